@@ -0,0 +1,114 @@
+/**
+ * @file main.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief Check that sampling never allocates, through a counting replacement of the global operator new. it lives in
+ * its own executable so the benchmarks keep the default allocator
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "Camera.h"
+#include "scenes.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+	std::atomic<uint64_t> allocation_count{0};
+	// set on a render worker from its first tile to its last, see Camera::setSamplingHook
+	thread_local bool sampling = false;
+
+	void *allocate(std::size_t size, std::size_t alignment) {
+		if (sampling)
+			allocation_count.fetch_add(1, std::memory_order_relaxed);
+		size = size == 0 ? 1 : size;
+		void *p = alignment <= alignof(std::max_align_t)
+						  ? std::malloc(size)
+						  : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	uint64_t allocationsDuring(Camera &camera, const IHittable &world, const std::string &name) {
+		auto path = std::string(IMG_OUTPUT_DIR) + "/bench";
+		auto before = allocation_count.load();
+		camera.Render(world, name, path);
+		return allocation_count.load() - before;
+	}
+} // namespace
+
+void *operator new(std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+
+void *operator new[](std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+	return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+	return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+/**
+ * @brief render every bundled scene in each integrator and count the allocations the workers make between their first
+ * and their last tile. setup of the scene, its BVHs, the framebuffer and the threads, and the image output, are not
+ * counted
+ * usage: RaytracingAllocations, fails when any sample allocated
+ */
+int main() {
+	struct Mode {
+		const char *name;
+		Integrator integrator;
+		bool packets;
+		bool adaptive;
+	};
+	const Mode modes[] = {
+			{"iterative", Integrator::Iterative, false, false},
+			{"recursive", Integrator::Recursive, false, false},
+			{"packets", Integrator::Iterative, true, false},
+			{"adaptive", Integrator::Iterative, false, true},
+	};
+	Camera::setSamplingHook([](bool on) { sampling = on; });
+	bool clean = true;
+	for (const auto &entry: bundledScenes()) {
+		spdlog::set_level(spdlog::level::warn);
+		auto scene = entry.make();
+		auto &camera = scene.camera;
+		camera.setWidth(64);
+		camera.setSampleCount(4);
+		for (const auto &mode: modes) {
+			camera.setIntegrator(mode.integrator);
+			camera.setPacketTracing(mode.packets);
+			camera.setAdaptiveSampling(mode.adaptive);
+			auto count = allocationsDuring(camera, scene.world, scene.name);
+			spdlog::set_level(spdlog::level::info);
+			if (count != 0) {
+				spdlog::error("{} ({}): {} allocations while sampling", entry.name, mode.name, count);
+				clean = false;
+			} else {
+				spdlog::info("{} ({}): no allocations while sampling", entry.name, mode.name);
+			}
+			spdlog::set_level(spdlog::level::warn);
+		}
+	}
+	spdlog::set_level(spdlog::level::info);
+	return clean ? 0 : 1;
+}
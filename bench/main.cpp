@@ -0,0 +1,487 @@
+/**
+ * @file main.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Benchmarks for the renderer, results are logged and written as JSON
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BVH.h"
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "GraphicObjects.h"
+#include "ImageUtil.h"
+#include "Material.h"
+#include "MeshLoader.h"
+#include "RayPacket.h"
+#include "RenderPool.h"
+#include "SceneFile.h"
+#include "Texture.h"
+#include "scenes.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+	// resolution and samples every bundled scene is overridden with
+	constexpr int scene_width = 320;
+	constexpr int scene_samples = 16;
+
+	// keeps the results of the measured loops alive
+	volatile double sink;
+
+	struct MicroResult {
+		std::string name;
+		double ns_per_op;
+	};
+
+	struct ScalingResult {
+		int threads;
+		double ms;
+		double rays_per_s;
+	};
+
+	struct SceneResult {
+		std::string name;
+		int width, height, samples;
+		uint64_t rays;
+		std::vector<ScalingResult> scaling;
+	};
+
+	template<typename F>
+	double averageMs(int iterations, F &&f) {
+		f();
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			f();
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(end - begin).count() / iterations;
+	}
+
+	/**
+	 * @brief repeat f, which does ops operations per call, for at least a fifth of a second
+	 */
+	template<typename F>
+	double nsPerOp(size_t ops, F &&f) {
+		f();
+		size_t calls = 0;
+		auto begin = std::chrono::steady_clock::now();
+		std::chrono::duration<double, std::nano> elapsed{};
+		do {
+			f();
+			calls++;
+			elapsed = std::chrono::steady_clock::now() - begin;
+		} while (elapsed < std::chrono::milliseconds(200));
+		return elapsed.count() / static_cast<double>(calls * ops);
+	}
+
+	// rays from a shell around the origin towards the unit cube, most of them reach anything placed there
+	std::vector<Ray> randomRays(size_t count, Real distance) {
+		PCG32 rng(3, 1);
+		std::vector<Ray> rays;
+		rays.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			Vec3 origin = randomUnitVec3(rng) * distance;
+			Vec3 target = randomVec3(rng, -1, 1);
+			rays.emplace_back(origin, (target - origin).normalized(), 0);
+		}
+		return rays;
+	}
+
+	/**
+	 * @brief counts the rays traced against the wrapped world, packets count their active lanes
+	 */
+	class RayCounter : public IHittable {
+	public:
+		explicit RayCounter(const IHittable &world) : world(world) {}
+
+		bool hit(const Ray &r, Interval interval, HitRecord &record) const override {
+			rays.fetch_add(1, std::memory_order_relaxed);
+			return world.hit(r, interval, record);
+		}
+
+		void hitPacket(const RayPacket &packet, float t_min, PacketHit &result) const override {
+			rays.fetch_add(packet.active.count(), std::memory_order_relaxed);
+			world.hitPacket(packet, t_min, result);
+		}
+
+		AABB boundingBox() const override { return world.boundingBox(); }
+
+		void gatherLights(std::vector<const IHittable *> &lights) const override { world.gatherLights(lights); }
+
+		uint64_t count() const { return rays.load(); }
+
+	private:
+		const IHittable &world;
+		mutable std::atomic<uint64_t> rays{0};
+	};
+
+	void primitiveBench(std::vector<MicroResult> &results) {
+		Lambertian material(Color{0.5, 0.5, 0.5});
+		auto rays = randomRays(4096, 5);
+		Sphere sphere(1, Point3{0, 0, 0}, &material);
+		Quad quad(Point3{-1, -1, 0}, Vec3{2, 0, 0}, Vec3{0, 2, 0}, &material);
+		Triangle triangle(Point3{-1, -1, 0}, Vec3{2, 0, 0}, Vec3{0, 2, 0}, &material);
+		AABB box(Point3{-1, -1, -1}, Point3{1, 1, 1});
+		auto hitAll = [&](const IHittable &object) {
+			return nsPerOp(rays.size(), [&]() {
+				HitRecord record;
+				int hits = 0;
+				for (auto &ray: rays)
+					hits += object.hit(ray, Interval(0.001, INF), record);
+				sink = hits;
+			});
+		};
+		results.push_back({"Sphere::hit", hitAll(sphere)});
+		results.push_back({"Quad::hit", hitAll(quad)});
+		results.push_back({"Triangle::hit", hitAll(triangle)});
+		results.push_back({"AABB::hit", nsPerOp(rays.size(), [&]() {
+							   int hits = 0;
+							   for (auto &ray: rays)
+								   hits += box.hit(ray, Interval(0.001, INF));
+							   sink = hits;
+						   })});
+	}
+
+	void bvhBench(std::vector<MicroResult> &results) {
+		Lambertian material(Color{0.5, 0.5, 0.5});
+		PCG32 rng(5, 1);
+		std::vector<std::shared_ptr<IHittable>> objects;
+		for (int i = 0; i < 20000; i++) {
+			objects.push_back(std::make_shared<Sphere>(0.01, randomVec3(rng, -1, 1), &material));
+		}
+		// every build logs its report
+		spdlog::set_level(spdlog::level::warn);
+		results.push_back({"LinearBVH build (per primitive)",
+						   nsPerOp(objects.size(), [&]() { sink = LinearBVH(objects).nodeCount(); })});
+		spdlog::set_level(spdlog::level::info);
+		LinearBVH bvh(objects);
+		auto rays = randomRays(4096, 5);
+		results.push_back({"LinearBVH::hit", nsPerOp(rays.size(), [&]() {
+							   HitRecord record;
+							   int hits = 0;
+							   for (auto &ray: rays)
+								   hits += bvh.hit(ray, Interval(0.001, INF), record);
+							   sink = hits;
+						   })});
+	}
+
+	/**
+	 * @brief write a rippled grid of 2 * n * n triangles as OBJ and as binary PLY
+	 */
+	void writeGridMesh(int n, const std::filesystem::path &obj, const std::filesystem::path &ply) {
+		auto height = [n](int i, int j) {
+			return 0.1 * std::sin(i * 20.0 / n) * std::cos(j * 20.0 / n);
+		};
+		std::string text;
+		std::ofstream ply_out(ply, std::ios::binary);
+		ply_out << fmt::format("ply\nformat binary_little_endian 1.0\nelement vertex {}\n"
+							   "property float x\nproperty float y\nproperty float z\nelement face {}\n"
+							   "property list uchar int vertex_indices\nend_header\n",
+							   (n + 1) * (n + 1), 2 * n * n);
+		for (int i = 0; i <= n; i++) {
+			for (int j = 0; j <= n; j++) {
+				float v[3] = {2.0f * i / n - 1, static_cast<float>(height(i, j)), 2.0f * j / n - 1};
+				fmt::format_to(std::back_inserter(text), "v {} {} {}\n", v[0], v[1], v[2]);
+				ply_out.write(reinterpret_cast<const char *>(v), sizeof(v));
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) {
+				int a = i * (n + 1) + j, b = a + 1, c = a + n + 1, d = c + 1;
+				// OBJ counts from 1
+				fmt::format_to(std::back_inserter(text), "f {} {} {}\nf {} {} {}\n", a + 1, b + 1, d + 1, a + 1,
+							   d + 1, c + 1);
+				int faces[2][3] = {{a, b, d}, {a, d, c}};
+				for (auto &face: faces) {
+					ply_out.put(3);
+					ply_out.write(reinterpret_cast<const char *>(face), sizeof(face));
+				}
+			}
+		}
+		std::ofstream(obj, std::ios::binary) << text;
+	}
+
+	void meshBench(std::vector<MicroResult> &results) {
+		auto dir = std::filesystem::path(IMG_OUTPUT_DIR) / "bench";
+		std::filesystem::create_directories(dir);
+		auto obj = (dir / "grid.obj").string();
+		auto ply = (dir / "grid.ply").string();
+		writeGridMesh(708, obj, ply);
+		auto mesh = loadObj(obj);
+		if (mesh == nullptr || loadPly(ply) == nullptr)
+			return;
+		auto triangles = static_cast<double>(mesh->triangleCount());
+		spdlog::set_level(spdlog::level::warn);
+		results.push_back({"loadObj (per triangle)", averageMs(2, [&]() { sink = loadObj(obj)->triangleCount(); }) *
+															 1e6 / triangles});
+		results.push_back({"loadPly (per triangle)", averageMs(2, [&]() { sink = loadPly(ply)->triangleCount(); }) *
+															 1e6 / triangles});
+		Lambertian material(Color{0.5, 0.5, 0.5});
+		results.push_back({"TriangleMesh build (per triangle)",
+						   averageMs(2, [&]() { sink = TriangleMesh(mesh, {&material}).memoryUsage(); }) * 1e6 /
+								   triangles});
+		spdlog::set_level(spdlog::level::info);
+		TriangleMesh object(mesh, {&material});
+		spdlog::info("{} triangles take {:.1f}MB of buffers and {:.1f}MB of BVH", mesh->triangleCount(),
+					 mesh->memoryUsage() / 1048576.0, object.memoryUsage() / 1048576.0);
+		auto rays = randomRays(4096, 5);
+		results.push_back({"TriangleMesh::hit", nsPerOp(rays.size(), [&]() {
+							   HitRecord record;
+							   int hits = 0;
+							   for (auto &ray: rays)
+								   hits += object.hit(ray, Interval(0.001, INF), record);
+							   sink = hits;
+						   })});
+
+		// the grid as a scene file, loaded from text and then from its cache
+		auto scene = (dir / "grid.scene").string();
+		auto cache = scene + ".cache";
+		std::ofstream(scene) << "material grey lambertian .5 .5 .5\nmesh grid.ply grey\n";
+		std::filesystem::remove(cache);
+		spdlog::set_level(spdlog::level::warn);
+		results.push_back({"loadSceneFile (per triangle)",
+						   averageMs(2, [&]() { sink = loadSceneFile(scene).has_value(); }) * 1e6 / triangles});
+		sink = loadScene(scene, cache).has_value();
+		results.push_back({"loadScene from cache (per triangle)",
+						   averageMs(2, [&]() { sink = loadScene(scene, cache).has_value(); }) * 1e6 / triangles});
+		spdlog::set_level(spdlog::level::info);
+	}
+
+	void textureBench(std::vector<MicroResult> &results) {
+		PCG32 rng(9, 1);
+		std::vector<Point3> points;
+		for (int i = 0; i < 4096; i++) {
+			points.push_back(randomVec3(rng, -10, 10));
+		}
+		Perlin perlin;
+		results.push_back({"Perlin::octaveNoise", nsPerOp(points.size(), [&]() {
+							   double sum = 0;
+							   for (auto &p: points)
+								   sum += perlin.octaveNoise(p, 1, 10, 0.5);
+							   sink = sum;
+						   })});
+		auto lookup = [&](const ITexture &texture) {
+			return nsPerOp(points.size(), [&]() {
+				double sum = 0;
+				for (auto &p: points) {
+					auto u = static_cast<float>(p.x() * 0.05 + 0.5);
+					auto v = static_cast<float>(p.y() * 0.05 + 0.5);
+					sum += texture.value(u, v, p).x();
+				}
+				sink = sum;
+			});
+		};
+		results.push_back({"SolidColor::value", lookup(SolidColor(Color{0.5, 0.5, 0.5}))});
+		results.push_back({"CheckerTexture::value",
+						   lookup(CheckerTexture(0.1, Color{0.05, 0.1, 0.1}, Color{0.9, 0.9, 0.9}))});
+		ImageTexture image("huaji.jpeg");
+		results.push_back({"ImageTexture::value", lookup(image)});
+		// a few texels of the 256 pixel wide test image, between levels 1 and 2
+		results.push_back({"ImageTexture::filteredValue", nsPerOp(points.size(), [&]() {
+							   double sum = 0;
+							   for (auto &p: points) {
+								   auto u = static_cast<float>(p.x() * 0.05 + 0.5);
+								   auto v = static_cast<float>(p.y() * 0.05 + 0.5);
+								   sum += image.filteredValue(u, v, p, 0.01f).x();
+							   }
+							   sink = sum;
+						   })});
+		results.push_back({"NoiseTexture::value", lookup(NoiseTexture(1, 10, 0.5))});
+		results.push_back({"TerrainTexture::value", lookup(TerrainTexture(0.5, 10, 0.5))});
+		spdlog::set_level(spdlog::level::warn);
+		TerrainTexture baked(0.5, 10, 0.5);
+		baked.bake(AABB{Point3{-10, -10, -10}, Point3{10, 10, 10}}, 160);
+		spdlog::set_level(spdlog::level::info);
+		results.push_back({"TerrainTexture::value (baked)", lookup(baked)});
+	}
+
+	void materialBench(std::vector<MicroResult> &results) {
+		MaterialTable table;
+		auto checker = std::make_shared<CheckerTexture>(0.1, Color{0.05, 0.1, 0.1}, Color{0.9, 0.9, 0.9});
+		const IMaterial *materials[] = {
+				table.add<Lambertian>(checker),
+				table.add<Metal>(Color{0.8, 0.6, 0.2}, 0.1),
+				table.add<Dielectric>(1.5, Color{1, 1, 1}),
+				table.add<DiffuseLight>(Color{4, 4, 4}),
+		};
+		// hits cycle through the materials, like neighbouring paths of a mixed scene
+		auto rays = randomRays(4096, 11);
+		std::vector<HitRecord> records(rays.size());
+		for (size_t i = 0; i < rays.size(); i++) {
+			auto &record = records[i];
+			record.p = rays[i].pos();
+			record.normal = -rays[i].dir().normalized();
+			record.front_face = true;
+			record.u = static_cast<float>(i % 64) / 64;
+			record.v = static_cast<float>(i / 64 % 64) / 64;
+			record.material = materials[i * 7 / 3 % 4];
+		}
+		auto shade = [&](auto scatter) {
+			PCG32 rng(3, 1);
+			return nsPerOp(rays.size(), [&]() {
+				double sum = 0;
+				Vec3 attenuation;
+				Ray scattered;
+				for (size_t i = 0; i < rays.size(); i++)
+					if (scatter(*records[i].material, rays[i], records[i], attenuation, scattered, rng))
+						sum += attenuation.x() + scattered.dir().x();
+				sink = sum;
+			});
+		};
+		results.push_back({"IMaterial::scatter (virtual)",
+						   shade([](const IMaterial &material, const Ray &ray, const HitRecord &record, Vec3 &attenuation,
+									Ray &scattered, PCG32 &rng) {
+							   return material.scatter(ray, record, attenuation, scattered, rng);
+						   })});
+		results.push_back({"MaterialTable::scatter", shade(MaterialTable::scatter)});
+	}
+
+	void encodeBench(std::vector<MicroResult> &results) {
+		Framebuffer fb(1920, 1080);
+		for (int i = 0; i < fb.height(); i++) {
+			for (int j = 0; j < fb.width(); j++) {
+				float u = static_cast<float>(j) / fb.width();
+				float v = static_cast<float>(i) / fb.height();
+				fb.at(j, i) = Pixel(u, v, 1.5f * u * v);
+			}
+		}
+		auto path = std::string(IMG_OUTPUT_DIR) + "/bench";
+		for (auto format: {ImageFormat::PPM, ImageFormat::PFM, ImageFormat::PNG}) {
+			std::string file;
+			auto ms = averageMs(5, [&]() { file = writeImage(fb, "encode", format, path); });
+			if (file.empty())
+				continue;
+			results.push_back({fmt::format("writeImage {} 1920x1080", imageExtension(format)), ms * 1e6});
+			spdlog::info("encode {}x{} {}: {:.2f}ms, {} bytes", fb.width(), fb.height(), imageExtension(format), ms,
+						 std::filesystem::file_size(file));
+		}
+	}
+
+	// what a render pays to hand its workers out, before any of them traces a ray
+	void dispatchBench(std::vector<MicroResult> &results) {
+		int workers = std::max(1u, std::thread::hardware_concurrency());
+		std::atomic<int> ran{0};
+		results.push_back({fmt::format("spawn and join {} threads", workers), nsPerOp(1, [&]() {
+							   std::vector<std::thread> threads;
+							   for (int i = 0; i < workers; i++)
+								   threads.emplace_back([&] { ran.fetch_add(1, std::memory_order_relaxed); });
+							   for (auto &thread: threads)
+								   thread.join();
+						   })});
+		RenderPool pool(workers);
+		results.push_back({fmt::format("RenderPool::run {} workers", workers), nsPerOp(1, [&]() {
+							   pool.run(workers, [&](int) { ran.fetch_add(1, std::memory_order_relaxed); });
+						   })});
+		sink = ran.load();
+	}
+
+	std::vector<int> threadCounts() {
+		int hardware = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<int> counts;
+		for (int threads = 1; threads < hardware; threads *= 2)
+			counts.push_back(threads);
+		counts.push_back(hardware);
+		return counts;
+	}
+
+	std::vector<SceneResult> sceneBench() {
+		auto path = std::string(IMG_OUTPUT_DIR) + "/bench";
+		std::vector<SceneResult> results;
+		for (auto &entry: bundledScenes()) {
+			spdlog::set_level(spdlog::level::warn);
+			auto scene = entry.make();
+			auto &camera = scene.camera;
+			camera.setWidth(scene_width);
+			camera.setSampleCount(scene_samples);
+			camera.setChunkDimension(32);
+			SceneResult result{entry.name, camera.getWidth(), camera.getHeight(), scene_samples, 0, {}};
+			// every pixel has its own random sequence, so the rays traced do not depend on the thread count
+			RayCounter counter(scene.world);
+			camera.Render(counter, scene.name, path);
+			result.rays = counter.count();
+			for (int threads: threadCounts()) {
+				camera.setRenderThreadCount(threads);
+				auto begin = std::chrono::steady_clock::now();
+				camera.Render(scene.world, scene.name, path);
+				auto end = std::chrono::steady_clock::now();
+				auto ms = std::chrono::duration<double, std::milli>(end - begin).count();
+				result.scaling.push_back({threads, ms, static_cast<double>(result.rays) / ms * 1e3});
+			}
+			spdlog::set_level(spdlog::level::info);
+			for (auto &run: result.scaling) {
+				spdlog::info("scene {} ({}-bit, {} threads): {:.1f}ms, {:.2f}M rays/s, {:.2f}M rays/s per core",
+							 result.name, 8 * sizeof(Real), run.threads, run.ms, run.rays_per_s / 1e6,
+							 run.rays_per_s / 1e6 / run.threads);
+			}
+			results.push_back(std::move(result));
+		}
+		return results;
+	}
+
+	std::string toJson(const std::vector<MicroResult> &micro, const std::vector<SceneResult> &scenes) {
+		std::string json = fmt::format("{{\n  \"precision_bits\": {},\n  \"hardware_threads\": {},\n  \"micro\": [",
+									   8 * sizeof(Real), std::thread::hardware_concurrency());
+		for (size_t i = 0; i < micro.size(); i++) {
+			json += fmt::format("{}\n    {{\"name\": \"{}\", \"ns_per_op\": {:.3f}, \"mops_per_s\": {:.3f}}}",
+								i ? "," : "", micro[i].name, micro[i].ns_per_op, 1e3 / micro[i].ns_per_op);
+		}
+		json += "\n  ],\n  \"scenes\": [";
+		for (size_t i = 0; i < scenes.size(); i++) {
+			auto &scene = scenes[i];
+			json += fmt::format("{}\n    {{\"name\": \"{}\", \"width\": {}, \"height\": {}, \"samples\": {}, "
+								"\"rays\": {}, \"scaling\": [",
+								i ? "," : "", scene.name, scene.width, scene.height, scene.samples, scene.rays);
+			double base_ms = scene.scaling.front().ms;
+			for (size_t j = 0; j < scene.scaling.size(); j++) {
+				auto &run = scene.scaling[j];
+				double speedup = base_ms / run.ms;
+				json += fmt::format("{}\n      {{\"threads\": {}, \"ms\": {:.3f}, \"rays_per_s\": {:.0f}, "
+									"\"mrays_per_core\": {:.4f}, \"speedup\": {:.3f}, \"efficiency\": {:.3f}}}",
+									j ? "," : "", run.threads, run.ms, run.rays_per_s,
+									run.rays_per_s / 1e6 / run.threads, speedup, speedup / run.threads);
+			}
+			json += "\n    ]}";
+		}
+		json += "\n  ]\n}\n";
+		return json;
+	}
+} // namespace
+
+/**
+ * usage: RaytracingBench [result.json], the results go to bench/bench_<bits>.json under the output directory by
+ * default
+ */
+int main(int argc, char **argv) {
+	std::vector<MicroResult> micro;
+	primitiveBench(micro);
+	bvhBench(micro);
+	meshBench(micro);
+	textureBench(micro);
+	materialBench(micro);
+	encodeBench(micro);
+	dispatchBench(micro);
+	for (auto &result: micro) {
+		spdlog::info("{}: {:.2f}ns/op", result.name, result.ns_per_op);
+	}
+	auto scenes = sceneBench();
+
+	auto dir = std::filesystem::path(IMG_OUTPUT_DIR) / "bench";
+	std::filesystem::create_directories(dir);
+	auto file = argc > 1 ? std::filesystem::path(argv[1]) : dir / fmt::format("bench_{}.json", 8 * sizeof(Real));
+	std::ofstream out(file);
+	if (!out) {
+		spdlog::error("cannot write {}", file.string());
+		return 1;
+	}
+	out << toJson(micro, scenes);
+	spdlog::info("results written to {}", file.string());
+	return 0;
+}
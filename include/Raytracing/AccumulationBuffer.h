@@ -0,0 +1,66 @@
+/**
+ * @file AccumulationBuffer.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Running radiance sums of a progressive render, saved and restored as a binary checkpoint
+ */
+
+#ifndef RAYTRACING_ACCUMULATIONBUFFER_H
+#define RAYTRACING_ACCUMULATIONBUFFER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Framebuffer.h"
+
+class AccumulationBuffer {
+public:
+	AccumulationBuffer(int width, int height);
+
+	int width() const;
+
+	int height() const;
+
+	/**
+	 * @brief number of passes added so far, also the index of the next pass
+	 */
+	uint32_t passes() const;
+
+	/**
+	 * @brief smallest sample count of any pixel
+	 */
+	uint32_t samples() const;
+
+	/**
+	 * @brief add a pass in which every pixel is the average of the given number of samples
+	 */
+	void add(const Framebuffer &pass, uint32_t samples);
+
+	/**
+	 * @brief write the average of every pixel into image
+	 */
+	void resolve(Framebuffer &image) const;
+
+	/**
+	 * @brief write sums, counts and the pass count to file, through a temporary file that replaces it once complete so
+	 * a crash mid write leaves the previous checkpoint intact
+	 */
+	bool save(const std::string &file, uint64_t seed, uint64_t settings) const;
+
+	/**
+	 * @brief restore a checkpoint written by save
+	 * @param settings fingerprint of the scene and render settings the samples depend on
+	 * @return false when the file is missing, damaged or from a render with another size, seed or settings
+	 */
+	bool load(const std::string &file, uint64_t seed, uint64_t settings);
+
+private:
+	int acc_width;
+	int acc_height;
+	uint32_t pass_count = 0;
+	// RGB per pixel
+	std::vector<float> sums;
+	std::vector<uint32_t> counts;
+};
+
+#endif // RAYTRACING_ACCUMULATIONBUFFER_H
@@ -0,0 +1,232 @@
+/**
+ * @file BVH.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Flattened bounding volume hierarchy stored as a contiguous node array
+ */
+
+#ifndef RAYTRACING_BVH_H
+#define RAYTRACING_BVH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "GraphicObjects.h"
+#include "MathUtil.h"
+#include "PrimitiveBatch.h"
+#include "RenderStats.h"
+
+/**
+ * @brief one node of the flattened tree, laid out in depth-first order.
+ * the first child of an interior node always sits right after it, so only the offset of the second child is stored.
+ * leaves store a range into the reordered primitive array instead, sorted so primitives of one kind are adjacent.
+ */
+struct alignas(32) LinearBVHNode {
+	float bounds_min[3];
+	float bounds_max[3];
+	union {
+		uint32_t primitive_offset;
+		uint32_t second_child_offset;
+	};
+	uint16_t primitive_count;
+	uint8_t axis;
+	uint8_t pad;
+
+	bool isLeaf() const { return primitive_count > 0; }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should fit in half a cache line");
+
+/**
+ * @brief slab test of a single ray against the box of a node, the near planes are picked by the sign of the direction
+ */
+inline bool hitNodeBounds(const LinearBVHNode &node, const float origin[3], const float inv_dir[3],
+						  const int dir_is_neg[3], float t_min, float t_max) {
+	for (int i = 0; i < 3; i++) {
+		float t0 = ((dir_is_neg[i] ? node.bounds_max[i] : node.bounds_min[i]) - origin[i]) * inv_dir[i];
+		float t1 = ((dir_is_neg[i] ? node.bounds_min[i] : node.bounds_max[i]) - origin[i]) * inv_dir[i];
+		t_min = t0 > t_min ? t0 : t_min;
+		t_max = t1 < t_max ? t1 : t_max;
+		if (t_max < t_min)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief statistics gathered while building a LinearBVH
+ */
+struct BVHBuildReport {
+	size_t node_count = 0;
+	size_t leaf_count = 0;
+	size_t primitive_count = 0;
+	int depth = 0;
+	float sah_cost = 0;
+	float build_time_ms = 0;
+};
+
+class LinearBVH : public IHittable {
+public:
+	LinearBVH() = default;
+
+	explicit LinearBVH(const HittableList &list);
+
+	explicit LinearBVH(const std::vector<std::shared_ptr<IHittable>> &objects);
+
+	/**
+	 * @brief restore a tree saved from flatNodes and primitiveOrder over the same objects, without building it again
+	 */
+	LinearBVH(const std::vector<std::shared_ptr<IHittable>> &objects, std::vector<LinearBVHNode> nodes,
+			  const std::vector<uint32_t> &order);
+
+	bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
+
+	void hitPacket(const RayPacket &packet, float t_min, PacketHit &result) const override;
+
+	AABB boundingBox() const override;
+
+	void gatherLights(std::vector<const IHittable *> &lights) const override;
+
+	size_t nodeCount() const;
+
+	size_t primitiveCount() const;
+
+	const BVHBuildReport &buildReport() const;
+
+	const std::vector<LinearBVHNode> &flatNodes() const;
+
+	/**
+	 * @brief index into objects of every primitive slot, objects being what the tree was built over
+	 */
+	std::vector<uint32_t> primitiveOrder(const std::vector<std::shared_ptr<IHittable>> &objects) const;
+
+	/**
+	 * @brief build only the node array over bare boxes, for hittables that keep their own primitives.
+	 * leaves index into order, which receives the index of the box every slot refers to
+	 */
+	static std::vector<LinearBVHNode> buildNodes(const std::vector<AABB> &boxes, std::vector<uint32_t> &order,
+												 BVHBuildReport &report);
+
+	/**
+	 * @brief walk the tree in nodes from root, near child first, and call leaf on every leaf r enters within
+	 * (t_min, closest_t). leaf tests the primitives of the node and lowers closest_t on a hit, which culls the nodes
+	 * behind it
+	 */
+	template <typename Leaf>
+	static void traverseNodes(const std::vector<LinearBVHNode> &nodes, uint32_t root, const Ray &r, Real t_min,
+							  const Real &closest_t, Leaf &&leaf);
+
+	// leaves are tested a batch at a time, so they can hold two batches before a split pays off
+	static constexpr int max_leaf_size = 2 * batch_width;
+
+	static constexpr int max_depth = 64;
+
+	static constexpr int bin_count = 16;
+
+	static constexpr float traversal_cost = 1;
+
+	static constexpr float intersection_cost = 1;
+
+	// cost of one SIMD leaf kernel call relative to a single primitive test
+	static constexpr float batch_cost = 2;
+
+	// subtrees with fewer primitives than this are built on the calling thread
+	static constexpr size_t parallel_threshold = 4096;
+
+	// packets with fewer live rays than this leave the packet path for single ray traversal
+	static constexpr int divergence_threshold = packet_size / 4 > 1 ? packet_size / 4 : 2;
+
+private:
+	struct Bounds {
+		Eigen::Array3d min = Eigen::Array3d::Constant(INF);
+		Eigen::Array3d max = Eigen::Array3d::Constant(-INF);
+
+		void extend(const Bounds &other);
+
+		void extend(const Eigen::Array3d &p);
+
+		double surfaceArea() const;
+	};
+
+	struct PrimitiveInfo {
+		uint32_t index;
+		Bounds bounds;
+		Eigen::Array3d centroid;
+		PrimitiveKind kind;
+	};
+
+	struct BuildNode {
+		Bounds bounds;
+		std::unique_ptr<BuildNode> children[2];
+		uint32_t primitive_offset = 0;
+		uint32_t primitive_count = 0;
+		uint8_t axis = 0;
+	};
+
+	static PrimitiveInfo makeInfo(uint32_t index, const AABB &box, PrimitiveKind kind);
+
+	// builds and flattens the tree, info is left in leaf order
+	void buildTree(std::vector<PrimitiveInfo> &info);
+
+	// estimated while choosing a split, when only the primitive count of each side is known
+	static float leafCost(size_t count);
+
+	static float leafCost(const std::vector<PrimitiveInfo> &info, size_t start, size_t end);
+
+	std::unique_ptr<BuildNode> buildRecursive(std::vector<PrimitiveInfo> &info, size_t start, size_t end,
+											  int depth) const;
+
+	uint32_t flatten(const BuildNode &node, int depth, double root_area);
+
+	bool traverse(const Ray &r, Interval interval, HitRecord &record, uint32_t root,
+				  const IHittable **hit_object) const;
+
+	std::vector<LinearBVHNode> nodes;
+	std::vector<std::shared_ptr<IHittable>> primitives;
+	PrimitiveBatch batch;
+	AABB bbox;
+	BVHBuildReport report;
+};
+
+template <typename Leaf>
+void LinearBVH::traverseNodes(const std::vector<LinearBVHNode> &nodes, uint32_t root, const Ray &r, Real t_min,
+							  const Real &closest_t, Leaf &&leaf) {
+	auto pos = r.pos();
+	auto dir = r.dir();
+	float origin[3] = {static_cast<float>(pos[0]), static_cast<float>(pos[1]), static_cast<float>(pos[2])};
+	float inv_dir[3];
+	int dir_is_neg[3];
+	for (int i = 0; i < 3; i++) {
+		inv_dir[i] = static_cast<float>(1.0 / dir[i]);
+		dir_is_neg[i] = inv_dir[i] < 0;
+	}
+
+	uint32_t stack[max_depth];
+	int stack_top = 0;
+	uint32_t current = root;
+	while (true) {
+		const auto &node = nodes[current];
+		RAYTRACING_STAT(thread_stats.bvh_nodes++);
+		if (hitNodeBounds(node, origin, inv_dir, dir_is_neg, static_cast<float>(t_min),
+						  static_cast<float>(closest_t))) {
+			if (node.isLeaf()) {
+				leaf(node);
+				if (stack_top == 0)
+					break;
+				current = stack[--stack_top];
+			} else if (dir_is_neg[node.axis]) {
+				stack[stack_top++] = current + 1;
+				current = node.second_child_offset;
+			} else {
+				stack[stack_top++] = node.second_child_offset;
+				current = current + 1;
+			}
+		} else {
+			if (stack_top == 0)
+				break;
+			current = stack[--stack_top];
+		}
+	}
+}
+
+#endif // RAYTRACING_BVH_H
@@ -10,13 +10,26 @@
 
 #include <thread>
 #include "Eigen/Dense"
+#include "Framebuffer.h"
 #include "GraphicObjects.h"
 #include "ImageUtil.h"
+#include "Light.h"
 #include "MathUtil.h"
+#include "RenderPool.h"
+#include "RenderStats.h"
+#include "TileScheduler.h"
+
+enum class Integrator {
+	// rayColor recursing until render_depth or until the ray escapes
+	Recursive,
+	// loop carrying the path throughput, ended early by Russian roulette past the roulette depth. samples the
+	// emissive primitives at every diffuse vertex when light sampling is on
+	Iterative
+};
 
 class Camera {
 public:
-	Camera(int width, float aspect_ratio, float fov, Point3 position, Eigen::Vector3d target, float dof_angle);
+	Camera(int width, float aspect_ratio, float fov, Point3 position, Vec3 target, float dof_angle);
 
 	int getWidth() const;
 
@@ -36,13 +49,13 @@ public:
 
 	const Point3 &getPosition() const;
 
-	const Eigen::Vector3d &getHoriVec() const;
+	const Vec3 &getHoriVec() const;
 
-	const Eigen::Vector3d &getVertVec() const;
+	const Vec3 &getVertVec() const;
 
-	const Eigen::Vector3d &getPixDeltaX() const;
+	const Vec3 &getPixDeltaX() const;
 
-	const Eigen::Vector3d &getPixDeltaY() const;
+	const Vec3 &getPixDeltaY() const;
 
 	const Point3 &getViewportUl() const;
 
@@ -58,10 +71,31 @@ public:
 
 	void setFov(float fov);
 
-	Ray getRay(int x, int y);
+	Ray getRay(int x, int y, PCG32 &rng) const;
+
+	/**
+	 * @brief random stream for a pixel, derived only from the seed, the pixel coordinate and the progressive pass
+	 */
+	PCG32 pixelRng(int x, int y, uint32_t pass = 0) const;
+
+	uint64_t getSeed() const;
+
+	void setSeed(uint64_t seed);
 
 	std::string Render(const IHittable &world, const std::string &name, const std::string &path);
 
+	/**
+	 * @brief Render without writing the image, which writeOutput does later. stats and the adaptive sampling heatmap
+	 * are still written under name. progressive passes and checkpoints are left to Render
+	 */
+	Framebuffer renderImage(const IHittable &world, const std::string &name, const std::string &path);
+
+	/**
+	 * @brief encode image in the output format as name under path
+	 * @return the file written, empty when it could not be written
+	 */
+	std::string writeOutput(const Framebuffer &image, const std::string &name, const std::string &path) const;
+
 	int getRenderDepth() const;
 
 	void setRenderDepth(int renderDepth);
@@ -70,6 +104,19 @@ public:
 
 	void setRenderThreadCount(int renderThreadCount);
 
+	RenderPool *getRenderPool() const;
+
+	/**
+	 * @brief threads Render runs its workers on, not owned. null uses RenderPool::shared
+	 */
+	void setRenderPool(RenderPool *pool);
+
+	/**
+	 * @brief called by every render worker on its own thread, with true before its first tile and false after its
+	 * last. lets tools like the allocation check watch the sampling alone, null by default
+	 */
+	static void setSamplingHook(void (*hook)(bool sampling));
+
 	const Point3 &getTarget() const;
 
 	void setTarget(const Point3 &target);
@@ -88,26 +135,179 @@ public:
 
 	void setShutterSpeed(float shutterSpeed);
 
-	void setRotation(const Eigen::Vector3d &rot);
+	float getShutterOpen() const;
 
-	Eigen::Vector3d getRotation() const;
+	/**
+	 * @brief time the shutter opens at, rays get times in [open, open + shutter speed]. frames of an animation move it
+	 * along
+	 */
+	void setShutterOpen(float time);
+
+	void setRotation(const Vec3 &rot);
+
+	Vec3 getRotation() const;
 
 	Color getBackground() const;
 
 	void setBackground(const Color &background);
 
+	ImageFormat getOutputFormat() const;
+
+	/**
+	 * @brief format Render writes the image in, the extension of the file name is adjusted to match
+	 */
+	void setOutputFormat(ImageFormat format);
+
+	bool getPacketTracing() const;
+
+	/**
+	 * @brief trace camera rays in SIMD packets of packet_size neighbouring pixels, secondary rays stay scalar
+	 */
+	void setPacketTracing(bool enabled);
+
+	Integrator getIntegrator() const;
+
+	void setIntegrator(Integrator integrator);
+
+	int getRouletteDepth() const;
+
+	/**
+	 * @brief bounces every path of the iterative integrator takes before Russian roulette may end it
+	 */
+	void setRouletteDepth(int depth);
+
+	bool getLightSampling() const;
+
+	/**
+	 * @brief next event estimation for the iterative integrator, weighted against scattering by multiple importance
+	 * sampling
+	 */
+	void setLightSampling(bool enabled);
+
+	bool getAdaptiveSampling() const;
+
+	/**
+	 * @brief take at least the minimum sample count per pixel, then more rounds of that size until the relative error
+	 * of the pixel luminance drops below the threshold, capped at the sample count. Render also writes a heatmap of
+	 * the samples taken next to the image, named <name>_spp. camera rays are traced one by one in this mode
+	 */
+	void setAdaptiveSampling(bool enabled);
+
+	int getMinSampleCount() const;
+
+	void setMinSampleCount(int count);
+
+	float getAdaptiveThreshold() const;
+
+	/**
+	 * @brief half width of the 95% confidence interval of a pixel, relative to its luminance
+	 */
+	void setAdaptiveThreshold(float threshold);
+
+	int getProgressivePass() const;
+
+	/**
+	 * @brief render in passes of this many samples per pixel over the whole frame, 0 renders in one go. Render keeps
+	 * the running sums and writes a preview image and a checkpoint <name>.ckpt next to it every checkpoint interval
+	 */
+	void setProgressivePass(int samples);
+
+	float getCheckpointInterval() const;
+
+	/**
+	 * @brief seconds between progressive previews and checkpoints, the last pass always writes both
+	 */
+	void setCheckpointInterval(float seconds);
+
+	bool getResume() const;
+
+	/**
+	 * @brief continue a progressive render from a checkpoint of the same size, seed, scene and settings when there is
+	 * one. a finished checkpoint with a raised sample count gets the missing samples added
+	 */
+	void setResume(bool resume);
+
 private:
-	Color rayColor(const Ray &ray, const IHittable &object, int depth);
+	Color rayColor(const Ray &ray, const IHittable &object, int depth, PCG32 &rng) const;
+
+	/**
+	 * @brief emission plus scattered light at a hit that has already been found
+	 */
+	Color shade(const Ray &ray, const HitRecord &record, const IHittable &object, int depth, PCG32 &rng) const;
+
+	/**
+	 * @brief radiance along a camera ray with the selected integrator
+	 */
+	Color sample(const Ray &ray, const IHittable &world, PCG32 &rng) const;
+
+	/**
+	 * @brief radiance along a camera ray whose first hit has already been found
+	 */
+	Color sampleHit(const Ray &ray, const HitRecord &record, const IHittable &world, PCG32 &rng) const;
+
+	Color tracePath(Ray ray, HitRecord record, const IHittable &world, PCG32 &rng) const;
+
+	/**
+	 * @brief width of a pixel wide ray cone over the last segment, in the texture space of record. the cone restarts
+	 * at every vertex, so textures seen through bounces are filtered as if seen directly
+	 */
+	void setFootprint(const Ray &ray, HitRecord &record) const;
+
+	/**
+	 * @brief light reaching a diffuse hit along a shadow ray toward a random light, divided by the attenuation and
+	 * already weighted for multiple importance sampling
+	 */
+	Color sampleLight(const Ray &ray, const HitRecord &record, const IHittable &world, PCG32 &rng) const;
+
+	void renderTilePackets(const IHittable &world, TileView &view, uint32_t pass, int samples) const;
 
 	void updateVectors();
 
-	Eigen::Vector3d randomDisplacement() const;
+	Vec3 randomDisplacement(PCG32 &rng) const;
+
+	Point3 dofDiskSample(PCG32 &rng) const;
+
+	/**
+	 * @brief average of the adaptive sampling rounds of a pixel
+	 * @param samples number of samples taken
+	 */
+	Color samplePixelAdaptive(int x, int y, const IHittable &world, int &samples) const;
+
+	/**
+	 * @brief gather the lights of world for the render about to start
+	 * @return number of workers to render with
+	 */
+	int startRender(const IHittable &world);
+
+	/**
+	 * @brief fingerprint of everything a checkpoint depends on besides the size and seed: the view, the integrator
+	 * settings, and the bounds and lights of world. the sample count is left out, so a render can be resumed with more
+	 */
+	uint64_t checkpointSettings(const IHittable &world) const;
+
+	std::string renderProgressive(const IHittable &world, const std::string &name, const std::string &path,
+								  int worker_cnt, std::vector<RenderStats> &stats);
+
+	/**
+	 * @brief run the workers over every tile once
+	 * @param sample_map receives the sample count of every pixel and switches the workers to adaptive sampling, null
+	 * otherwise
+	 * @param pass progressive pass, selects the random streams
+	 * @param stats one entry per worker, the counters of the pass are added to it
+	 */
+	void renderPass(const IHittable &world, int worker_cnt, Framebuffer &image, Framebuffer *sample_map, uint32_t pass,
+					int samples, std::vector<RenderStats> &stats) const;
 
-	Point3 dofDiskSample() const;
+	/**
+	 * @brief write the counters of a render next to its image as <stem>_stats.json
+	 */
+	void writeStats(const std::vector<RenderStats> &stats, double seconds, const std::string &name,
+					const std::string &path) const;
 
-	void RenderWorker(const IHittable &world);
+	void RenderWorker(const IHittable &world, TileScheduler &scheduler, int worker_idx, Framebuffer &image,
+					  Framebuffer *sample_map, uint32_t pass, int samples, RenderStats &stats) const;
 
-	int partition() const;
+	void renderTile(const IHittable &world, TileView &view, Framebuffer *sample_map, uint32_t pass, int samples) const;
 
 	int width;
 	int height;
@@ -115,27 +315,45 @@ private:
 	float viewport_width;
 	float viewport_height;
 	float focal_len;
+	// angle between the rays of neighbouring pixels
+	float pixel_spread;
 	float fov = 45;
 	int sample_count = 20;
 	int render_depth = 50;
 	int render_thread_count = std::thread::hardware_concurrency() == 0 ? 12 : std::thread::hardware_concurrency();
-	int chunk_dimension = width / render_thread_count < 0 ? width : width / render_thread_count;
+	RenderPool *render_pool = nullptr;
+	static inline void (*sampling_hook)(bool sampling) = nullptr;
+	int chunk_dimension = 16;
 	float dof_angle = 0;
 	float shutter_speed = 1;
-	Eigen::Vector3d u, v, w;
+	float shutter_open = 0;
+	uint64_t seed = 0;
+	ImageFormat output_format = ImageFormat::PPM;
+	bool packet_tracing = false;
+	Integrator integrator = Integrator::Iterative;
+	int roulette_depth = 3;
+	bool light_sampling = true;
+	bool adaptive_sampling = false;
+	int min_sample_count = 16;
+	float adaptive_threshold = 0.05;
+	int progressive_pass = 0;
+	float checkpoint_interval = 60;
+	bool resume = false;
+	LightList lights;
+	Vec3 u, v, w;
 	Point3 position;
-	Eigen::Vector3d rotation_ypr = {0, 0, 0};
-	Eigen::Matrix3d rotation_matrix = Eigen::Matrix3d::Identity();
+	Vec3 rotation_ypr = {0, 0, 0};
+	Mat3 rotation_matrix = Mat3::Identity();
 	Point3 target;
-	Eigen::Vector3d UP = Eigen::Vector3d::UnitY();
-	Eigen::Vector3d hori_vec;
-	Eigen::Vector3d vert_vec;
-	Eigen::Vector3d pix_delta_x;
-	Eigen::Vector3d pix_delta_y;
+	Vec3 UP = Vec3::UnitY();
+	Vec3 hori_vec;
+	Vec3 vert_vec;
+	Vec3 pix_delta_x;
+	Vec3 pix_delta_y;
 	Point3 viewport_ul;
 	Point3 pixel_00;
-	Eigen::Vector3d dof_disk_h;
-	Eigen::Vector3d dof_disk_v;
+	Vec3 dof_disk_h;
+	Vec3 dof_disk_v;
 	Color background;
 };
 
@@ -0,0 +1,40 @@
+/**
+ * @file FrameSequence.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Animations rendered with the image output of each frame overlapped with the render of the next
+ */
+
+#ifndef RAYTRACING_FRAMESEQUENCE_H
+#define RAYTRACING_FRAMESEQUENCE_H
+
+#include <string>
+#include <vector>
+#include "Camera.h"
+
+struct Frame {
+	// carries the view and, through its shutter open time, the time of the frame
+	Camera camera;
+	std::string name;
+};
+
+struct FrameTiming {
+	// empty until the frame is written
+	std::string file;
+	// waiting for the writer to make room before the render could start
+	double wait_ms = 0;
+	double render_ms = 0;
+	// encoding and writing, on the writer thread
+	double write_ms = 0;
+};
+
+/**
+ * @brief render frames of one world in order under path. a background thread encodes and writes each finished frame
+ * while the next one renders. once max_pending frames are waiting for it, rendering waits too, so at most
+ * max_pending + 1 images are held at a time. the timings are logged and written to <path>/sequence_timing.json
+ * @return timings in frame order
+ */
+std::vector<FrameTiming> renderSequence(const IHittable &world, const std::vector<Frame> &frames,
+										const std::string &path, int max_pending = 2);
+
+#endif // RAYTRACING_FRAMESEQUENCE_H
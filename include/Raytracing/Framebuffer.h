@@ -0,0 +1,98 @@
+/**
+ * @file Framebuffer.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Contiguous row-major framebuffer the render workers write into in place
+ */
+
+#ifndef RAYTRACING_FRAMEBUFFER_H
+#define RAYTRACING_FRAMEBUFFER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include "MathUtil.h"
+#include "TileScheduler.h"
+
+/**
+ * @brief linear radiance of one pixel, padded to 16 bytes so a pixel never straddles a cache line
+ */
+struct alignas(16) Pixel {
+	float r = 0;
+	float g = 0;
+	float b = 0;
+	float a = 1;
+
+	Pixel() = default;
+
+	Pixel(float r, float g, float b, float a = 1) : r(r), g(g), b(b), a(a) {}
+
+	explicit Pixel(const Color &c) :
+		r(static_cast<float>(c[0])), g(static_cast<float>(c[1])), b(static_cast<float>(c[2])) {}
+
+	Color color() const { return Color{r, g, b}; }
+};
+
+/**
+ * @brief window into a rectangle of a framebuffer, addressed with tile-local coordinates
+ */
+class TileView {
+public:
+	TileView(Pixel *origin, std::ptrdiff_t stride, const Tile &tile) : origin(origin), stride(stride), tile(tile) {}
+
+	Pixel &at(int x, int y) { return origin[y * stride + x]; }
+
+	Pixel *row(int y) { return origin + y * stride; }
+
+	int width() const { return tile.width; }
+
+	int height() const { return tile.height; }
+
+	int startX() const { return tile.startx; }
+
+	int startY() const { return tile.starty; }
+
+private:
+	Pixel *origin;
+	std::ptrdiff_t stride;
+	Tile tile;
+};
+
+class Framebuffer {
+public:
+	static constexpr std::size_t alignment = 64;
+
+	Framebuffer(int width, int height);
+
+	int width() const;
+
+	int height() const;
+
+	Pixel &at(int x, int y) { return pixels[static_cast<std::ptrdiff_t>(y) * fb_width + x]; }
+
+	const Pixel &at(int x, int y) const { return pixels[static_cast<std::ptrdiff_t>(y) * fb_width + x]; }
+
+	Pixel *row(int y);
+
+	const Pixel *row(int y) const;
+
+	/**
+	 * @brief all pixels as one block of interleaved RGBA floats
+	 */
+	const float *data() const;
+
+	TileView view(const Tile &tile);
+
+	void clear(const Pixel &value = Pixel(0, 0, 0, 1));
+
+private:
+	struct AlignedFree {
+		void operator()(Pixel *p) const { std::free(p); }
+	};
+
+	int fb_width;
+	int fb_height;
+	std::unique_ptr<Pixel[], AlignedFree> pixels;
+};
+
+#endif // RAYTRACING_FRAMEBUFFER_H
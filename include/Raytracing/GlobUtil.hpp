@@ -13,19 +13,31 @@
 #include <sstream>
 #include <string>
 
+// scalar type of the render core, RAYTRACING_SINGLE_PRECISION makes it float
+#ifdef RAYTRACING_SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
+
+using Vec3 = Eigen::Matrix<Real, 3, 1>;
+using Vec4 = Eigen::Matrix<Real, 4, 1>;
+using Mat3 = Eigen::Matrix<Real, 3, 3>;
+using Mat4 = Eigen::Matrix<Real, 4, 4>;
+
 const float PI = 3.141592;
 const float INF = std::numeric_limits<float>::infinity();
 const float EPS = 1e-3;
 
 inline float deg2Rad(float deg) { return deg * PI / 180.0; }
 
-inline std::string vecToStr(const Eigen::Vector3d &v) {
+inline std::string vecToStr(const Vec3 &v) {
     std::stringstream ss;
     ss << v.x() << " " << v.y() << " " << v.z();
     return ss.str();
 }
 
-inline std::string vecToStr(const Eigen::Vector4d &v) {
+inline std::string vecToStr(const Vec4 &v) {
     std::stringstream ss;
     ss << v.x() << " " << v.y() << " " << v.z() << " " << v.w();
     return ss.str();
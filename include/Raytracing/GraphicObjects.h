@@ -9,6 +9,7 @@
 #define ONEWEEKEND_GRAPHICOBJECTS_H
 
 #include "MathUtil.h"
+#include "RayPacket.h"
 
 #include <memory>
 #include <vector>
@@ -18,13 +19,19 @@ class IMaterial;
 struct HitRecord {
     bool hit;
     Point3 p;
-    float t;
+    Real t;
     float u;
     float v;
-    Eigen::Vector3d normal;
-    std::shared_ptr<IMaterial> material;
+    // texture space units per world unit around p, set by the primitive
+    float uv_density = 0;
+    // width of the ray at p in texture space, set by the camera. 0 asks
+    // textures for their finest detail
+    float footprint = 0;
+    Vec3 normal;
+    // owned by the scene, see MaterialTable
+    const IMaterial *material = nullptr;
     bool front_face;
-    void setFaceNormal(const Ray &r, const Eigen::Vector3d &normal_out);
+    void setFaceNormal(const Ray &r, const Vec3 &normal_out);
 };
 
 class IHittable {
@@ -34,9 +41,43 @@ class IHittable {
     virtual bool hit(const Ray &r, Interval interval,
                      HitRecord &record) const = 0;
 
+    /**
+     * @brief intersect every active lane of a packet, lanes whose closest hit
+     * so far lies on this object get their t lowered and their object set.
+     * the default traces the lanes one by one with hit()
+     */
+    virtual void hitPacket(const RayPacket &packet, float t_min,
+                           PacketHit &result) const;
+
     virtual AABB boundingBox() const = 0;
+
+    /**
+     * @brief solid angle density random() picks the direction of r with, 0
+     * when r does not reach this object inside interval
+     */
+    virtual Real pdfValue(const Ray &r, Interval interval) const { return 0; }
+
+    /**
+     * @brief direction from origin to a random point of this object
+     */
+    virtual Vec3 random(const Point3 &origin, Real time, PCG32 &rng) const {
+        return Vec3::UnitX();
+    }
+
+    /**
+     * @brief append the primitives with an emissive material below this
+     * object, objects under a Translate or Rotation are not collected
+     */
+    virtual void gatherLights(std::vector<const IHittable *> &lights) const {}
 };
 
+/**
+ * @brief trace up to packet_size rays through world together, every lane that
+ * hits gets a full precision record
+ */
+void tracePacket(const IHittable &world, const Ray *rays, int count,
+                 Interval interval, HitRecord *records, bool *hits);
+
 class HittableList : public IHittable {
   public:
     std::vector<std::shared_ptr<IHittable>> objects;
@@ -55,35 +96,50 @@ class HittableList : public IHittable {
 
     AABB boundingBox() const override;
 
+    void gatherLights(std::vector<const IHittable *> &lights) const override;
+
   private:
     bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
 
-    AABB bbox;
+    void hitPacket(const RayPacket &packet, float t_min,
+                   PacketHit &result) const override;
+
+    AABB bbox = AABB(empty, empty, empty);
 };
 
 class Sphere : public IHittable {
   public:
-    Sphere(float radius, Eigen::Vector3d position,
-           std::shared_ptr<IMaterial> mat);
+    Sphere(Real radius, Vec3 position, const IMaterial *mat);
 
-    Sphere(float radius, const Point3 &init_position,
-           const Point3 &final_position, std::shared_ptr<IMaterial> mat);
+    Sphere(Real radius, const Point3 &init_position,
+           const Point3 &final_position, const IMaterial *mat);
 
-    Eigen::Vector3d getPosition(float time) const;
+    Vec3 getPosition(Real time) const;
 
     bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
 
+    void hitPacket(const RayPacket &packet, float t_min,
+                   PacketHit &result) const override;
+
     AABB boundingBox() const override;
 
+    Real pdfValue(const Ray &r, Interval interval) const override;
+
+    Vec3 random(const Point3 &origin, Real time, PCG32 &rng) const override;
+
+    void gatherLights(std::vector<const IHittable *> &lights) const override;
+
   private:
+    friend class PrimitiveBatch;
+
     static void getSphereUV(const Point3 &p, float &u, float &v);
 
-    Eigen::Vector3d direction_vec;
+    Vec3 direction_vec;
     bool is_moving = false;
-    float radius;
+    Real radius;
     AABB bbox;
-    Eigen::Vector3d position;
-    std::shared_ptr<IMaterial> material;
+    Vec3 position;
+    const IMaterial *material;
 };
 
 class BVHNode : public IHittable {
@@ -92,13 +148,15 @@ class BVHNode : public IHittable {
 
     BVHNode(const HittableList &list);
 
-    BVHNode(const std::vector<std::shared_ptr<IHittable>> &objects,
-            size_t start, size_t end);
+    BVHNode(std::vector<std::shared_ptr<IHittable>> &objects, size_t start,
+            size_t end);
 
     bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
 
     AABB boundingBox() const override;
 
+    void gatherLights(std::vector<const IHittable *> &lights) const override;
+
   private:
     std::shared_ptr<IHittable> left;
     std::shared_ptr<IHittable> right;
@@ -120,8 +178,8 @@ class BVHNode : public IHittable {
 
 class Quad : public IHittable {
   public:
-    Quad(const Eigen::Vector3d &Q, const Eigen::Vector3d &u,
-         const Eigen::Vector3d &v, std::shared_ptr<IMaterial> mat);
+    Quad(const Vec3 &Q, const Vec3 &u, const Vec3 &v,
+         const IMaterial *mat);
 
     virtual ~Quad() = default;
 
@@ -131,21 +189,32 @@ class Quad : public IHittable {
 
     bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
 
-    bool inside(float a, float b, HitRecord &rec) const;
+    void hitPacket(const RayPacket &packet, float t_min,
+                   PacketHit &result) const override;
+
+    bool inside(Real a, Real b, HitRecord &rec) const;
+
+    Real pdfValue(const Ray &r, Interval interval) const override;
+
+    Vec3 random(const Point3 &origin, Real time, PCG32 &rng) const override;
+
+    void gatherLights(std::vector<const IHittable *> &lights) const override;
 
   private:
-    Eigen::Vector3d Q, u, v;
-    Eigen::Vector3d normal;
-    float D;
-    Eigen::Vector3d w;
-    std::shared_ptr<IMaterial> mat;
+    friend class PrimitiveBatch;
+
+    Vec3 Q, u, v;
+    Vec3 normal;
+    Real D;
+    Vec3 w;
+    const IMaterial *mat;
     AABB bbox;
 };
 
 class Triangle : public IHittable {
   public:
-    Triangle(const Eigen::Vector3d &Q, const Eigen::Vector3d &u,
-             const Eigen::Vector3d &v, std::shared_ptr<IMaterial> mat);
+    Triangle(const Vec3 &Q, const Vec3 &u, const Vec3 &v,
+             const IMaterial *mat);
 
     virtual ~Triangle() = default;
 
@@ -155,20 +224,31 @@ class Triangle : public IHittable {
 
     bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
 
-    bool inside(const Eigen::Vector3d &intersection) const;
+    void hitPacket(const RayPacket &packet, float t_min,
+                   PacketHit &result) const override;
+
+    bool inside(const Vec3 &intersection) const;
+
+    Real pdfValue(const Ray &r, Interval interval) const override;
+
+    Vec3 random(const Point3 &origin, Real time, PCG32 &rng) const override;
+
+    void gatherLights(std::vector<const IHittable *> &lights) const override;
 
   private:
-    Eigen::Vector3d Q, u, v;
-    Eigen::Vector3d normal;
-    Eigen::Vector3d w;
-    float D;
+    friend class PrimitiveBatch;
+
+    Vec3 Q, u, v;
+    Vec3 normal;
+    Vec3 w;
+    Real D;
 
-    std::shared_ptr<IMaterial> mat;
+    const IMaterial *mat;
     AABB box;
 };
 
 inline std::shared_ptr<HittableList> box(const Point3 &a, const Point3 &b,
-                                         std::shared_ptr<IMaterial> mat) {
+                                         const IMaterial *mat) {
     auto sides = std::make_shared<HittableList>();
 
     auto min = Point3{std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()),
@@ -176,30 +256,29 @@ inline std::shared_ptr<HittableList> box(const Point3 &a, const Point3 &b,
     auto max = Point3{std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()),
                       std::fmax(a.z(), b.z())};
 
-    auto dx = Eigen::Vector3d{max.x() - min.x(), 0, 0};
-    auto dy = Eigen::Vector3d{0, max.y() - min.y(), 0};
-    auto dz = Eigen::Vector3d{0, 0, max.z() - min.z()};
-
-    sides->add(make_shared<Quad>(Point3{min.x(), min.y(), max.z()}, dx, dy,
-                                 mat)); // front
-    sides->add(make_shared<Quad>(Point3{max.x(), min.y(), max.z()}, -dz, dy,
-                                 mat)); // right
-    sides->add(make_shared<Quad>(Point3{max.x(), min.y(), min.z()}, -dx, dy,
-                                 mat)); // back
-    sides->add(make_shared<Quad>(Point3{min.x(), min.y(), min.z()}, dz, dy,
-                                 mat)); // left
-    sides->add(make_shared<Quad>(Point3{min.x(), max.y(), max.z()}, dx, -dz,
-                                 mat)); // top
-    sides->add(make_shared<Quad>(Point3{min.x(), min.y(), min.z()}, dx, dz,
-                                 mat)); // bottom
+    auto dx = Vec3{max.x() - min.x(), 0, 0};
+    auto dy = Vec3{0, max.y() - min.y(), 0};
+    auto dz = Vec3{0, 0, max.z() - min.z()};
+
+    sides->add(std::make_shared<Quad>(Point3{min.x(), min.y(), max.z()}, dx,
+                                      dy, mat)); // front
+    sides->add(std::make_shared<Quad>(Point3{max.x(), min.y(), max.z()}, -dz,
+                                      dy, mat)); // right
+    sides->add(std::make_shared<Quad>(Point3{max.x(), min.y(), min.z()}, -dx,
+                                      dy, mat)); // back
+    sides->add(std::make_shared<Quad>(Point3{min.x(), min.y(), min.z()}, dz,
+                                      dy, mat)); // left
+    sides->add(std::make_shared<Quad>(Point3{min.x(), max.y(), max.z()}, dx,
+                                      -dz, mat)); // top
+    sides->add(std::make_shared<Quad>(Point3{min.x(), min.y(), min.z()}, dx,
+                                      dz, mat)); // bottom
 
     return sides;
 }
 
 class Translate : public IHittable {
   public:
-    Translate(std::shared_ptr<IHittable> obj,
-              const Eigen::Vector3d &displacement);
+    Translate(std::shared_ptr<IHittable> obj, const Vec3 &displacement);
 
     AABB boundingBox() const override;
 
@@ -207,7 +286,7 @@ class Translate : public IHittable {
 
   private:
     std::shared_ptr<IHittable> object;
-    Eigen::Vector3d offset;
+    Vec3 offset;
     AABB bbox;
 };
 
@@ -222,7 +301,9 @@ class Rotation : public IHittable {
 
   private:
     std::shared_ptr<IHittable> object;
-    Eigen::Matrix4d rotation_matrix, inverse_rotation_matrix;
+    Mat4 rotation_matrix, inverse_rotation_matrix;
+    // inverse transpose of inverse_rotation_matrix, carries normals back
+    Mat4 normal_matrix;
     AABB bbox;
 };
 
@@ -8,7 +8,7 @@
 #ifndef ONEWEEKEND_IMAGEUTIL_H
 #define ONEWEEKEND_IMAGEUTIL_H
 
-#include "KawaiiMQ/kawaiiMQ.h"
+#include "Framebuffer.h"
 #include "MathUtil.h"
 #include "spdlog/spdlog.h"
 #include "stb_image.h"
@@ -18,7 +18,6 @@
 #include <sys/stat.h>
 #include <tuple>
 #include <vector>
-using Color = Eigen::Vector3d;
 
 class Image {
   public:
@@ -48,18 +47,44 @@ const std::string grayscale = " .:-=+*#%@";
 
 std::string getGreyScaleCharacter(float r, float g, float b);
 
-std::string makePPM(int width, int height,
-                    const std::vector<std::vector<Color>> &img,
-                    const std::string &name,
+enum class ImageFormat {
+    // binary 8-bit P6
+    PPM,
+    // 32-bit float RGB in host byte order, linear radiance without gamma
+    PFM,
+    PNG
+};
+
+std::string imageExtension(ImageFormat format);
+
+/**
+ * @brief write a framebuffer in the given format, the extension of name is
+ * replaced by the one of the format
+ * @return path of the written file, empty when it could not be written
+ */
+std::string writeImage(const Framebuffer &img, const std::string &name,
+                       ImageFormat format,
+                       const std::string &path = IMG_OUTPUT_DIR);
+
+std::string makePPM(const Framebuffer &img, const std::string &name,
+                    const std::string &path = IMG_OUTPUT_DIR);
+
+std::string makePFM(const Framebuffer &img, const std::string &name,
                     const std::string &path = IMG_OUTPUT_DIR);
 
-std::string makeGrayscaleTxt(int width, int height,
-                             const std::vector<std::vector<Color>> &img,
-                             const std::string &name,
+std::string makePNG(const Framebuffer &img, const std::string &name,
+                    const std::string &path = IMG_OUTPUT_DIR);
+
+/**
+ * @brief gamma correct, clamp and quantize the framebuffer into tightly packed
+ * 8-bit RGB rows
+ */
+std::vector<unsigned char> quantizeRGB8(const Framebuffer &img);
+
+std::string makeGrayscaleTxt(const Framebuffer &img, const std::string &name,
                              const std::string &path = IMG_OUTPUT_DIR);
 
-std::string makeGrayscaleString(int width, int height,
-                                std::vector<std::vector<Color>> img);
+std::string makeGrayscaleString(const Framebuffer &img);
 
 std::string mkdir(const std::string &path, const std::string &name);
 
@@ -70,13 +95,9 @@ int clamp(int x, int low, int high);
 
 float gammaCorrect(float c);
 
-struct ImageChunk : public KawaiiMQ::MessageData {
-    int startx;
-    int starty;
-    int chunk_idx;
-    int width;
-    int height;
-    std::vector<std::vector<Color>> partial;
-};
+/**
+ * @brief gamma correct and clamp a linear pixel to [0, 1]
+ */
+Color displayColor(const Pixel &p);
 
 #endif // ONEWEEKEND_IMAGEUTIL_H
@@ -0,0 +1,53 @@
+/**
+ * @file Instance.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief A placed copy of a shared object, for two-level acceleration structures
+ */
+
+#ifndef RAYTRACING_INSTANCE_H
+#define RAYTRACING_INSTANCE_H
+
+#include <memory>
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "GraphicObjects.h"
+#include "MathUtil.h"
+
+/**
+ * @brief one placement of a bottom level object, usually a LinearBVH or a TriangleMesh shared by every copy. a
+ * LinearBVH over instances is the top level. the ray is moved into object space once per instance, the object itself
+ * is never copied. lights inside an instance are only reached by scattering, gatherLights does not collect them
+ */
+class Instance : public IHittable {
+public:
+	using Transform = Eigen::Transform<Real, 3, Eigen::Affine>;
+
+	/**
+	 * @param material replaces the materials of object when not null
+	 */
+	Instance(std::shared_ptr<IHittable> object, const Transform &object_to_world, const IMaterial *material = nullptr);
+
+	/**
+	 * @brief scale, then rotate by the euler angles in the order of makeEulerRotationMatrixAboutPt, then translate
+	 */
+	static Transform makeTransform(const Vec3 &translation, Real psi = 0, Real theta = 0, Real phi = 0,
+								   Real scale = 1);
+
+	bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
+
+	AABB boundingBox() const override;
+
+private:
+	std::shared_ptr<IHittable> object;
+	// affine 3x4 matrices, the last column is the translation
+	Eigen::Matrix<Real, 3, 4> to_world, to_object;
+	// inverse transpose of the linear part of to_world, carries normals out
+	Eigen::Matrix<Real, 3, 3> normal_matrix;
+	// texture density of object per unit of world space, one over the average scale
+	float density_scale;
+	const IMaterial *material;
+	AABB bbox;
+};
+
+#endif // RAYTRACING_INSTANCE_H
@@ -0,0 +1,44 @@
+/**
+ * @file Light.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Emissive primitives of a scene, sampled directly for next event estimation
+ */
+
+#ifndef RAYTRACING_LIGHT_H
+#define RAYTRACING_LIGHT_H
+
+#include <vector>
+#include "GraphicObjects.h"
+#include "MathUtil.h"
+
+/**
+ * @brief every sphere, quad and triangle with an emissive material, picked uniformly.
+ * the primitives stay owned by the scene, which has to outlive the list
+ */
+class LightList {
+public:
+	LightList() = default;
+
+	explicit LightList(const IHittable &world);
+
+	bool empty() const;
+
+	size_t size() const;
+
+	/**
+	 * @brief direction from origin to a random point on a uniformly chosen light
+	 */
+	Vec3 random(const Point3 &origin, Real time, PCG32 &rng) const;
+
+	/**
+	 * @brief solid angle density random() picks the direction of r with. lights behind the first hit along r still
+	 * count, random() can pick them through an occluder
+	 */
+	Real pdfValue(const Ray &r) const;
+
+private:
+	std::vector<const IHittable *> lights;
+};
+
+#endif // RAYTRACING_LIGHT_H
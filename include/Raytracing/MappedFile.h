@@ -0,0 +1,53 @@
+/**
+ * @file MappedFile.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Read-only memory mapping of a whole file
+ */
+
+#ifndef RAYTRACING_MAPPEDFILE_H
+#define RAYTRACING_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+class MappedFile {
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::string &file);
+
+	MappedFile(const MappedFile &) = delete;
+
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile &&other) noexcept;
+
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	~MappedFile();
+
+	/**
+	 * @brief map file, any previous mapping is released first
+	 * @return false when the file cannot be opened or mapped, an empty file maps to an empty view
+	 */
+	bool open(const std::string &file);
+
+	bool isOpen() const;
+
+	const char *data() const;
+
+	size_t size() const;
+
+	std::string_view view() const;
+
+private:
+	void close();
+
+	const char *bytes = nullptr;
+	size_t length = 0;
+	bool opened = false;
+};
+
+#endif // RAYTRACING_MAPPEDFILE_H
@@ -7,20 +7,37 @@
 
 #ifndef ONEWEEKEND_MATERIAL_H
 #define ONEWEEKEND_MATERIAL_H
+#include <cstdint>
 #include <memory>
+#include <vector>
 #include "MathUtil.h"
 #include "GraphicObjects.h"
-#include "KawaiiMQ/kawaiiMQ.h"
 #include "Texture.h"
 
+struct CompiledMaterials;
+
 class IMaterial {
 public:
 	virtual ~IMaterial() = default;
 
-	virtual bool scatter(const Ray &r_in, const HitRecord &record, Eigen::Vector3d &attenuation,
-						 Ray &scattered) const = 0;
+	virtual bool scatter(const Ray &r_in, const HitRecord &record, Vec3 &attenuation, Ray &scattered,
+						 PCG32 &rng) const = 0;
 	
 	virtual Color emitted(float u, float v, const Point3& p) const;
+
+	/**
+	 * @brief density scatter picks the direction of scattered with, attenuation times this is the BSDF times the
+	 * cosine. 0 for specular materials, which light sampling skips
+	 */
+	virtual Real scatteringPdf(const Ray &r_in, const HitRecord &record, const Ray &scattered) const;
+
+	virtual bool isEmissive() const;
+
+private:
+	friend class MaterialTable;
+	// flat copy of this material, set by the MaterialTable that owns it
+	const CompiledMaterials *compiled = nullptr;
+	uint32_t compiled_index = 0;
 };
 
 class Lambertian : public IMaterial {
@@ -29,12 +46,14 @@ public:
 
 	Lambertian(std::shared_ptr<ITexture> tex);
 
-	bool scatter(const Ray &r_in, const HitRecord &record, Eigen::Vector3d &attenuation,
-				 Ray &scattered) const override;
+	bool scatter(const Ray &r_in, const HitRecord &record, Vec3 &attenuation, Ray &scattered,
+				 PCG32 &rng) const override;
+
+	Real scatteringPdf(const Ray &r_in, const HitRecord &record, const Ray &scattered) const override;
 
 private:
+	friend class MaterialTable;
 	std::shared_ptr<ITexture> albedo;
-
 };
 
 class Metal : public IMaterial {
@@ -43,10 +62,11 @@ public:
 
 	Metal(const Color& abledo, float fuzz);
 
-	bool scatter(const Ray &r_in, const HitRecord &record, Eigen::Vector3d &attenuation,
-				 Ray &scattered) const override;
+	bool scatter(const Ray &r_in, const HitRecord &record, Vec3 &attenuation, Ray &scattered,
+				 PCG32 &rng) const override;
 
 private:
+	friend class MaterialTable;
 	std::shared_ptr<ITexture> albedo;
 	float fuzz;
 };
@@ -57,12 +77,12 @@ public:
 
 	Dielectric(float idx, const Color& albedo);
 
-	bool scatter(const Ray &r_in, const HitRecord &record, Eigen::Vector3d &attenuation,
-				 Ray &scattered) const override;
+	bool scatter(const Ray &r_in, const HitRecord &record, Vec3 &attenuation, Ray &scattered,
+				 PCG32 &rng) const override;
 private:
+	friend class MaterialTable;
 	float ir;
 	std::shared_ptr<ITexture> albedo;
-	static float reflectance(float cosine, float refr_idx);
 };
 
 class DiffuseLight : public IMaterial {
@@ -71,13 +91,70 @@ public:
 
 	DiffuseLight(Color c);
 
-	bool scatter(const Ray &r_in, const HitRecord &record, Eigen::Vector3d &attenuation,
-				 Ray &scattered) const override;
+	bool scatter(const Ray &r_in, const HitRecord &record, Vec3 &attenuation, Ray &scattered,
+				 PCG32 &rng) const override;
 	
 	Color emitted(float u, float v, const Point3& p) const override;
 
+	bool isEmissive() const override;
+
 private:
+	friend class MaterialTable;
 	std::shared_ptr<ITexture> emit;
 };
 
+/**
+ * @brief material flattened into a MaterialTable, see TextureTable for the texture
+ */
+struct FlatMaterial {
+	enum class Kind : uint8_t { Lambertian, Metal, Dielectric, DiffuseLight, Other };
+
+	Kind kind = Kind::Other;
+	// albedo, or the emission of DiffuseLight
+	uint32_t texture = 0;
+	float fuzz = 0;
+	// index of refraction of Dielectric
+	float ir = 1;
+};
+
+struct CompiledMaterials {
+	std::vector<FlatMaterial> materials;
+	TextureTable textures;
+};
+
+/**
+ * @brief owns the materials of a scene. primitives and hit records only keep the pointers handed out here, so the
+ * table has to outlive every hittable built with them. every material added is also flattened, and the static shading
+ * functions switch over the flat copy instead of calling through the class hierarchy
+ */
+class MaterialTable {
+public:
+	template<typename T, typename... Args>
+	const T *add(Args &&...args) {
+		materials.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+		compileLast();
+		return static_cast<const T *>(materials.back().get());
+	}
+
+	size_t size() const { return materials.size(); }
+
+	/**
+	 * @brief shading entry points of the integrators, materials without a table fall back to their virtual functions
+	 */
+	static bool scatter(const IMaterial &material, const Ray &r_in, const HitRecord &record, Vec3 &attenuation,
+						Ray &scattered, PCG32 &rng);
+
+	static Color emitted(const IMaterial &material, float u, float v, const Point3 &p);
+
+	static Real scatteringPdf(const IMaterial &material, const Ray &r_in, const HitRecord &record,
+							  const Ray &scattered);
+
+private:
+	void compileLast();
+
+	std::vector<std::unique_ptr<IMaterial>> materials;
+	// on the heap so the pointers the materials keep survive moving the table
+	std::unique_ptr<CompiledMaterials> compiled = std::make_unique<CompiledMaterials>();
+};
+
 #endif // ONEWEEKEND_MATERIAL_H
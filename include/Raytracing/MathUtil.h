@@ -14,45 +14,46 @@
 #include "GlobUtil.hpp"
 #include "spdlog/fmt/bundled/core.h"
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
-#include <random>
 
-using Point3 = Eigen::Vector3d;
+using Point3 = Vec3;
+using Color = Vec3;
 
 class Ray {
   private:
     Point3 position;
-    Eigen::Vector3d direction;
-    double tm;
+    Vec3 direction;
+    Real tm;
 
   public:
-    Ray(Eigen::Vector3d pos, Eigen::Vector3d dir, double time);
-    Ray(Eigen::Vector3d pos, Eigen::Vector3d dir);
+    Ray(Vec3 pos, Vec3 dir, Real time);
+    Ray(Vec3 pos, Vec3 dir);
     Ray() = default;
 
-    Eigen::Vector3d pos() const;
-    Eigen::Vector3d dir() const;
-    double time() const;
+    Vec3 pos() const;
+    Vec3 dir() const;
+    Real time() const;
 
-    Point3 at(double t) const;
+    Point3 at(Real t) const;
 };
 
 class Interval {
   public:
-    double min, max;
+    Real min, max;
     Interval();
 
-    Interval(float min, float max);
+    Interval(Real min, Real max);
 
     Interval(const Interval &first, const Interval &second);
 
-    bool within(float x) const;
+    bool within(Real x) const;
 
-    bool surround(float x) const;
+    bool surround(Real x) const;
 
-    float clamp(float x) const;
+    Real clamp(Real x) const;
 
-    Interval expand(float delta);
+    Interval expand(Real delta);
 
     static const Interval empty, universe;
 };
@@ -86,10 +87,25 @@ class Perlin {
 
     float rawNoise(const Point3 &p) const;
 
+    /**
+     * @brief sum of octave_count octaves of rawNoise, evaluated
+     * octave_lanes octaves at a time in SIMD lanes
+     */
     float octaveNoise(const Point3 &p, float frequency, int octave_count,
                       float presistence) const;
 
+    static constexpr int octave_lanes = 8;
+
   private:
+    using NoiseLanes = Eigen::Array<float, octave_lanes, 1>;
+
+    /**
+     * @brief rawNoise of one point per lane. only the lattice hashing is
+     * scalar, gradients come from a table instead of a switch
+     */
+    NoiseLanes rawNoise(const NoiseLanes &x, const NoiseLanes &y,
+                        const NoiseLanes &z) const;
+
     static constexpr int perm[] = {
         151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233,
         7,   225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,
@@ -133,109 +149,175 @@ class Perlin {
 
     float lerp(float begin, float end, float weight) const;
 
-    float gradientDotProd(int hash, const Eigen::Vector3d &pt) const;
+    float gradientDotProd(int hash, const Vec3 &pt) const;
+};
+
+/**
+ * @brief PCG32 generator, small enough to live on the stack of a render thread.
+ * every pixel seeds its own stream, so the samples a pixel receives do not depend
+ * on which thread renders it or in which order tiles are processed
+ */
+class PCG32 {
+  public:
+    PCG32() : PCG32(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+
+    PCG32(uint64_t seed, uint64_t sequence) { setSeed(seed, sequence); }
+
+    void setSeed(uint64_t seed, uint64_t sequence) {
+        state = 0;
+        inc = (sequence << 1u) | 1u;
+        nextUInt();
+        state += seed;
+        nextUInt();
+    }
+
+    uint32_t nextUInt() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        auto xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto rot = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // uniform in [0, 1)
+    float nextFloat() { return static_cast<float>(nextUInt() >> 8) * 0x1p-24f; }
+
+  private:
+    uint64_t state;
+    uint64_t inc;
 };
 
-inline float randomFloat() {
-    static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+inline PCG32 &threadRng() {
+    thread_local PCG32 rng;
+    return rng;
 }
 
-inline double randomFloat(double min, double max) {
-    return min + (max - min) * randomFloat();
+inline float randomFloat(PCG32 &rng) { return rng.nextFloat(); }
+
+inline Real randomFloat(PCG32 &rng, Real min, Real max) {
+    return min + (max - min) * randomFloat(rng);
+}
+
+inline float randomFloat() { return randomFloat(threadRng()); }
+
+inline Real randomFloat(Real min, Real max) {
+    return randomFloat(threadRng(), min, max);
 }
 
 inline int randomInt(int min, int max) {
     return static_cast<int>(randomFloat(min, max + 1));
 }
 
-inline Eigen::Vector3d randomVec3() {
-    return Eigen::Vector3d(randomFloat(), randomFloat(), randomFloat());
+inline Vec3 randomVec3(PCG32 &rng) {
+    auto x = randomFloat(rng);
+    auto y = randomFloat(rng);
+    auto z = randomFloat(rng);
+    return Vec3(x, y, z);
 }
 
-inline Eigen::Vector3d randomVec3(float min, float max) {
-    return Eigen::Vector3d(randomFloat(min, max), randomFloat(min, max),
-                           randomFloat(min, max));
+inline Vec3 randomVec3(PCG32 &rng, float min, float max) {
+    auto x = randomFloat(rng, min, max);
+    auto y = randomFloat(rng, min, max);
+    auto z = randomFloat(rng, min, max);
+    return Vec3(x, y, z);
 }
 
-inline Eigen::Vector3d randomVec3InUnitSphere() {
+inline Vec3 randomVec3() { return randomVec3(threadRng()); }
+
+inline Vec3 randomVec3(float min, float max) {
+    return randomVec3(threadRng(), min, max);
+}
+
+inline Vec3 randomVec3InUnitSphere(PCG32 &rng) {
     while (true) {
-        auto p = randomVec3(-1, 1);
+        auto p = randomVec3(rng, -1, 1);
         if (p.norm() >= 1)
             continue;
         return p;
     }
 }
 
-inline Eigen::Vector3d randomUnitVec3() {
-    return randomVec3InUnitSphere().normalized();
+inline Vec3 randomUnitVec3(PCG32 &rng) {
+    return randomVec3InUnitSphere(rng).normalized();
 }
 
-inline Eigen::Vector3d randomVec3InUnitDisk() {
+inline Vec3 randomVec3InUnitDisk(PCG32 &rng) {
     while (true) {
-        auto p = Eigen::Vector3d{randomFloat(-1, 1), randomFloat(-1, 1), 0};
+        auto x = randomFloat(rng, -1, 1);
+        auto y = randomFloat(rng, -1, 1);
+        auto p = Vec3{x, y, 0};
         if (p.norm() >= 1)
             continue;
         return p;
     }
 }
 
-inline Eigen::Vector3d
-randomUnitVec3InHemiSphere(const Eigen::Vector3d &normal) {
-    auto in_unit_sphere = randomVec3InUnitSphere();
+inline Vec3
+randomUnitVec3InHemiSphere(PCG32 &rng, const Vec3 &normal) {
+    auto in_unit_sphere = randomVec3InUnitSphere(rng);
     if (in_unit_sphere.dot(normal) > 0.0)
         return in_unit_sphere;
     else
         return -in_unit_sphere;
 }
 
-inline Eigen::Vector3d reflect(const Eigen::Vector3d &v,
-                               const Eigen::Vector3d &n) {
+inline Vec3 randomVec3InUnitSphere() {
+    return randomVec3InUnitSphere(threadRng());
+}
+
+inline Vec3 randomUnitVec3() { return randomUnitVec3(threadRng()); }
+
+inline Vec3 randomVec3InUnitDisk() {
+    return randomVec3InUnitDisk(threadRng());
+}
+
+inline Vec3 randomUnitVec3InHemiSphere(const Vec3 &normal) {
+    return randomUnitVec3InHemiSphere(threadRng(), normal);
+}
+
+inline Vec3 reflect(const Vec3 &v, const Vec3 &n) {
     return v - 2 * v.dot(n) * n;
 }
 
-inline Eigen::Vector3d refract(const Eigen::Vector3d &uv,
-                               const Eigen::Vector3d &n, float etai_over_etat) {
-    auto cos_theta = std::fmin(-uv.dot(n), 1.0);
-    Eigen::Vector3d r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    Eigen::Vector3d r_out_parallel =
-        -std::sqrt(std::fabs(1.0 - r_out_perp.norm())) * n;
+inline Vec3 refract(const Vec3 &uv, const Vec3 &n, float etai_over_etat) {
+    auto cos_theta = std::fmin(-uv.dot(n), Real(1));
+    Vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
+    Vec3 r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.norm())) * n;
     return r_out_perp + r_out_parallel;
 }
 
-inline bool verySmall(const Eigen::Vector3d &v) {
+inline bool verySmall(const Vec3 &v) {
     return (std::abs(v[0]) < EPS) && (std::abs(v[1]) < EPS) &&
            (std::abs(v[2]) < EPS);
 }
 
-inline std::string makeColor(const Eigen::Vector3d &v) {
+inline std::string makeColor(const Vec3 &v) {
     auto r = static_cast<int>(255.999 * v[0]);
     auto g = static_cast<int>(255.999 * v[1]);
     auto b = static_cast<int>(255.999 * v[2]);
     return fmt::format("{} {} {}\n", r, g, b);
 }
 
-inline Eigen::Matrix4d makeEulerRotationMatrixAboutPt(const Point3 &pt,
-                                                      double psi, double theta,
-                                                      double phi) {
-    Eigen::AngleAxisd yaw(psi, Eigen::Vector3d::UnitZ());
-    Eigen::AngleAxisd pitch(theta, Eigen::Vector3d::UnitY());
-    Eigen::AngleAxisd roll(phi, Eigen::Vector3d::UnitX());
-
-    Eigen::Quaterniond q = yaw * pitch * roll;
-    auto translation = Eigen::Translation<double, 3>(pt.x(), pt.y(), pt.z());
-    Eigen::Affine3d affine = Eigen::Affine3d::Identity() * translation *
-                             q.toRotationMatrix() * translation.inverse();
+inline Mat4 makeEulerRotationMatrixAboutPt(const Point3 &pt, Real psi,
+                                            Real theta, Real phi) {
+    Eigen::AngleAxis<Real> yaw(psi, Vec3::UnitZ());
+    Eigen::AngleAxis<Real> pitch(theta, Vec3::UnitY());
+    Eigen::AngleAxis<Real> roll(phi, Vec3::UnitX());
+
+    Eigen::Quaternion<Real> q = yaw * pitch * roll;
+    auto translation = Eigen::Translation<Real, 3>(pt.x(), pt.y(), pt.z());
+    using Affine = Eigen::Transform<Real, 3, Eigen::Affine>;
+    Affine affine = Affine::Identity() * translation * q.toRotationMatrix() *
+                    translation.inverse();
     return affine.matrix();
 }
 
-inline Eigen::Vector3d deHomo(const Eigen::Vector4d &p) {
-    return Eigen::Vector3d(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
+inline Vec3 deHomo(const Vec4 &p) {
+    return Vec3(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
 }
 
-inline Eigen::Vector4d makeHomo(const Eigen::Vector3d &p) {
-    return Eigen::Vector4d(p[0], p[1], p[2], 1);
+inline Vec4 makeHomo(const Vec3 &p) {
+    return Vec4(p[0], p[1], p[2], 1);
 }
 
 #endif // ONEWEEKEND_MATHUTIL_H
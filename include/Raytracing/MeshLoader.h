@@ -0,0 +1,34 @@
+/**
+ * @file MeshLoader.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief OBJ and binary PLY loading into MeshData. files are memory mapped and parsed by all cores
+ */
+
+#ifndef RAYTRACING_MESHLOADER_H
+#define RAYTRACING_MESHLOADER_H
+
+#include <memory>
+#include <string>
+#include "TriangleMesh.h"
+
+/**
+ * @brief load a Wavefront OBJ file. polygons are fanned into triangles, usemtl names become material ids in the order
+ * they first appear, faces before the first usemtl get id 0. mtllib and groups are ignored
+ * @return null when the file cannot be read or is malformed
+ */
+std::shared_ptr<MeshData> loadObj(const std::string &file);
+
+/**
+ * @brief load a binary PLY file of either endianness. reads x, y, z, the optional nx, ny, nz and u, v (or s, t) of
+ * the vertex element and the vertex_indices list of the face element. ASCII PLY is rejected
+ * @return null when the file cannot be read or is malformed
+ */
+std::shared_ptr<MeshData> loadPly(const std::string &file);
+
+/**
+ * @brief loadObj or loadPly by the file extension
+ */
+std::shared_ptr<MeshData> loadMesh(const std::string &file);
+
+#endif // RAYTRACING_MESHLOADER_H
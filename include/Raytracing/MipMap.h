@@ -0,0 +1,79 @@
+/**
+ * @file MipMap.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Linear float mip pyramid in tiled storage, and the cache image textures share them through
+ */
+
+#ifndef RAYTRACING_MIPMAP_H
+#define RAYTRACING_MIPMAP_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen/Core"
+#include "MathUtil.h"
+
+class MipMap {
+public:
+	/**
+	 * @param texels linear rgb, width * height of them in rows from the top
+	 */
+	MipMap(int width, int height, const std::vector<Eigen::Vector3f> &texels);
+
+	/**
+	 * @brief bilinear lookup at level, v = 0 is the bottom row. coordinates outside [0, 1] are clamped
+	 */
+	Color bilinear(int level, float u, float v) const;
+
+	/**
+	 * @brief blend the two levels whose texels are closest to footprint, the width of the sampled area in texture
+	 * space. 0 gives a bilinear lookup of the full resolution level
+	 */
+	Color trilinear(float u, float v, float footprint) const;
+
+	int levelCount() const;
+
+	int width() const;
+
+	int height() const;
+
+	size_t memoryUsage() const;
+
+private:
+	// texels are stored in square tiles so the four texels of a lookup usually share a cache line or two
+	static constexpr int tile_shift = 3;
+	static constexpr int tile_size = 1 << tile_shift;
+
+	struct Level {
+		int width, height;
+		int tiles_x;
+		std::vector<Eigen::Vector3f> texels;
+
+		const Eigen::Vector3f &texel(int x, int y) const {
+			auto tile = (y >> tile_shift) * tiles_x + (x >> tile_shift);
+			return texels[(tile << 2 * tile_shift) + ((y & (tile_size - 1)) << tile_shift) + (x & (tile_size - 1))];
+		}
+
+		Eigen::Vector3f &texel(int x, int y) {
+			return const_cast<Eigen::Vector3f &>(static_cast<const Level &>(*this).texel(x, y));
+		}
+	};
+
+	static Level makeLevel(int width, int height);
+
+	std::vector<Level> levels;
+};
+
+/**
+ * @brief decodes every image file once, textures of the same path share one pyramid for as long as any of them lives
+ */
+class TextureCache {
+public:
+	/**
+	 * @return null when the file cannot be decoded
+	 */
+	static std::shared_ptr<const MipMap> load(const std::string &name, const std::string &parent);
+};
+
+#endif // RAYTRACING_MIPMAP_H
@@ -0,0 +1,75 @@
+/**
+ * @file PrimitiveBatch.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Structure of arrays copy of sphere, quad and triangle geometry for SIMD leaf tests
+ */
+
+#ifndef RAYTRACING_PRIMITIVEBATCH_H
+#define RAYTRACING_PRIMITIVEBATCH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Eigen/Core"
+#include "GraphicObjects.h"
+#include "MathUtil.h"
+
+// primitives tested per SIMD step, one AVX register of Real
+constexpr int batch_width = 32 / sizeof(Real);
+
+using BatchReal = Eigen::Array<Real, batch_width, 1>;
+
+enum class PrimitiveKind : uint8_t {
+	Sphere,
+	Quad,
+	Triangle,
+	// anything else is tested through its own hit
+	Other
+};
+
+/**
+ * @brief geometry of a primitive array in columns, indexed like the array it was built from.
+ * the kernels only pick the closest primitive of a run, the caller fills the record through its hit so the result
+ * stays exactly the one the scalar path produces.
+ */
+class PrimitiveBatch {
+public:
+	PrimitiveBatch() = default;
+
+	explicit PrimitiveBatch(const std::vector<std::shared_ptr<IHittable>> &primitives);
+
+	static PrimitiveKind kindOf(const IHittable &object);
+
+	PrimitiveKind kind(uint32_t i) const { return kinds[i]; }
+
+	/**
+	 * @brief test r against primitives [begin, end), which all have the given kind
+	 * @param closest_t lowered to the t of the closest hit
+	 * @return index of the closest primitive, or -1 when none is hit in (t_min, closest_t)
+	 */
+	int64_t hit(PrimitiveKind kind, const Ray &r, uint32_t begin, uint32_t end, Real t_min, Real &closest_t) const;
+
+	/**
+	 * @brief add count tests of kind to the statistics. hit counts nothing itself, the caller re-runs some of its
+	 * tests through the scalar hit, which counts them already
+	 */
+	static void countTests(PrimitiveKind kind, uint32_t count);
+
+private:
+	// spheres keep their center in p, their motion in u and the squared radius in s.
+	// quads and triangles keep the corner in p, the edges in u and v, the plane in n and s, and w.
+	enum Field { px, py, pz, ux, uy, uz, vx, vy, vz, nx, ny, nz, wx, wy, wz, s, field_count };
+
+	BatchReal load(Field field, uint32_t i) const { return Eigen::Map<const BatchReal>(fields[field].data() + i); }
+
+	int64_t hitSpheres(const Ray &r, uint32_t begin, uint32_t end, Real t_min, Real &closest_t) const;
+
+	int64_t hitPlanar(PrimitiveKind kind, const Ray &r, uint32_t begin, uint32_t end, Real t_min,
+					  Real &closest_t) const;
+
+	std::vector<PrimitiveKind> kinds;
+	std::vector<Real> fields[field_count];
+};
+
+#endif // RAYTRACING_PRIMITIVEBATCH_H
@@ -0,0 +1,78 @@
+/**
+ * @file RayPacket.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Coherent ray packets traced together with SIMD kernels
+ */
+
+#ifndef RAYTRACING_RAYPACKET_H
+#define RAYTRACING_RAYPACKET_H
+
+#include <array>
+#include "Eigen/Core"
+#include "MathUtil.h"
+
+#ifndef RAYTRACING_PACKET_SIZE
+#define RAYTRACING_PACKET_SIZE 8
+#endif
+
+constexpr int packet_size = RAYTRACING_PACKET_SIZE;
+
+static_assert(packet_size == 4 || packet_size == 8 || packet_size == 16, "packet size should be 4, 8 or 16");
+
+// one lane per ray, Eigen maps these onto SSE / AVX registers
+using PacketFloat = Eigen::Array<float, packet_size, 1>;
+using PacketMask = Eigen::Array<bool, packet_size, 1>;
+
+class IHittable;
+
+/**
+ * @brief structure of arrays view of up to packet_size rays
+ */
+struct RayPacket {
+	PacketFloat ox, oy, oz;
+	PacketFloat dx, dy, dz;
+	PacketFloat inv_dx, inv_dy, inv_dz;
+	PacketFloat time;
+	PacketMask active;
+	const Ray *rays;
+	int count;
+
+	/**
+	 * @brief pack rays, lanes past count are inactive
+	 */
+	RayPacket(const Ray *rays, int count);
+};
+
+/**
+ * @brief closest hit found so far for every lane of a packet
+ */
+struct PacketHit {
+	PacketFloat t;
+	std::array<const IHittable *, packet_size> object;
+	// lanes that came within float error of hitting or missing something
+	PacketMask uncertain;
+
+	explicit PacketHit(float t_max);
+
+	/**
+	 * @brief lower t to the candidate for every lane in mask and remember the object that produced it
+	 */
+	void commit(const PacketMask &mask, const PacketFloat &candidate, const IHittable *hit_object) {
+		if (!mask.any())
+			return;
+		t = mask.select(candidate, t);
+		for (int i = 0; i < packet_size; i++) {
+			if (mask[i])
+				object[i] = hit_object;
+		}
+	}
+
+	/**
+	 * @brief flag the lanes in mask whose float result is too close to call, tracePacket traces them again one ray at
+	 * a time
+	 */
+	void doubt(const PacketMask &mask) { uncertain = uncertain || mask; }
+};
+
+#endif // RAYTRACING_RAYPACKET_H
@@ -0,0 +1,69 @@
+/**
+ * @file RenderPool.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Render worker threads that outlive a single render
+ */
+
+#ifndef RAYTRACING_RENDERPOOL_H
+#define RAYTRACING_RENDERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief threads that wait for jobs between renders, so a sequence of small frames does not pay for starting and
+ * joining them every time. the thread local state of the workers, like their render counters, lives as long as the
+ * pool
+ */
+class RenderPool {
+public:
+	/**
+	 * @param thread_count threads started right away, more are started when a job asks for them
+	 */
+	explicit RenderPool(int thread_count = 0);
+
+	RenderPool(const RenderPool &) = delete;
+
+	RenderPool &operator=(const RenderPool &) = delete;
+
+	~RenderPool();
+
+	/**
+	 * @brief call job once with every worker index in [0, worker_count), each on its own pool thread, and wait for
+	 * all of them. jobs from different callers run one after another
+	 */
+	void run(int worker_count, const std::function<void(int)> &job);
+
+	int threadCount() const;
+
+	/**
+	 * @brief pool of Camera::Render when the camera has none set, its threads start on first use
+	 */
+	static RenderPool &shared();
+
+private:
+	void work(int index, uint64_t generation);
+
+	// makes sure at least count threads exist, called with mutex held
+	void grow(int count);
+
+	// one job at a time
+	std::mutex run_mutex;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::vector<std::thread> threads;
+	const std::function<void(int)> *job = nullptr;
+	int job_workers = 0;
+	int remaining = 0;
+	// bumped for every job, a worker runs each generation at most once
+	uint64_t generation = 0;
+	bool stopping = false;
+};
+
+#endif // RAYTRACING_RENDERPOOL_H
@@ -0,0 +1,50 @@
+/**
+ * @file RenderStats.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Per thread counters of a render, only collected in builds with RAYTRACING_STATS
+ */
+
+#ifndef RAYTRACING_RENDERSTATS_H
+#define RAYTRACING_RENDERSTATS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RenderStats {
+	uint64_t primary_rays = 0;
+	uint64_t secondary_rays = 0;
+	uint64_t shadow_rays = 0;
+	uint64_t bvh_nodes = 0;
+	uint64_t sphere_tests = 0;
+	uint64_t quad_tests = 0;
+	uint64_t triangle_tests = 0;
+	// surface hits shaded, over primary_rays this is the average path depth
+	uint64_t path_vertices = 0;
+	uint64_t tiles = 0;
+	double tile_ms = 0;
+	double max_tile_ms = 0;
+
+	void merge(const RenderStats &other);
+
+	uint64_t rays() const;
+};
+
+#ifdef RAYTRACING_STATS
+// the statements are dropped entirely from builds without statistics
+#define RAYTRACING_STAT(...) __VA_ARGS__
+
+// counters of the calling thread, render workers hand them over once their tiles are done
+extern constinit thread_local RenderStats thread_stats;
+#else
+#define RAYTRACING_STAT(...)
+#endif
+
+/**
+ * @brief write the counters of every worker and their sum as JSON
+ * @param seconds wall time of the render
+ */
+bool writeRenderStats(const std::vector<RenderStats> &workers, double seconds, const std::string &file);
+
+#endif // RAYTRACING_RENDERSTATS_H
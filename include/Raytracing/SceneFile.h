@@ -0,0 +1,45 @@
+/**
+ * @file SceneFile.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Scenes described in text files, and a binary cache of them once parsed and built
+ */
+
+#ifndef RAYTRACING_SCENEFILE_H
+#define RAYTRACING_SCENEFILE_H
+
+#include <optional>
+#include <string>
+#include "scenes.h"
+
+/**
+ * @brief parse and build a scene file, one directive per line and # starts a comment:
+ *
+ *     output <file>
+ *     camera [width n] [aspect a] [fov deg] [from x y z] [at x y z] [dof deg] [focus d] [samples n] [depth n]
+ *            [threads n] [chunk n] [shutter s] [background r g b]
+ *     texture <name> solid <r g b> | checker <scale> <even> <odd> | image <file> | noise <frequency> <octaves>
+ *            <persistence> | terrain <frequency> <octaves> <persistence>
+ *     material <name> lambertian <tex> | metal <tex> <fuzz> | dielectric <ir> [tex] | light <tex>
+ *     sphere <center> <radius> <material>
+ *     moving_sphere <from> <to> <radius> <material>
+ *     quad | triangle <corner> <u> <v> <material>
+ *     box <corner> <opposite corner> <material>
+ *     mesh <file> <material>...
+ *     object <name> ... end
+ *     instance <object> [translate x y z] [rotate psi theta phi] [scale s] [material m]
+ *
+ * a <tex> is a texture name or an inline r g b. names have to be defined before they are used. images are looked up
+ * in IMG_INPUT_DIR, meshes next to the scene file. objects collect the shapes up to their end into one BVH, which
+ * instances place in the world or in later objects. rotations are in degrees
+ * @return nullopt when the file cannot be read or has an error, which is logged with its line
+ */
+std::optional<Scene> loadSceneFile(const std::string &file);
+
+/**
+ * @brief loadSceneFile through a binary cache of the parsed scene, its mesh buffers and every BVH. the cache is written
+ * again when it is missing, or when the scene file or one of its meshes changed since
+ */
+std::optional<Scene> loadScene(const std::string &file, const std::string &cache);
+
+#endif // RAYTRACING_SCENEFILE_H
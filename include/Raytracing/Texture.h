@@ -8,13 +8,26 @@
 #ifndef RAYTRACING_TEXTURE_H
 #define RAYTRACING_TEXTURE_H
 
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
 #include "ImageUtil.h"
 #include "MathUtil.h"
+#include "MipMap.h"
+
 class ITexture {
 public:
 	virtual ~ITexture() = default;
 
 	virtual Color value(float u, float v, const Point3& p) const = 0;
+
+	/**
+	 * @brief value averaged over footprint, the width of the sampled area in texture space. textures without detail
+	 * to filter ignore it
+	 */
+	virtual Color filteredValue(float u, float v, const Point3& p, float footprint) const { return value(u, v, p); }
 };
 
 class SolidColor : public ITexture {
@@ -26,6 +39,7 @@ public:
 	Color value(float u, float v, const Point3& p) const override;
 
 private:
+	friend class TextureTable;
 	Color color_val;
 };
 
@@ -37,20 +51,63 @@ public:
 
 	Color value(float u, float v, const Point3 &p) const override;
 
+	Color filteredValue(float u, float v, const Point3 &p, float footprint) const override;
+
 private:
+	friend class TextureTable;
 	float inv_scale;
 	std::shared_ptr<ITexture> even;
 	std::shared_ptr<ITexture> odd;
 };
 
+/**
+ * @brief image file in linear float with a mip pyramid, textures of the same file share it through TextureCache
+ */
 class ImageTexture : public ITexture {
 public:
 	ImageTexture(const std::string& image, const std::string& parent = IMG_INPUT_DIR);
 
+	/**
+	 * @brief bilinear lookup of the full resolution image
+	 */
 	Color value(float u, float v, const Point3 &p) const override;
 
+	/**
+	 * @brief trilinear lookup of the levels matching footprint
+	 */
+	Color filteredValue(float u, float v, const Point3 &p, float footprint) const override;
+
 private:
-	Image img;
+	friend class TextureTable;
+	std::shared_ptr<const MipMap> texture;
+};
+
+/**
+ * @brief octave noise sampled once on a grid over a box and read back with trilinear interpolation. detail finer than
+ * the grid is lost, points outside the box get the procedural noise
+ */
+class NoiseVolume {
+public:
+	/**
+	 * @param resolution cells along the longest side of region, the other sides get cells of the same size
+	 */
+	NoiseVolume(const Perlin &noise, float frequency, int octave_count, float persistence, const AABB &region,
+				int resolution);
+
+	float value(const Point3 &p) const;
+
+	size_t memoryUsage() const;
+
+private:
+	Perlin noise;
+	float frequency;
+	int octave_count;
+	float persistence;
+	Point3 origin;
+	Real cells_per_unit;
+	// samples along each axis, one more than cells
+	int size[3];
+	std::vector<float> samples;
 };
 
 class NoiseTexture : public ITexture {
@@ -58,11 +115,17 @@ public:
 	NoiseTexture(float frequency, int octave_count, float persistence);
 
 	Color value(float u, float v, const Point3& p) const override;
+
+	/**
+	 * @brief look the noise up in a NoiseVolume over region from now on, instead of evaluating every octave
+	 */
+	void bake(const AABB &region, int resolution);
 private:
 	Perlin noise;
 	float frequency;
 	int octave_count;
 	float persistence;
+	std::shared_ptr<const NoiseVolume> volume;
 };
 
 class TerrainTexture : public ITexture {
@@ -70,11 +133,81 @@ public:
 	TerrainTexture(float frequency, int octave_count, float persistence);
 
 	Color value(float u, float v, const Point3& p) const override;
+
+	/**
+	 * @brief look the height up in a NoiseVolume over region from now on, instead of evaluating every octave
+	 */
+	void bake(const AABB &region, int resolution);
 private:
 	Perlin noise;
 	float frequency;
 	int octave_count;
 	float persistence;
+	std::shared_ptr<const NoiseVolume> volume;
+};
+
+/**
+ * @brief texture flattened into a TextureTable. the kinds above are evaluated by a switch, anything else keeps
+ * calling through its vtable
+ */
+struct FlatTexture {
+	enum class Kind : uint8_t { Solid, Checker, Image, Noise, Terrain, Other };
+
+	Kind kind = Kind::Other;
+	float inv_scale = 1;
+	// Checker: the halves, in the same table
+	uint32_t even = 0, odd = 0;
+	Color color{0, 0, 0};
+	const MipMap *image = nullptr;
+	// Noise, Terrain and Other
+	const ITexture *texture = nullptr;
+};
+
+/**
+ * @brief contiguous flat copies of a set of textures. the textures have to outlive the table
+ */
+class TextureTable {
+public:
+	/**
+	 * @brief flatten texture and whatever it refers to, a texture added twice keeps its first index
+	 */
+	uint32_t add(const ITexture *texture);
+
+	Color value(uint32_t index, float u, float v, const Point3 &p) const { return lookup<false>(index, u, v, p, 0); }
+
+	Color filteredValue(uint32_t index, float u, float v, const Point3 &p, float footprint) const {
+		return lookup<true>(index, u, v, p, footprint);
+	}
+
+	size_t size() const { return textures.size(); }
+
+private:
+	template<bool filtered>
+	Color lookup(uint32_t index, float u, float v, const Point3 &p, float footprint) const {
+		const FlatTexture *texture = &textures[index];
+		while (texture->kind == FlatTexture::Kind::Checker) {
+			auto u_int = static_cast<int>(u * 50 * texture->inv_scale);
+			auto v_int = static_cast<int>(v * 50 * texture->inv_scale);
+			texture = &textures[(u_int + v_int) % 2 == 0 ? texture->even : texture->odd];
+		}
+		switch (texture->kind) {
+			case FlatTexture::Kind::Solid:
+				return texture->color;
+			case FlatTexture::Kind::Image:
+				if (texture->image == nullptr)
+					return Color{0, 1, 1};
+				return filtered ? texture->image->trilinear(u, v, footprint) : texture->image->bilinear(0, u, v);
+			case FlatTexture::Kind::Noise:
+				return static_cast<const NoiseTexture *>(texture->texture)->NoiseTexture::value(u, v, p);
+			case FlatTexture::Kind::Terrain:
+				return static_cast<const TerrainTexture *>(texture->texture)->TerrainTexture::value(u, v, p);
+			default:
+				return filtered ? texture->texture->filteredValue(u, v, p, footprint) : texture->texture->value(u, v, p);
+		}
+	}
+
+	std::vector<FlatTexture> textures;
+	std::unordered_map<const ITexture *, uint32_t> indices;
 };
 
 #endif // RAYTRACING_TEXTURE_H
@@ -0,0 +1,74 @@
+/**
+ * @file TileScheduler.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Lock-free tile scheduler used by the render workers
+ */
+
+#ifndef RAYTRACING_TILESCHEDULER_H
+#define RAYTRACING_TILESCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct Tile {
+	int startx;
+	int starty;
+	int width;
+	int height;
+	int idx;
+};
+
+enum class SchedulePolicy {
+	// every worker owns a contiguous band of tiles and steals from the others when it runs dry
+	WorkStealing,
+	// every worker takes the next tile from one shared counter
+	SharedCounter
+};
+
+class TileScheduler {
+public:
+	TileScheduler(int width, int height, int tile_dimension, int worker_count,
+				  SchedulePolicy policy = SchedulePolicy::WorkStealing);
+
+	/**
+	 * @brief fetch the next tile for a worker
+	 * @param worker index of the calling worker, in [0, worker_count)
+	 * @param tile output tile
+	 * @return false when every tile has been handed out
+	 */
+	bool next(int worker, Tile &tile);
+
+	int tileCount() const;
+
+	int workerCount() const;
+
+private:
+	// the owner pops from the front and thieves pop from the back of the same packed [begin, end) range,
+	// so a single CAS on one word arbitrates both ends
+	struct alignas(64) WorkerRange {
+		std::atomic<uint64_t> range;
+	};
+
+	static uint64_t pack(uint32_t begin, uint32_t end);
+
+	bool popFront(int worker, int &idx);
+
+	bool stealBack(int victim, int &idx);
+
+	Tile makeTile(int idx) const;
+
+	int width;
+	int height;
+	int tile_dimension;
+	int tiles_x;
+	int tile_count;
+	int worker_count;
+	SchedulePolicy policy;
+	std::unique_ptr<WorkerRange[]> ranges;
+	alignas(64) std::atomic<int> counter = 0;
+};
+
+#endif // RAYTRACING_TILESCHEDULER_H
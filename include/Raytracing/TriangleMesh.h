@@ -0,0 +1,90 @@
+/**
+ * @file TriangleMesh.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Indexed triangle mesh over shared vertex buffers, with its own BVH over the triangles
+ */
+
+#ifndef RAYTRACING_TRIANGLEMESH_H
+#define RAYTRACING_TRIANGLEMESH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BVH.h"
+#include "Eigen/Core"
+#include "GraphicObjects.h"
+#include "MathUtil.h"
+
+/**
+ * @brief vertex and index buffers of a mesh, kept in float to halve their size.
+ * normals and uvs are indexed separately from the positions, like in OBJ files, and may be empty
+ */
+struct MeshData {
+	std::vector<Eigen::Vector3f> positions;
+	std::vector<Eigen::Vector3f> normals;
+	std::vector<Eigen::Vector2f> uvs;
+	// three per triangle
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> normal_indices;
+	std::vector<uint32_t> uv_indices;
+	// one per triangle, or empty when the whole mesh uses material 0
+	std::vector<uint16_t> material_ids;
+	// names the ids refer to, as found in the file
+	std::vector<std::string> material_names;
+
+	size_t triangleCount() const { return indices.size() / 3; }
+
+	size_t memoryUsage() const;
+};
+
+/**
+ * @brief one hittable for a whole mesh. emissive triangles are only reached by scattering, gatherLights does not
+ * collect them
+ */
+class TriangleMesh : public IHittable {
+public:
+	/**
+	 * @param materials indexed by the material ids of data, ids past the end use the last material. owned by the scene.
+	 * without any the mesh is logged as an error and stays empty
+	 */
+	TriangleMesh(std::shared_ptr<const MeshData> data, std::vector<const IMaterial *> materials);
+
+	/**
+	 * @brief restore a mesh whose tree was saved from flatNodes and triangleOrder, without building it again
+	 */
+	TriangleMesh(std::shared_ptr<const MeshData> data, std::vector<const IMaterial *> materials,
+				 std::vector<LinearBVHNode> nodes, std::vector<uint32_t> order);
+
+	bool hit(const Ray &r, Interval interval, HitRecord &record) const override;
+
+	AABB boundingBox() const override;
+
+	size_t triangleCount() const;
+
+	/**
+	 * @brief bytes of the triangle BVH and the triangle order, the shared buffers are counted by MeshData
+	 */
+	size_t memoryUsage() const;
+
+	const MeshData &meshData() const;
+
+	const std::vector<LinearBVHNode> &flatNodes() const;
+
+	const std::vector<uint32_t> &triangleOrder() const;
+
+private:
+	void setBoundingBox();
+
+	bool hitTriangle(uint32_t triangle, const Ray &r, Interval interval, HitRecord &record) const;
+
+	std::shared_ptr<const MeshData> data;
+	std::vector<const IMaterial *> materials;
+	std::vector<LinearBVHNode> nodes;
+	// triangle index of every leaf slot
+	std::vector<uint32_t> order;
+	AABB bbox;
+};
+
+#endif // RAYTRACING_TRIANGLEMESH_H
@@ -8,6 +8,67 @@
 #ifndef RAYTRACING_SCENES_H
 #define RAYTRACING_SCENES_H
 
+#include <span>
+#include <string>
+#include "Camera.h"
+#include "GraphicObjects.h"
+#include "Material.h"
+
+/**
+ * @brief a bundled scene as it would be rendered, name is the output file. the world points into materials
+ */
+struct Scene {
+	std::string name;
+	MaterialTable materials;
+	HittableList world;
+	Camera camera;
+};
+
+Scene makeRandomSpheres();
+
+Scene makeTwoSpheres();
+
+Scene makeHuajiSphere();
+
+Scene makePerlinSpheres();
+
+/**
+ * @brief perlinSpheres with the noise looked up in a baked volume
+ */
+Scene makeBakedPerlinSpheres();
+
+Scene makeTerrain();
+
+/**
+ * @brief terrain with the height looked up in a baked volume
+ */
+Scene makeBakedTerrain();
+
+Scene makeQuads();
+
+Scene makeTriangles();
+
+Scene makeCornellBox();
+
+Scene makeCornellBoxWithObjects();
+
+Scene makeInstances();
+
+struct BundledScene {
+	const char *name;
+	Scene (*make)();
+};
+
+/**
+ * @brief every make function above with its name, for the tools that go through all bundled scenes
+ */
+std::span<const BundledScene> bundledScenes();
+
+/**
+ * @brief render scene with its own camera into IMG_OUTPUT_DIR
+ */
+void render(const Scene &scene);
+
 void randomSpheres();
 
 void twoSpheres();
@@ -32,4 +93,6 @@ void cornellBoxWithObjects();
 
 void entityRotationTest();
 
+void instances();
+
 #endif // RAYTRACING_SCENES_H
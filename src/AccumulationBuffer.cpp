@@ -0,0 +1,138 @@
+/**
+ * @file AccumulationBuffer.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "AccumulationBuffer.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include "spdlog/spdlog.h"
+
+namespace {
+	constexpr char checkpoint_magic[4] = {'R', 'T', 'C', 'K'};
+	constexpr uint32_t checkpoint_version = 2;
+
+	struct CheckpointHeader {
+		char magic[4];
+		uint32_t version;
+		int32_t width;
+		int32_t height;
+		uint64_t seed;
+		uint64_t settings;
+		uint32_t passes;
+		// keeps the tail free of padding, always zero
+		uint32_t reserved;
+	};
+
+	// written as raw bytes, so every one of them has to be a field
+	static_assert(std::has_unique_object_representations_v<CheckpointHeader>);
+} // namespace
+
+AccumulationBuffer::AccumulationBuffer(int width, int height) :
+	acc_width(width), acc_height(height), sums(static_cast<size_t>(width) * height * 3, 0),
+	counts(static_cast<size_t>(width) * height, 0) {}
+
+int AccumulationBuffer::width() const { return acc_width; }
+
+int AccumulationBuffer::height() const { return acc_height; }
+
+uint32_t AccumulationBuffer::passes() const { return pass_count; }
+
+uint32_t AccumulationBuffer::samples() const {
+	return counts.empty() ? 0 : *std::min_element(counts.begin(), counts.end());
+}
+
+void AccumulationBuffer::add(const Framebuffer &pass, uint32_t samples) {
+	for (int y = 0; y < acc_height; y++) {
+		const auto *row = pass.row(y);
+		for (int x = 0; x < acc_width; x++) {
+			auto i = static_cast<size_t>(y) * acc_width + x;
+			sums[3 * i] += row[x].r * samples;
+			sums[3 * i + 1] += row[x].g * samples;
+			sums[3 * i + 2] += row[x].b * samples;
+			counts[i] += samples;
+		}
+	}
+	pass_count++;
+}
+
+void AccumulationBuffer::resolve(Framebuffer &image) const {
+	for (int y = 0; y < acc_height; y++) {
+		auto *row = image.row(y);
+		for (int x = 0; x < acc_width; x++) {
+			auto i = static_cast<size_t>(y) * acc_width + x;
+			float scale = counts[i] == 0 ? 0 : 1.0f / counts[i];
+			row[x] = Pixel(sums[3 * i] * scale, sums[3 * i + 1] * scale, sums[3 * i + 2] * scale);
+		}
+	}
+}
+
+bool AccumulationBuffer::save(const std::string &file, uint64_t seed, uint64_t settings) const {
+	auto temp = file + ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+		CheckpointHeader header{};
+		std::copy(std::begin(checkpoint_magic), std::end(checkpoint_magic), header.magic);
+		header.version = checkpoint_version;
+		header.width = acc_width;
+		header.height = acc_height;
+		header.seed = seed;
+		header.settings = settings;
+		header.passes = pass_count;
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(float)));
+		out.write(reinterpret_cast<const char *>(counts.data()),
+				  static_cast<std::streamsize>(counts.size() * sizeof(uint32_t)));
+		if (!out) {
+			spdlog::error("failed to write checkpoint {}", temp);
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temp, file, ec);
+	if (ec) {
+		spdlog::error("failed to replace checkpoint {}: {}", file, ec.message());
+		return false;
+	}
+	return true;
+}
+
+bool AccumulationBuffer::load(const std::string &file, uint64_t seed, uint64_t settings) {
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+	CheckpointHeader header{};
+	in.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if (!in || !std::equal(std::begin(checkpoint_magic), std::end(checkpoint_magic), header.magic) ||
+		header.version != checkpoint_version) {
+		spdlog::warn("{} is not a checkpoint, ignoring it", file);
+		return false;
+	}
+	if (header.width != acc_width || header.height != acc_height || header.seed != seed) {
+		spdlog::warn("checkpoint {} is from a {}x{} render with seed {}, ignoring it", file, header.width,
+					 header.height, header.seed);
+		return false;
+	}
+	if (header.settings != settings) {
+		spdlog::warn("checkpoint {} is from another scene or other render settings, ignoring it", file);
+		return false;
+	}
+	std::vector<float> loaded_sums(sums.size());
+	std::vector<uint32_t> loaded_counts(counts.size());
+	in.read(reinterpret_cast<char *>(loaded_sums.data()),
+			static_cast<std::streamsize>(loaded_sums.size() * sizeof(float)));
+	in.read(reinterpret_cast<char *>(loaded_counts.data()),
+			static_cast<std::streamsize>(loaded_counts.size() * sizeof(uint32_t)));
+	if (!in) {
+		spdlog::warn("checkpoint {} is truncated, ignoring it", file);
+		return false;
+	}
+	sums = std::move(loaded_sums);
+	counts = std::move(loaded_counts);
+	pass_count = header.passes;
+	return true;
+}
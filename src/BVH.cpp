@@ -0,0 +1,447 @@
+/**
+ * @file BVH.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "BVH.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+#include "RenderStats.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+	// double bounds are rounded outwards so the float box never shrinks below the primitive
+	float roundDown(double x) {
+		auto f = static_cast<float>(x);
+		return f > x ? std::nextafter(f, -INF) : f;
+	}
+
+	float roundUp(double x) {
+		auto f = static_cast<float>(x);
+		return f < x ? std::nextafter(f, INF) : f;
+	}
+
+	PacketMask hitNodeBounds(const LinearBVHNode &node, const RayPacket &packet, float t_min,
+							 const PacketFloat &t_max) {
+		PacketFloat t0 = (node.bounds_min[0] - packet.ox) * packet.inv_dx;
+		PacketFloat t1 = (node.bounds_max[0] - packet.ox) * packet.inv_dx;
+		PacketFloat near = t0.min(t1).max(t_min);
+		PacketFloat far = t0.max(t1).min(t_max);
+		t0 = (node.bounds_min[1] - packet.oy) * packet.inv_dy;
+		t1 = (node.bounds_max[1] - packet.oy) * packet.inv_dy;
+		near = near.max(t0.min(t1));
+		far = far.min(t0.max(t1));
+		t0 = (node.bounds_min[2] - packet.oz) * packet.inv_dz;
+		t1 = (node.bounds_max[2] - packet.oz) * packet.inv_dz;
+		near = near.max(t0.min(t1));
+		far = far.min(t0.max(t1));
+		// widened by the rounding of the slab distances, so grazing lanes still reach the primitives that doubt them
+		return packet.active && (near <= far * (1 + 4 * std::numeric_limits<float>::epsilon()));
+	}
+} // namespace
+
+void LinearBVH::Bounds::extend(const Bounds &other) {
+	min = min.min(other.min);
+	max = max.max(other.max);
+}
+
+void LinearBVH::Bounds::extend(const Eigen::Array3d &p) {
+	min = min.min(p);
+	max = max.max(p);
+}
+
+double LinearBVH::Bounds::surfaceArea() const {
+	Eigen::Array3d d = max - min;
+	if ((d < 0).any())
+		return 0;
+	return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+float LinearBVH::leafCost(size_t count) {
+	// partial batches cost as much as full ones
+	return intersection_cost * batch_cost * static_cast<float>((count + batch_width - 1) / batch_width);
+}
+
+float LinearBVH::leafCost(const std::vector<PrimitiveInfo> &info, size_t start, size_t end) {
+	// every kind in a leaf is its own run of batches, primitives without a kernel are tested one by one
+	size_t counts[static_cast<int>(PrimitiveKind::Other) + 1] = {};
+	for (auto i = start; i < end; i++)
+		counts[static_cast<int>(info[i].kind)]++;
+	float cost = 0;
+	for (int k = 0; k < static_cast<int>(PrimitiveKind::Other); k++)
+		cost += leafCost(counts[k]);
+	return cost + intersection_cost * static_cast<float>(counts[static_cast<int>(PrimitiveKind::Other)]);
+}
+
+LinearBVH::LinearBVH(const HittableList &list) : LinearBVH(list.objects) {}
+
+LinearBVH::LinearBVH(const std::vector<std::shared_ptr<IHittable>> &objects) {
+	if (objects.empty())
+		return;
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<PrimitiveInfo> info(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		info[i] = makeInfo(static_cast<uint32_t>(i), objects[i]->boundingBox(), PrimitiveBatch::kindOf(*objects[i]));
+	}
+	buildTree(info);
+
+	primitives.reserve(objects.size());
+	for (const auto &i : info) {
+		primitives.push_back(objects[i.index]);
+	}
+	for (const auto &node : nodes) {
+		if (!node.isLeaf())
+			continue;
+		auto first = primitives.begin() + node.primitive_offset;
+		std::stable_sort(first, first + node.primitive_count, [](const auto &a, const auto &b) {
+			return PrimitiveBatch::kindOf(*a) < PrimitiveBatch::kindOf(*b);
+		});
+	}
+	batch = PrimitiveBatch(primitives);
+
+	auto end = std::chrono::steady_clock::now();
+	report.build_time_ms = std::chrono::duration<float, std::milli>(end - begin).count();
+	spdlog::info("bvh built in {}ms: {} primitives, {} nodes, {} leaves, depth {}, SAH cost {}", report.build_time_ms,
+				 report.primitive_count, report.node_count, report.leaf_count, report.depth, report.sah_cost);
+}
+
+LinearBVH::LinearBVH(const std::vector<std::shared_ptr<IHittable>> &objects, std::vector<LinearBVHNode> nodes,
+					 const std::vector<uint32_t> &order) :
+	nodes(std::move(nodes)) {
+	if (this->nodes.empty())
+		return;
+	primitives.reserve(order.size());
+	for (auto i : order) {
+		primitives.push_back(objects[i]);
+		bbox = primitives.size() == 1 ? objects[i]->boundingBox() : AABB(bbox, objects[i]->boundingBox());
+	}
+	batch = PrimitiveBatch(primitives);
+	report.node_count = this->nodes.size();
+	report.primitive_count = primitives.size();
+	for (const auto &node : this->nodes)
+		report.leaf_count += node.isLeaf();
+}
+
+std::vector<LinearBVHNode> LinearBVH::buildNodes(const std::vector<AABB> &boxes, std::vector<uint32_t> &order,
+												 BVHBuildReport &report) {
+	if (boxes.empty())
+		return {};
+	LinearBVH bvh;
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<PrimitiveInfo> info(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		info[i] = makeInfo(static_cast<uint32_t>(i), boxes[i], PrimitiveKind::Other);
+	}
+	bvh.buildTree(info);
+	order.resize(info.size());
+	for (size_t i = 0; i < info.size(); i++)
+		order[i] = info[i].index;
+	auto end = std::chrono::steady_clock::now();
+	bvh.report.build_time_ms = std::chrono::duration<float, std::milli>(end - begin).count();
+	report = bvh.report;
+	return std::move(bvh.nodes);
+}
+
+LinearBVH::PrimitiveInfo LinearBVH::makeInfo(uint32_t index, const AABB &box, PrimitiveKind kind) {
+	PrimitiveInfo info;
+	info.index = index;
+	info.kind = kind;
+	info.bounds.min = Eigen::Array3d{box.x.min, box.y.min, box.z.min};
+	info.bounds.max = Eigen::Array3d{box.x.max, box.y.max, box.z.max};
+	info.centroid = (info.bounds.min + info.bounds.max) / 2;
+	// unbounded primitives would poison the centroid bins, keep them at the origin instead
+	info.centroid = info.centroid.isFinite().select(info.centroid, 0);
+	return info;
+}
+
+void LinearBVH::buildTree(std::vector<PrimitiveInfo> &info) {
+	auto root = buildRecursive(info, 0, info.size(), 0);
+	nodes.reserve(2 * info.size());
+	flatten(*root, 1, root->bounds.surfaceArea());
+	// the traversal stacks hold max_depth entries
+	assert(report.depth <= max_depth);
+	nodes.shrink_to_fit();
+	bbox = AABB(Interval(root->bounds.min.x(), root->bounds.max.x()),
+				Interval(root->bounds.min.y(), root->bounds.max.y()),
+				Interval(root->bounds.min.z(), root->bounds.max.z()));
+	report.node_count = nodes.size();
+	report.primitive_count = info.size();
+}
+
+std::unique_ptr<LinearBVH::BuildNode> LinearBVH::buildRecursive(std::vector<PrimitiveInfo> &info, size_t start,
+																 size_t end, int depth) const {
+	auto node = std::make_unique<BuildNode>();
+	Bounds centroid_bounds;
+	for (size_t i = start; i < end; i++) {
+		node->bounds.extend(info[i].bounds);
+		centroid_bounds.extend(info[i].centroid);
+	}
+	auto count = end - start;
+	auto make_leaf = [&]() {
+		node->primitive_offset = static_cast<uint32_t>(start);
+		node->primitive_count = static_cast<uint32_t>(count);
+		return std::move(node);
+	};
+	if (count == 1 || depth >= max_depth - 1)
+		return make_leaf();
+	// median splits halve the node, it needs this many of them before every leaf fits in a node
+	auto median_levels = std::bit_width((count - 1) / UINT16_MAX);
+	if (depth + median_levels >= max_depth - 1) {
+		// SAH splits left too few levels, only median splits keep the tree within max_depth from here on
+		int axis = 0;
+		Eigen::Array3d extent = centroid_bounds.max - centroid_bounds.min;
+		extent.maxCoeff(&axis);
+		auto mid = start + count / 2;
+		std::nth_element(info.begin() + start, info.begin() + mid, info.begin() + end,
+						 [=](const PrimitiveInfo &a, const PrimitiveInfo &b) {
+							 return a.centroid[axis] < b.centroid[axis];
+						 });
+		node->axis = static_cast<uint8_t>(axis);
+		node->children[0] = buildRecursive(info, start, mid, depth + 1);
+		node->children[1] = buildRecursive(info, mid, end, depth + 1);
+		return node;
+	}
+
+	struct Bin {
+		Bounds bounds;
+		size_t count = 0;
+	};
+
+	Eigen::Array3d extent = centroid_bounds.max - centroid_bounds.min;
+	auto parent_area = node->bounds.surfaceArea();
+	if (parent_area <= 0)
+		parent_area = 1;
+	float best_cost = INF;
+	int best_axis = -1;
+	int best_split = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 0)
+			continue;
+		Bin bins[bin_count];
+		auto scale = bin_count / extent[axis];
+		for (size_t i = start; i < end; i++) {
+			auto offset = (info[i].centroid[axis] - centroid_bounds.min[axis]) * scale;
+			auto b = std::clamp(static_cast<int>(offset), 0, bin_count - 1);
+			bins[b].count++;
+			bins[b].bounds.extend(info[i].bounds);
+		}
+		double right_area[bin_count - 1];
+		size_t right_count[bin_count - 1];
+		Bounds acc;
+		size_t acc_count = 0;
+		for (int i = bin_count - 1; i > 0; i--) {
+			acc.extend(bins[i].bounds);
+			acc_count += bins[i].count;
+			right_area[i - 1] = acc.surfaceArea();
+			right_count[i - 1] = acc_count;
+		}
+		acc = Bounds();
+		acc_count = 0;
+		for (int i = 0; i < bin_count - 1; i++) {
+			acc.extend(bins[i].bounds);
+			acc_count += bins[i].count;
+			if (acc_count == 0 || right_count[i] == 0)
+				continue;
+			float cost = traversal_cost +
+						 (leafCost(acc_count) * acc.surfaceArea() + leafCost(right_count[i]) * right_area[i]) / parent_area;
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	if (count <= max_leaf_size && leafCost(info, start, end) <= best_cost)
+		return make_leaf();
+
+	size_t mid;
+	if (best_axis >= 0) {
+		auto axis = best_axis;
+		auto scale = bin_count / extent[axis];
+		auto min = centroid_bounds.min[axis];
+		auto split = best_split;
+		auto it = std::partition(info.begin() + start, info.begin() + end, [=](const PrimitiveInfo &p) {
+			return std::clamp(static_cast<int>((p.centroid[axis] - min) * scale), 0, bin_count - 1) <= split;
+		});
+		mid = it - info.begin();
+		node->axis = static_cast<uint8_t>(axis);
+	} else {
+		// every centroid coincides, fall back to splitting the range in half
+		mid = start + count / 2;
+		node->axis = 0;
+	}
+
+	static const int parallel_depth = std::bit_width(std::max(1u, std::thread::hardware_concurrency())) + 1;
+	if (count >= parallel_threshold && depth < parallel_depth) {
+		auto left = std::async(std::launch::async, &LinearBVH::buildRecursive, this, std::ref(info), start, mid,
+							   depth + 1);
+		node->children[1] = buildRecursive(info, mid, end, depth + 1);
+		node->children[0] = left.get();
+	} else {
+		node->children[0] = buildRecursive(info, start, mid, depth + 1);
+		node->children[1] = buildRecursive(info, mid, end, depth + 1);
+	}
+	return node;
+}
+
+uint32_t LinearBVH::flatten(const BuildNode &node, int depth, double root_area) {
+	auto node_idx = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	for (int i = 0; i < 3; i++) {
+		nodes[node_idx].bounds_min[i] = roundDown(node.bounds.min[i]);
+		nodes[node_idx].bounds_max[i] = roundUp(node.bounds.max[i]);
+	}
+	auto area_ratio = root_area > 0 ? node.bounds.surfaceArea() / root_area : 1;
+	report.depth = std::max(report.depth, depth);
+	if (node.primitive_count > 0) {
+		nodes[node_idx].primitive_offset = node.primitive_offset;
+		nodes[node_idx].primitive_count = static_cast<uint16_t>(node.primitive_count);
+		report.leaf_count++;
+		report.sah_cost += static_cast<float>(area_ratio * leafCost(node.primitive_count));
+		return node_idx;
+	}
+	report.sah_cost += static_cast<float>(area_ratio * traversal_cost);
+	flatten(*node.children[0], depth + 1, root_area);
+	auto second = flatten(*node.children[1], depth + 1, root_area);
+	nodes[node_idx].second_child_offset = second;
+	nodes[node_idx].primitive_count = 0;
+	nodes[node_idx].axis = node.axis;
+	return node_idx;
+}
+
+const std::vector<LinearBVHNode> &LinearBVH::flatNodes() const { return nodes; }
+
+std::vector<uint32_t> LinearBVH::primitiveOrder(const std::vector<std::shared_ptr<IHittable>> &objects) const {
+	std::unordered_map<const IHittable *, uint32_t> index;
+	for (size_t i = 0; i < objects.size(); i++)
+		index.emplace(objects[i].get(), static_cast<uint32_t>(i));
+	std::vector<uint32_t> order;
+	order.reserve(primitives.size());
+	for (const auto &primitive : primitives)
+		order.push_back(index.at(primitive.get()));
+	return order;
+}
+
+bool LinearBVH::hit(const Ray &r, Interval interval, HitRecord &record) const {
+	if (nodes.empty())
+		return false;
+	return traverse(r, interval, record, 0, nullptr);
+}
+
+bool LinearBVH::traverse(const Ray &r, Interval interval, HitRecord &record, uint32_t root,
+						 const IHittable **hit_object) const {
+	bool if_hit = false;
+	auto closest_t = interval.max;
+	traverseNodes(nodes, root, r, interval.min, closest_t, [&](const LinearBVHNode &node) {
+		auto hit_scalar = [&](uint32_t i) {
+			if (primitives[i]->hit(r, Interval(interval.min, closest_t), record)) {
+				if_hit = true;
+				closest_t = record.t;
+				if (hit_object != nullptr)
+					*hit_object = primitives[i].get();
+			}
+		};
+		auto leaf_end = node.primitive_offset + node.primitive_count;
+		for (uint32_t run = node.primitive_offset; run < leaf_end;) {
+			auto kind = batch.kind(run);
+			auto run_end = run + 1;
+			while (run_end < leaf_end && batch.kind(run_end) == kind)
+				run_end++;
+			if (kind == PrimitiveKind::Other) {
+				for (auto i = run; i < run_end; i++)
+					hit_scalar(i);
+			} else {
+				Real candidate_t = closest_t;
+				auto best = batch.hit(kind, r, run, run_end, interval.min, candidate_t);
+				if (best < 0) {
+					RAYTRACING_STAT(PrimitiveBatch::countTests(kind, run_end - run));
+				} else {
+					auto before = closest_t;
+					hit_scalar(static_cast<uint32_t>(best));
+					// the kernel and the scalar test disagree at the last bit, let the scalar test decide.
+					// best already missed and the others only lower closest_t, so it is not tested again
+					if (closest_t == before) {
+						for (auto i = run; i < run_end; i++) {
+							if (i != best)
+								hit_scalar(i);
+						}
+					} else {
+						RAYTRACING_STAT(PrimitiveBatch::countTests(kind, run_end - run - 1));
+					}
+				}
+			}
+			run = run_end;
+		}
+	});
+	return if_hit;
+}
+
+void LinearBVH::hitPacket(const RayPacket &packet, float t_min, PacketHit &result) const {
+	if (nodes.empty() || packet.count == 0)
+		return;
+	// the packet is coherent, so the first ray decides the near child for everyone
+	int dir_is_neg[3] = {packet.inv_dx[0] < 0, packet.inv_dy[0] < 0, packet.inv_dz[0] < 0};
+
+	uint32_t stack[max_depth];
+	int stack_top = 0;
+	uint32_t current = 0;
+	while (true) {
+		const auto &node = nodes[current];
+		RAYTRACING_STAT(thread_stats.bvh_nodes++);
+		auto mask = hitNodeBounds(node, packet, t_min, result.t);
+		auto active = mask.count();
+		if (active >= divergence_threshold) {
+			if (node.isLeaf()) {
+				for (uint32_t i = 0; i < node.primitive_count; i++) {
+					primitives[node.primitive_offset + i]->hitPacket(packet, t_min, result);
+				}
+			} else if (dir_is_neg[node.axis]) {
+				stack[stack_top++] = current + 1;
+				current = node.second_child_offset;
+				continue;
+			} else {
+				stack[stack_top++] = node.second_child_offset;
+				current = current + 1;
+				continue;
+			}
+		} else if (active > 0) {
+			// too few rays left to fill the lanes, finish this subtree one ray at a time
+			for (int i = 0; i < packet.count; i++) {
+				if (!mask[i])
+					continue;
+				HitRecord record;
+				const IHittable *object = nullptr;
+				if (traverse(packet.rays[i], Interval(t_min, result.t[i]), record, current, &object)) {
+					result.t[i] = record.t;
+					result.object[i] = object;
+				}
+			}
+		}
+		if (stack_top == 0)
+			break;
+		current = stack[--stack_top];
+	}
+}
+
+AABB LinearBVH::boundingBox() const { return bbox; }
+
+void LinearBVH::gatherLights(std::vector<const IHittable *> &lights) const {
+	for (const auto &primitive: primitives)
+		primitive->gatherLights(lights);
+}
+
+size_t LinearBVH::nodeCount() const { return nodes.size(); }
+
+size_t LinearBVH::primitiveCount() const { return primitives.size(); }
+
+const BVHBuildReport &LinearBVH::buildReport() const { return report; }
@@ -6,15 +6,115 @@
  */
 
 #include "Camera.h"
+#include "AccumulationBuffer.h"
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "ImageUtil.h"
 #include "Material.h"
+#include "RayPacket.h"
+#include "TileScheduler.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <string>
+#include <type_traits>
+
+namespace {
+// FNV-1a over the bytes of every value added
+class Fingerprint {
+  public:
+    template <typename T> void add(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (auto byte : bytes) {
+            hash ^= byte;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    void add(const Vec3 &v) {
+        add(v.x());
+        add(v.y());
+        add(v.z());
+    }
+
+    uint64_t value() const { return hash; }
+
+  private:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+// black -> red -> yellow -> white as t goes from 0 to 1
+Pixel heatColor(float t) {
+    return Pixel(std::clamp(3 * t, 0.0f, 1.0f),
+                 std::clamp(3 * t - 1, 0.0f, 1.0f),
+                 std::clamp(3 * t - 2, 0.0f, 1.0f));
+}
+} // namespace
 
 std::string Camera::Render(const IHittable &world, const std::string &name,
                            const std::string &path) {
-    auto now = std::chrono::system_clock::now();
+    if (progressive_pass > 0) {
+        int worker_cnt = startRender(world);
+        std::vector<RenderStats> stats(worker_cnt);
+        RAYTRACING_STAT(auto begin = std::chrono::steady_clock::now());
+        auto file = renderProgressive(world, name, path, worker_cnt, stats);
+        RAYTRACING_STAT(writeStats(
+            stats,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          begin)
+                .count(),
+            name, path));
+        return file;
+    }
+    return writeOutput(renderImage(world, name, path), name, path);
+}
+
+Framebuffer Camera::renderImage(const IHittable &world,
+                                const std::string &name,
+                                const std::string &path) {
+    int worker_cnt = startRender(world);
+    std::vector<RenderStats> stats(worker_cnt);
+    Framebuffer image(width, height);
+    // per pixel sample counts, kept in the red channel until the render ends
+    std::unique_ptr<Framebuffer> sample_map;
+    if (adaptive_sampling)
+        sample_map = std::make_unique<Framebuffer>(width, height);
+    auto begin = std::chrono::system_clock::now();
+    renderPass(world, worker_cnt, image, sample_map.get(), 0, sample_count,
+               stats);
+    auto end = std::chrono::system_clock::now();
+    auto time_elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    spdlog::info("render completed! taken {}s",
+                 static_cast<float>(time_elapsed.count()) / 1000.0);
+    RAYTRACING_STAT(writeStats(
+        stats, std::chrono::duration<double>(end - begin).count(), name, path));
+#ifndef ASCII_ART
+    if (sample_map) {
+        double total = 0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto &pixel = sample_map->at(x, y);
+                total += pixel.r;
+                pixel = heatColor(pixel.r / sample_count);
+            }
+        }
+        spdlog::info("adaptive sampling took {:.1f} samples per pixel",
+                     total / (static_cast<double>(width) * height));
+        writeImage(*sample_map,
+                   std::filesystem::path(name).stem().string() + "_spp",
+                   output_format, path);
+    }
+#endif
+    return image;
+}
+
+int Camera::startRender(const IHittable &world) {
     int worker_cnt;
     if (render_thread_count == 0) {
         worker_cnt = std::thread::hardware_concurrency() == 0
@@ -23,139 +123,234 @@ std::string Camera::Render(const IHittable &world, const std::string &name,
     } else {
         worker_cnt = render_thread_count;
     }
-    std::vector<std::vector<Color>> image;
-    image.resize(height);
-    for (auto &i : image) {
-        i.resize(width);
-    }
-    int part = partition();
-    auto m = KawaiiMQ::MessageQueueManager::Instance();
-    auto result_queue = KawaiiMQ::makeQueue("result");
-    auto result_topic = KawaiiMQ::Topic("renderResult");
-    m->relate(result_topic, result_queue);
-    auto th = std::vector<std::thread>();
+    lights = LightList(world);
     spdlog::info("rendering started!");
-    spdlog::info("using {} threads to render {} blocks", worker_cnt, part);
-    auto begin = std::chrono::system_clock::now();
-    for (int i = 0; i < worker_cnt; i++) {
-        th.emplace_back(&Camera::RenderWorker, this, std::ref(world));
+    if (light_sampling && !lights.empty())
+        spdlog::info("sampling {} lights", lights.size());
+    return worker_cnt;
+}
+
+std::string Camera::renderProgressive(const IHittable &world,
+                                      const std::string &name,
+                                      const std::string &path,
+                                      int worker_cnt,
+                                      std::vector<RenderStats> &stats) {
+    if (adaptive_sampling)
+        spdlog::warn("progressive rendering samples every pixel uniformly, "
+                     "adaptive sampling is ignored");
+    AccumulationBuffer accumulation(width, height);
+    auto checkpoint =
+        (std::filesystem::path(path) / std::filesystem::path(name).stem())
+            .string() +
+        ".ckpt";
+    auto settings = checkpointSettings(world);
+    if (resume && accumulation.load(checkpoint, seed, settings))
+        spdlog::info("resumed {} at {} samples per pixel", checkpoint,
+                     accumulation.samples());
+    Framebuffer pass_image(width, height);
+    Framebuffer image(width, height);
+    std::string file;
+    auto begin = std::chrono::steady_clock::now();
+    auto last_checkpoint = begin;
+    auto target = static_cast<uint32_t>(std::max(sample_count, 0));
+    while (accumulation.samples() < target) {
+        auto samples = std::min(static_cast<uint32_t>(progressive_pass),
+                                target - accumulation.samples());
+        renderPass(world, worker_cnt, pass_image, nullptr,
+                   accumulation.passes(), static_cast<int>(samples), stats);
+        accumulation.add(pass_image, samples);
+        auto now = std::chrono::steady_clock::now();
+        if (accumulation.samples() < target &&
+            now - last_checkpoint <
+                std::chrono::duration<float>(checkpoint_interval))
+            continue;
+        accumulation.resolve(image);
+        file = writeOutput(image, name, path);
+        accumulation.save(checkpoint, seed, settings);
+        last_checkpoint = now;
+        spdlog::info("{} of {} samples per pixel, preview written to {}",
+                     accumulation.samples(), target, file);
     }
-    for (auto &i : th) {
-        i.join();
+    // a resumed checkpoint may already hold every sample
+    if (file.empty()) {
+        accumulation.resolve(image);
+        file = writeOutput(image, name, path);
     }
-    auto end = std::chrono::system_clock::now();
-    auto time_elapsed =
-        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin);
     spdlog::info("render completed! taken {}s",
                  static_cast<float>(time_elapsed.count()) / 1000.0);
-    auto consumer = KawaiiMQ::Consumer("resultConsumer");
-    consumer.subscribe(result_topic);
-    while (!result_queue->empty()) {
-        auto chunk = KawaiiMQ::getMessage<ImageChunk>(
-            consumer.fetchSingleTopic(result_topic)[0]);
-        for (int i = chunk.starty; i < chunk.starty + chunk.height; i++) {
-            for (int j = chunk.startx; j < chunk.startx + chunk.width; j++) {
-                image[i][j] = chunk.partial[i - chunk.starty][j - chunk.startx];
-            }
-        }
+    return file;
+}
+
+void Camera::renderPass(const IHittable &world, int worker_cnt,
+                        Framebuffer &image, Framebuffer *sample_map,
+                        uint32_t pass, int samples,
+                        std::vector<RenderStats> &stats) const {
+    TileScheduler scheduler(width, height, chunk_dimension, worker_cnt);
+    spdlog::info("using {} threads to render {} blocks", worker_cnt,
+                 scheduler.tileCount());
+    auto &pool = render_pool != nullptr ? *render_pool : RenderPool::shared();
+    pool.run(worker_cnt, [&](int i) {
+        RenderWorker(world, scheduler, i, image, sample_map, pass, samples,
+                     stats[i]);
+    });
+}
+
+uint64_t Camera::checkpointSettings(const IHittable &world) const {
+    Fingerprint fingerprint;
+    fingerprint.add(position);
+    fingerprint.add(rotation_ypr);
+    fingerprint.add(fov);
+    fingerprint.add(dof_angle);
+    fingerprint.add(focal_len);
+    fingerprint.add(shutter_open);
+    fingerprint.add(shutter_speed);
+    fingerprint.add(background);
+    fingerprint.add(render_depth);
+    fingerprint.add(integrator);
+    fingerprint.add(roulette_depth);
+    fingerprint.add(light_sampling);
+    // the scene itself only through its bounds and light count
+    auto box = world.boundingBox();
+    for (const auto &axis : {box.x, box.y, box.z}) {
+        fingerprint.add(axis.min);
+        fingerprint.add(axis.max);
     }
-    m->unrelate(result_topic, result_queue);
+    fingerprint.add(lights.size());
+    return fingerprint.value();
+}
+
+std::string Camera::writeOutput(const Framebuffer &image,
+                                const std::string &name,
+                                const std::string &path) const {
 #ifndef ASCII_ART
-    return makePPM(width, height, image, name, path);
+    return writeImage(image, name, output_format, path);
 #else
-    return makeGrayscaleTxt(width, height, image, name);
+    return makeGrayscaleTxt(image, name);
 #endif
 }
 
-void Camera::RenderWorker(const IHittable &world) {
-    std::stringstream ss;
-    ss << std::this_thread::get_id();
-    auto m = KawaiiMQ::MessageQueueManager::Instance();
-    auto result_topic = KawaiiMQ::Topic("renderResult");
-    auto result_producer = KawaiiMQ::Producer("producer");
-    result_producer.subscribe(result_topic);
-    auto task_topic = KawaiiMQ::Topic("renderTask");
-    auto task_fetcher = KawaiiMQ::Consumer({task_topic});
-    auto task_queue = m->getAllRelatedQueue(task_topic)[0];
-    auto chunk_message = std::shared_ptr<KawaiiMQ::MessageData>();
-    spdlog::info("thread {} started", ss.str());
-    while (task_queue->tryWait(chunk_message)) {
-        auto chunk = KawaiiMQ::getMessage<ImageChunk>(chunk_message);
-        spdlog::info("chunk {} (start from ({}, {}), dimension {} * {}) "
-                     "started by thread {}",
-                     chunk.chunk_idx, chunk.startx, chunk.starty, chunk.width,
-                     chunk.height, ss.str());
-
-        for (int i = chunk.starty; i < chunk.starty + chunk.height; i++) {
-            auto hori = std::vector<Color>();
-            hori.reserve(chunk.width);
-            for (int j = chunk.startx; j < chunk.startx + chunk.width; j++) {
-                Color pixel_color = Color{0, 0, 0};
-                for (int k = 0; k < sample_count; ++k) {
-                    auto ray = getRay(j, i);
-                    pixel_color += rayColor(ray, world, render_depth);
-                }
-                pixel_color /= sample_count;
-                pixel_color = Color{gammaCorrect(pixel_color[0]),
-                                    gammaCorrect(pixel_color[1]),
-                                    gammaCorrect(pixel_color[2])};
-                hori.emplace_back(pixel_color);
+void Camera::writeStats(const std::vector<RenderStats> &stats, double seconds,
+                        const std::string &name,
+                        const std::string &path) const {
+    auto file = (std::filesystem::path(path) /
+                 (std::filesystem::path(name).stem().string() + "_stats.json"))
+                    .string();
+    if (writeRenderStats(stats, seconds, file))
+        spdlog::info("render stats written to {}", file);
+}
+
+void Camera::RenderWorker(const IHittable &world, TileScheduler &scheduler,
+                          int worker_idx, Framebuffer &image,
+                          Framebuffer *sample_map, uint32_t pass,
+                          int samples,
+                          [[maybe_unused]] RenderStats &stats) const {
+    // formatted once, pool threads keep it from one render to the next
+    thread_local const std::string thread_name = [] {
+        std::stringstream ss;
+        ss << std::this_thread::get_id();
+        return ss.str();
+    }();
+    spdlog::info("thread {} started", thread_name);
+    RAYTRACING_STAT(thread_stats = RenderStats());
+    Tile tile;
+    if (sampling_hook)
+        sampling_hook(true);
+    while (scheduler.next(worker_idx, tile)) {
+        auto view = image.view(tile);
+        spdlog::debug("chunk {} (start from ({}, {}), dimension {} * {}) "
+                      "started by thread {}",
+                      tile.idx, tile.startx, tile.starty, tile.width,
+                      tile.height, thread_name);
+        RAYTRACING_STAT(auto tile_begin = std::chrono::steady_clock::now());
+        renderTile(world, view, sample_map, pass, samples);
+        RAYTRACING_STAT({
+            std::chrono::duration<double, std::milli> tile_time =
+                std::chrono::steady_clock::now() - tile_begin;
+            thread_stats.tiles++;
+            thread_stats.tile_ms += tile_time.count();
+            thread_stats.max_tile_ms =
+                std::max(thread_stats.max_tile_ms, tile_time.count());
+        });
+    }
+    if (sampling_hook)
+        sampling_hook(false);
+    RAYTRACING_STAT(stats.merge(thread_stats));
+}
+
+void Camera::renderTile(const IHittable &world, TileView &view,
+                        Framebuffer *sample_map, uint32_t pass,
+                        int samples) const {
+    if (packet_tracing && !sample_map && render_depth > 0) {
+        renderTilePackets(world, view, pass, samples);
+        return;
+    }
+    for (int i = 0; i < view.height(); i++) {
+        auto row = view.row(i);
+        auto y = view.startY() + i;
+        for (int j = 0; j < view.width(); j++) {
+            auto x = view.startX() + j;
+            if (sample_map) {
+                int taken;
+                row[j] = Pixel(samplePixelAdaptive(x, y, world, taken));
+                sample_map->at(x, y).r = static_cast<float>(taken);
+                continue;
             }
-            chunk.partial.emplace_back(hori);
+            Color pixel_color = Color{0, 0, 0};
+            PCG32 rng = pixelRng(x, y, pass);
+            for (int k = 0; k < samples; ++k) {
+                auto ray = getRay(x, y, rng);
+                pixel_color += sample(ray, world, rng);
+            }
+            row[j] = Pixel(pixel_color / samples);
         }
-        auto message = KawaiiMQ::makeMessage(chunk);
-        result_producer.broadcastMessage(message);
     }
-    task_fetcher.unsubscribe(task_topic);
-    result_producer.unsubscribe(result_topic);
-
-    m->unrelate(task_topic, task_queue);
-}
-
-int Camera::partition() const {
-    auto manager = KawaiiMQ::MessageQueueManager::Instance();
-    auto queue = KawaiiMQ::makeQueue("renderTaskQueue");
-    auto topic = KawaiiMQ::Topic("renderTask");
-    manager->relate(topic, queue);
-    KawaiiMQ::Producer prod("chunkPusher");
-    prod.subscribe(topic);
-    int upperleft_x = 0;
-    int upperleft_y = 0;
-    int idx = 0;
-    while (upperleft_y < height) {
-        while (upperleft_x < width) {
-            ImageChunk chunk;
-            chunk.chunk_idx = idx;
-            ++idx;
-            chunk.startx = upperleft_x;
-            chunk.starty = upperleft_y;
-            if (upperleft_x + chunk_dimension > width) {
-                chunk.width = width % chunk_dimension;
-            } else {
-                chunk.width = chunk_dimension;
+}
+
+void Camera::renderTilePackets(const IHittable &world, TileView &view,
+                               uint32_t pass, int samples) const {
+    std::array<PCG32, packet_size> rngs;
+    std::array<Color, packet_size> colors;
+    std::array<Ray, packet_size> rays;
+    std::array<HitRecord, packet_size> records;
+    bool hits[packet_size];
+    for (int i = 0; i < view.height(); i++) {
+        auto row = view.row(i);
+        auto y = view.startY() + i;
+        // neighbouring pixels of a row share a packet, one sample per lane
+        for (int j = 0; j < view.width(); j += packet_size) {
+            int count = std::min(packet_size, view.width() - j);
+            for (int l = 0; l < count; l++) {
+                rngs[l] = pixelRng(view.startX() + j + l, y, pass);
+                colors[l] = Color{0, 0, 0};
             }
-            if (upperleft_y + chunk_dimension > height) {
-                chunk.height = height % chunk_dimension;
-            } else {
-                chunk.height = chunk_dimension;
+            for (int k = 0; k < samples; ++k) {
+                for (int l = 0; l < count; l++)
+                    rays[l] = getRay(view.startX() + j + l, y, rngs[l]);
+                RAYTRACING_STAT(thread_stats.primary_rays += count);
+                tracePacket(world, rays.data(), count, Interval(EPS, INF),
+                            records.data(), hits);
+                for (int l = 0; l < count; l++) {
+                    if (hits[l])
+                        setFootprint(rays[l], records[l]);
+                    colors[l] += hits[l] ? sampleHit(rays[l], records[l],
+                                                     world, rngs[l])
+                                         : background;
+                }
             }
-            auto message = KawaiiMQ::makeMessage(chunk);
-            prod.broadcastMessage(message);
-            upperleft_x += chunk_dimension;
+            for (int l = 0; l < count; l++)
+                row[j + l] = Pixel(colors[l] / samples);
         }
-        upperleft_x = 0;
-        upperleft_y += chunk_dimension;
     }
-    prod.unsubscribe(topic);
-    return idx;
 }
 
-void Camera::setRotation(const Eigen::Vector3d &rot) {
+void Camera::setRotation(const Vec3 &rot) {
     rotation_ypr = rot;
     updateVectors();
 }
 
-Eigen::Vector3d Camera::getRotation() const { return rotation_ypr; }
+Vec3 Camera::getRotation() const { return rotation_ypr; }
 
 Color Camera::getBackground() const { return background; }
 
@@ -164,18 +359,18 @@ void Camera::setBackground(const Color &background) {
 }
 
 Camera::Camera(int width, float aspect_ratio, float fov, Point3 position,
-               Eigen::Vector3d target, float dof_angle)
+               Vec3 target, float dof_angle)
     : width(width), aspect_ratio(aspect_ratio), fov(fov),
       target(std::move(target)), position(std::move(position)),
       height(static_cast<int>(width / aspect_ratio)), dof_angle(dof_angle) {
     render_thread_count = std::thread::hardware_concurrency() == 0
                               ? 12
                               : std::thread::hardware_concurrency();
-    auto q = Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d{0, 0, -1},
-                                                (target - position));
+    auto q = Eigen::Quaternion<Real>::FromTwoVectors(Vec3{0, 0, -1},
+                                                     (target - position));
     rotation_matrix = q.toRotationMatrix();
     auto angle = rotation_matrix.canonicalEulerAngles(2, 1, 0);
-    rotation_ypr = Eigen::Vector3d{angle(0, 0), angle(1, 0), angle(2, 0)};
+    rotation_ypr = Vec3{angle(0, 0), angle(1, 0), angle(2, 0)};
     updateVectors();
 }
 
@@ -185,7 +380,7 @@ void Camera::updateVectors() {
     focal_len = (position - target).norm();
     viewport_height = 2 * h * focal_len;
     viewport_width = viewport_height * (static_cast<float>(width) / height);
-    w = rotation_matrix * Eigen::Vector3d::UnitZ();
+    w = rotation_matrix * Vec3::UnitZ();
     auto this_UP = UP;
     // flip vertically
     if (rotation_ypr[0] > PI / 2 && rotation_ypr[0] < 3 * PI / 2)
@@ -196,6 +391,7 @@ void Camera::updateVectors() {
     vert_vec = viewport_height * -v;
     pix_delta_x = hori_vec / width;
     pix_delta_y = vert_vec / height;
+    pixel_spread = viewport_height / focal_len / height;
     viewport_ul = position - focal_len * w - (vert_vec + hori_vec) / 2;
     pixel_00 = viewport_ul + (pix_delta_y + pix_delta_x) * 0.5;
     auto dof_radius = focal_len * tan(deg2Rad(dof_angle / 2));
@@ -217,13 +413,13 @@ float Camera::getFocalLen() const { return focal_len; }
 
 const Point3 &Camera::getPosition() const { return position; }
 
-const Eigen::Vector3d &Camera::getHoriVec() const { return hori_vec; }
+const Vec3 &Camera::getHoriVec() const { return hori_vec; }
 
-const Eigen::Vector3d &Camera::getVertVec() const { return vert_vec; }
+const Vec3 &Camera::getVertVec() const { return vert_vec; }
 
-const Eigen::Vector3d &Camera::getPixDeltaX() const { return pix_delta_x; }
+const Vec3 &Camera::getPixDeltaX() const { return pix_delta_x; }
 
-const Eigen::Vector3d &Camera::getPixDeltaY() const { return pix_delta_y; }
+const Vec3 &Camera::getPixDeltaY() const { return pix_delta_y; }
 
 const Point3 &Camera::getViewportUl() const { return viewport_ul; }
 
@@ -255,40 +451,188 @@ void Camera::setSampleCount(int sample_count) {
     Camera::sample_count = sample_count;
 }
 
-Eigen::Vector3d Camera::dofDiskSample() const {
-    auto p = randomVec3InUnitDisk();
+Vec3 Camera::dofDiskSample(PCG32 &rng) const {
+    auto p = randomVec3InUnitDisk(rng);
     return position + (p[0] * dof_disk_h) + (p[1] * dof_disk_v);
 }
 
-Color Camera::rayColor(const Ray &ray, const IHittable &object, int depth) {
+Color Camera::rayColor(const Ray &ray, const IHittable &object, int depth,
+                       PCG32 &rng) const {
     HitRecord record;
     if (depth <= 0)
         return Color{0, 0, 0};
+    RAYTRACING_STAT(if (depth < render_depth) thread_stats.secondary_rays++);
 
     if (object.hit(ray, Interval(EPS, INF), record)) {
+        setFootprint(ray, record);
+        return shade(ray, record, object, depth, rng);
+    }
+    return background;
+}
+
+Color Camera::shade(const Ray &ray, const HitRecord &record,
+                    const IHittable &object, int depth, PCG32 &rng) const {
+    Ray scattered;
+    Color attenuation;
+    RAYTRACING_STAT(thread_stats.path_vertices++);
+    Color emission =
+        MaterialTable::emitted(*record.material, record.u, record.v, record.p);
+    if (MaterialTable::scatter(*record.material, ray, record, attenuation,
+                               scattered, rng)) {
+        return attenuation.cwiseProduct(
+                   rayColor(scattered, object, depth - 1, rng)) +
+               emission;
+    }
+    return emission;
+}
+
+Color Camera::sample(const Ray &ray, const IHittable &world,
+                     PCG32 &rng) const {
+    RAYTRACING_STAT(thread_stats.primary_rays++);
+    if (integrator == Integrator::Recursive)
+        return rayColor(ray, world, render_depth, rng);
+    if (render_depth <= 0)
+        return Color{0, 0, 0};
+    HitRecord record;
+    if (world.hit(ray, Interval(EPS, INF), record)) {
+        setFootprint(ray, record);
+        return tracePath(ray, record, world, rng);
+    }
+    return background;
+}
+
+Color Camera::sampleHit(const Ray &ray, const HitRecord &record,
+                        const IHittable &world, PCG32 &rng) const {
+    if (integrator == Integrator::Recursive)
+        return shade(ray, record, world, render_depth, rng);
+    return tracePath(ray, record, world, rng);
+}
+
+Color Camera::tracePath(Ray ray, HitRecord record, const IHittable &world,
+                        PCG32 &rng) const {
+    Color radiance{0, 0, 0};
+    Color throughput{1, 1, 1};
+    bool sample_lights = light_sampling && !lights.empty();
+    // density the last direction was scattered with, 0 after the camera and
+    // after specular bounces, which light sampling cannot reproduce
+    Real scatter_pdf = 0;
+    // the vertex at bounce render_depth - 1 is the last one rayColor shades
+    for (int bounce = 0; bounce < render_depth; bounce++) {
+        RAYTRACING_STAT(thread_stats.path_vertices++);
+        Color emission = MaterialTable::emitted(*record.material, record.u,
+                                                record.v, record.p);
+        if (sample_lights && scatter_pdf > 0 && !emission.isZero()) {
+            // the previous vertex could have sampled this direction directly
+            auto light_pdf = lights.pdfValue(ray);
+            emission *= scatter_pdf / (scatter_pdf + light_pdf);
+        }
+        radiance += throughput.cwiseProduct(emission);
         Ray scattered;
         Color attenuation;
-        Color emission = record.material->emitted(record.u, record.v, record.p);
-        if (record.material->scatter(ray, record, attenuation, scattered)) {
-            return attenuation.cwiseProduct(
-                       rayColor(scattered, object, depth - 1)) +
-                   emission;
+        if (bounce + 1 == render_depth ||
+            !MaterialTable::scatter(*record.material, ray, record,
+                                    attenuation, scattered, rng))
+            break;
+        scatter_pdf = MaterialTable::scatteringPdf(*record.material, ray,
+                                                   record, scattered);
+        if (sample_lights && scatter_pdf > 0) {
+            radiance += throughput.cwiseProduct(attenuation).cwiseProduct(
+                sampleLight(ray, record, world, rng));
+        }
+        throughput = throughput.cwiseProduct(attenuation);
+        if (bounce + 1 >= roulette_depth) {
+            // survivors are weighted up by 1 / p, so the estimate stays
+            // unbiased while dim paths mostly stop here
+            Real p = std::min(throughput.maxCoeff(), Real(1));
+            if (randomFloat(rng) >= p)
+                break;
+            throughput /= p;
         }
-        return emission;
+        ray = scattered;
+        RAYTRACING_STAT(thread_stats.secondary_rays++);
+        if (!world.hit(ray, Interval(EPS, INF), record)) {
+            radiance += throughput.cwiseProduct(background);
+            break;
+        }
+        setFootprint(ray, record);
     }
-    return background;
+    return radiance;
+}
+
+void Camera::setFootprint(const Ray &ray, HitRecord &record) const {
+    // directions are not normalized, t alone is not a distance
+    auto distance = static_cast<float>(record.t * ray.dir().norm());
+    record.footprint = pixel_spread * distance * record.uv_density;
+}
+
+Color Camera::sampleLight(const Ray &ray, const HitRecord &record,
+                          const IHittable &world, PCG32 &rng) const {
+    Ray shadow(record.p, lights.random(record.p, ray.time(), rng), ray.time());
+    auto scatter_pdf =
+        MaterialTable::scatteringPdf(*record.material, ray, record, shadow);
+    if (scatter_pdf <= 0)
+        return Color{0, 0, 0};
+    RAYTRACING_STAT(thread_stats.shadow_rays++);
+    HitRecord light_record;
+    if (!world.hit(shadow, Interval(EPS, INF), light_record))
+        return Color{0, 0, 0};
+    // whatever emitter the shadow ray reaches first counts, a blocked ray
+    // ends on a surface that emits nothing
+    auto light_pdf = lights.pdfValue(shadow);
+    if (light_pdf <= 0)
+        return Color{0, 0, 0};
+    // BSDF * cos / light_pdf with the balance heuristic weight, the
+    // attenuation factor is left to the caller
+    auto emission = MaterialTable::emitted(
+        *light_record.material, light_record.u, light_record.v, light_record.p);
+    return emission * (scatter_pdf / (scatter_pdf + light_pdf));
+}
+
+Color Camera::samplePixelAdaptive(int x, int y, const IHittable &world,
+                                  int &samples) const {
+    PCG32 rng = pixelRng(x, y);
+    Color sum{0, 0, 0};
+    // running mean and variance of the luminance, Welford's update
+    double mean = 0, m2 = 0;
+    int round = std::max(min_sample_count, 2);
+    int n = 0;
+    while (n < sample_count) {
+        for (int k = 0; k < round && n < sample_count; k++) {
+            auto color = sample(getRay(x, y, rng), world, rng);
+            sum += color;
+            double luma =
+                0.299 * color[0] + 0.587 * color[1] + 0.114 * color[2];
+            n++;
+            double delta = luma - mean;
+            mean += delta / n;
+            m2 += delta * (luma - mean);
+        }
+        // 95% confidence half width of the mean, relative to the mean, dark
+        // pixels are judged against a floor so they are not sampled forever
+        double error = 1.96 * std::sqrt(m2 / (n - 1) / n) /
+                       std::max(mean, 1e-2);
+        if (error <= adaptive_threshold)
+            break;
+    }
+    samples = n;
+    return sum / n;
 }
 
 int Camera::getSampleCount() const { return sample_count; }
-Eigen::Vector3d Camera::randomDisplacement() const {
-    auto delta_x = pix_delta_x * (randomFloat() - 0.5);
-    auto delta_y = pix_delta_y * (randomFloat() - 0.5);
+Vec3 Camera::randomDisplacement(PCG32 &rng) const {
+    auto delta_x = pix_delta_x * (randomFloat(rng) - 0.5);
+    auto delta_y = pix_delta_y * (randomFloat(rng) - 0.5);
     return delta_x + delta_y;
 }
 
 int Camera::getRenderDepth() const { return render_depth; }
 void Camera::setRenderDepth(int renderDepth) { render_depth = renderDepth; }
 int Camera::getRenderThreadCount() const { return render_thread_count; }
+RenderPool *Camera::getRenderPool() const { return render_pool; }
+void Camera::setRenderPool(RenderPool *pool) { render_pool = pool; }
+void Camera::setSamplingHook(void (*hook)(bool sampling)) {
+    sampling_hook = hook;
+}
 void Camera::setRenderThreadCount(int renderThreadCount) {
     if (renderThreadCount == 0 || renderThreadCount > width ||
         renderThreadCount > height) {
@@ -306,11 +650,11 @@ const Point3 &Camera::getTarget() const { return target; }
 void Camera::setTarget(const Point3 &target) {
     Camera::target = target;
     auto dir_vec = position - target;
-    rotation_matrix = Eigen::Quaternion<double>::FromTwoVectors(
-                          Eigen::Vector3d::UnitZ(), position - target)
+    rotation_matrix = Eigen::Quaternion<Real>::FromTwoVectors(Vec3::UnitZ(),
+                                                              position - target)
                           .toRotationMatrix();
     auto angle = rotation_matrix.canonicalEulerAngles(2, 1, 0);
-    rotation_ypr = Eigen::Vector3d{angle(0, 0), angle(1, 0), angle(2, 0)};
+    rotation_ypr = Vec3{angle(0, 0), angle(1, 0), angle(2, 0)};
     updateVectors();
 }
 float Camera::getDofAngle() const { return dof_angle; }
@@ -323,14 +667,24 @@ void Camera::setFocalLen(float focalLen) {
     updateVectors();
 }
 
-Ray Camera::getRay(int x, int y) {
-    auto pixel_vec =
-        pixel_00 + pix_delta_x * x + pix_delta_y * y + randomDisplacement();
-    auto origin = dof_angle <= 0 ? position : dofDiskSample();
+Ray Camera::getRay(int x, int y, PCG32 &rng) const {
+    auto pixel_vec = pixel_00 + pix_delta_x * x + pix_delta_y * y +
+                     randomDisplacement(rng);
+    auto origin = dof_angle <= 0 ? position : dofDiskSample(rng);
     auto direction = pixel_vec - origin;
-    auto time = randomFloat(0, shutter_speed);
+    auto time = randomFloat(rng, shutter_open, shutter_open + shutter_speed);
     return Ray(origin, direction, time);
 }
+
+PCG32 Camera::pixelRng(int x, int y, uint32_t pass) const {
+    // golden ratio steps keep the states of consecutive passes far apart
+    return PCG32(seed + pass * 0x9e3779b97f4a7c15ULL,
+                 static_cast<uint64_t>(y) * width + x);
+}
+
+uint64_t Camera::getSeed() const { return seed; }
+
+void Camera::setSeed(uint64_t seed) { this->seed = seed; }
 int Camera::getChunkDimension() const { return chunk_dimension; }
 
 void Camera::setChunkDimension(int dimension) {
@@ -341,6 +695,60 @@ void Camera::setChunkDimension(int dimension) {
 
 float Camera::getShutterSpeed() const { return shutter_speed; }
 
+float Camera::getShutterOpen() const { return shutter_open; }
+
+void Camera::setShutterOpen(float time) { shutter_open = time; }
+
+ImageFormat Camera::getOutputFormat() const { return output_format; }
+
+void Camera::setOutputFormat(ImageFormat format) { output_format = format; }
+
+bool Camera::getPacketTracing() const { return packet_tracing; }
+
+void Camera::setPacketTracing(bool enabled) { packet_tracing = enabled; }
+
+Integrator Camera::getIntegrator() const { return integrator; }
+
+void Camera::setIntegrator(Integrator integrator) {
+    Camera::integrator = integrator;
+}
+
+int Camera::getRouletteDepth() const { return roulette_depth; }
+
+void Camera::setRouletteDepth(int depth) { roulette_depth = depth; }
+
+bool Camera::getLightSampling() const { return light_sampling; }
+
+void Camera::setLightSampling(bool enabled) { light_sampling = enabled; }
+
+bool Camera::getAdaptiveSampling() const { return adaptive_sampling; }
+
+void Camera::setAdaptiveSampling(bool enabled) { adaptive_sampling = enabled; }
+
+int Camera::getMinSampleCount() const { return min_sample_count; }
+
+void Camera::setMinSampleCount(int count) { min_sample_count = count; }
+
+float Camera::getAdaptiveThreshold() const { return adaptive_threshold; }
+
+void Camera::setAdaptiveThreshold(float threshold) {
+    adaptive_threshold = threshold;
+}
+
+int Camera::getProgressivePass() const { return progressive_pass; }
+
+void Camera::setProgressivePass(int samples) { progressive_pass = samples; }
+
+float Camera::getCheckpointInterval() const { return checkpoint_interval; }
+
+void Camera::setCheckpointInterval(float seconds) {
+    checkpoint_interval = seconds;
+}
+
+bool Camera::getResume() const { return resume; }
+
+void Camera::setResume(bool resume) { Camera::resume = resume; }
+
 void Camera::setShutterSpeed(float shutterSpeed) {
     shutter_speed = shutterSpeed;
 }
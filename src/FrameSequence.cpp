@@ -0,0 +1,164 @@
+/**
+ * @file FrameSequence.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "FrameSequence.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "spdlog/spdlog.h"
+
+namespace {
+	double msSince(std::chrono::steady_clock::time_point begin) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	/**
+	 * @brief thread writing rendered frames in the order they are pushed
+	 */
+	class FrameWriter {
+	public:
+		FrameWriter(const std::vector<Frame> &frames, const std::string &path, size_t max_pending,
+					std::vector<FrameTiming> &timings) :
+			frames(frames), path(path), max_pending(max_pending), timings(timings), thread(&FrameWriter::work, this) {}
+
+		~FrameWriter() {
+			{
+				std::lock_guard lock(mutex);
+				closing = true;
+			}
+			changed.notify_all();
+			thread.join();
+		}
+
+		/**
+		 * @brief block until fewer than max_pending frames are left to write
+		 * @return milliseconds waited
+		 */
+		double waitForRoom() {
+			auto begin = std::chrono::steady_clock::now();
+			std::unique_lock lock(mutex);
+			changed.wait(lock, [this] { return pending < max_pending; });
+			return msSince(begin);
+		}
+
+		void push(size_t index, Framebuffer image) {
+			{
+				std::lock_guard lock(mutex);
+				queue.push_back({index, std::move(image)});
+				pending++;
+			}
+			changed.notify_all();
+		}
+
+	private:
+		struct Pending {
+			size_t index;
+			Framebuffer image;
+		};
+
+		// takes the frame by value, so its image is freed before the slot is given back
+		std::string write(Pending frame, double &ms) const {
+			const auto &[camera, name] = frames[frame.index];
+			auto begin = std::chrono::steady_clock::now();
+			auto file = camera.writeOutput(frame.image, name, path);
+			ms = msSince(begin);
+			return file;
+		}
+
+		void work() {
+			std::unique_lock lock(mutex);
+			while (true) {
+				changed.wait(lock, [this] { return closing || !queue.empty(); });
+				if (queue.empty())
+					return;
+				auto index = queue.front().index;
+				auto frame = std::move(queue.front());
+				queue.pop_front();
+				lock.unlock();
+				double ms;
+				auto file = write(std::move(frame), ms);
+				lock.lock();
+				timings[index].file = std::move(file);
+				timings[index].write_ms = ms;
+				pending--;
+				changed.notify_all();
+			}
+		}
+
+		const std::vector<Frame> &frames;
+		const std::string &path;
+		size_t max_pending;
+		std::vector<FrameTiming> &timings;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<Pending> queue;
+		// pushed frames whose write has not finished, including the one being written
+		size_t pending = 0;
+		bool closing = false;
+		std::thread thread;
+	};
+
+	void writeTimings(const std::vector<FrameTiming> &timings, double seconds, const std::string &file) {
+		std::ofstream out(file);
+		if (!out) {
+			spdlog::error("cannot write frame timings to {}", file);
+			return;
+		}
+		out << fmt::format("{{\n  \"frames\": {},\n  \"seconds\": {:.3f},\n  \"timings\": [", timings.size(), seconds);
+		for (size_t i = 0; i < timings.size(); i++) {
+			const auto &timing = timings[i];
+			out << fmt::format("{}\n    {{\"file\": \"{}\", \"wait_ms\": {:.3f}, \"render_ms\": {:.3f}, "
+							   "\"write_ms\": {:.3f}}}",
+							   i ? "," : "", timing.file, timing.wait_ms, timing.render_ms, timing.write_ms);
+		}
+		out << "\n  ]\n}\n";
+		spdlog::info("frame timings written to {}", file);
+	}
+} // namespace
+
+std::vector<FrameTiming> renderSequence(const IHittable &world, const std::vector<Frame> &frames,
+										const std::string &path, int max_pending) {
+	std::vector<FrameTiming> timings(frames.size());
+	auto begin = std::chrono::steady_clock::now();
+	{
+		FrameWriter writer(frames, path, std::max(max_pending, 1), timings);
+		for (size_t i = 0; i < frames.size(); i++) {
+			auto &timing = timings[i];
+			timing.wait_ms = writer.waitForRoom();
+			// renderImage sets the lights up in the camera, the frames stay untouched for the writer
+			auto camera = frames[i].camera;
+			if (camera.getProgressivePass() > 0)
+				spdlog::warn("frame {} renders in one go, progressive passes are not used in sequences", i);
+			auto render_begin = std::chrono::steady_clock::now();
+			auto image = camera.renderImage(world, frames[i].name, path);
+			timing.render_ms = msSince(render_begin);
+			writer.push(i, std::move(image));
+		}
+	}
+	auto seconds = msSince(begin) / 1000;
+	double render_ms = 0, write_ms = 0, wait_ms = 0;
+	for (size_t i = 0; i < timings.size(); i++) {
+		const auto &timing = timings[i];
+		spdlog::info("frame {} {}: render {:.1f}ms, write {:.1f}ms, waited {:.1f}ms", i, timing.file,
+					 timing.render_ms, timing.write_ms, timing.wait_ms);
+		render_ms += timing.render_ms;
+		write_ms += timing.write_ms;
+		wait_ms += timing.wait_ms;
+	}
+	// without the overlap the sequence would take the render and write times added up
+	spdlog::info("{} frames in {:.2f}s: render {:.2f}s, write {:.2f}s, waited on the writer {:.2f}s", frames.size(),
+				 seconds, render_ms / 1000, write_ms / 1000, wait_ms / 1000);
+	std::error_code error;
+	std::filesystem::create_directories(path, error);
+	writeTimings(timings, seconds, (std::filesystem::path(path) / "sequence_timing.json").string());
+	return timings;
+}
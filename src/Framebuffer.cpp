@@ -0,0 +1,36 @@
+/**
+ * @file Framebuffer.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "Framebuffer.h"
+#include <algorithm>
+#include <new>
+
+Framebuffer::Framebuffer(int width, int height) : fb_width(width), fb_height(height) {
+	auto bytes = static_cast<std::size_t>(width) * height * sizeof(Pixel);
+	bytes = (bytes + alignment - 1) / alignment * alignment;
+	auto memory = static_cast<Pixel *>(std::aligned_alloc(alignment, std::max(bytes, alignment)));
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	pixels.reset(memory);
+	clear();
+}
+
+int Framebuffer::width() const { return fb_width; }
+
+int Framebuffer::height() const { return fb_height; }
+
+Pixel *Framebuffer::row(int y) { return &at(0, y); }
+
+const Pixel *Framebuffer::row(int y) const { return &at(0, y); }
+
+const float *Framebuffer::data() const { return reinterpret_cast<const float *>(pixels.get()); }
+
+TileView Framebuffer::view(const Tile &tile) { return TileView(&at(tile.startx, tile.starty), fb_width, tile); }
+
+void Framebuffer::clear(const Pixel &value) {
+	std::fill(pixels.get(), pixels.get() + static_cast<std::size_t>(fb_width) * fb_height, value);
+}
@@ -9,22 +9,30 @@
 #include "Eigen/Core"
 #include "Material.h"
 #include "MathUtil.h"
+#include "RenderStats.h"
 #include <memory>
 
-Sphere::Sphere(float radius, Eigen::Vector3d position,
-               std::shared_ptr<IMaterial> mat)
-    : radius(radius), position(std::move(position)), material(std::move(mat)) {
-    auto rvec = Eigen::Vector3d{radius, radius, radius};
+namespace {
+// relative error of the float packet kernels, lanes closer than this to
+// flipping between hit and miss are traced again in full precision
+constexpr float float_error = 1e-5f;
+// the same for the distance to a quad or triangle edge, relative to its length
+constexpr float edge_error = 1e-4f;
+} // namespace
+
+Sphere::Sphere(Real radius, Vec3 position, const IMaterial *mat)
+    : radius(radius), position(std::move(position)), material(mat) {
+    auto rvec = Vec3{radius, radius, radius};
     bbox = AABB(this->position - rvec, this->position + rvec);
 }
 
 bool Sphere::hit(const Ray &r, Interval interval, HitRecord &record) const {
+    RAYTRACING_STAT(thread_stats.sphere_tests++);
     auto sphere_center = getPosition(r.time());
-    std::shared_ptr<Eigen::Vector3d> oc =
-        std::make_shared<Eigen::Vector3d>(r.pos() - sphere_center);
+    Vec3 oc = r.pos() - sphere_center;
     auto a = r.dir().squaredNorm();
-    auto h = oc->dot(r.dir());
-    auto c = oc->squaredNorm() - radius * radius;
+    auto h = oc.dot(r.dir());
+    auto c = oc.squaredNorm() - radius * radius;
 
     auto discriminant = h * h - a * c;
     if (discriminant < 0)
@@ -43,6 +51,9 @@ bool Sphere::hit(const Ray &r, Interval interval, HitRecord &record) const {
     auto out_normal = (record.p - sphere_center) / radius;
     record.setFaceNormal(r, out_normal);
     getSphereUV(out_normal, record.u, record.v);
+    // geometric mean of the u and v rates at the equator
+    record.uv_density =
+        static_cast<float>(1 / (PI * std::sqrt(2.0) * std::fabs(radius)));
     record.material = material;
     return true;
 }
@@ -54,7 +65,77 @@ void Sphere::getSphereUV(const Point3 &p, float &u, float &v) {
     v = theta / PI;
 }
 
-void HitRecord::setFaceNormal(const Ray &r, const Eigen::Vector3d &normal_out) {
+void IHittable::hitPacket(const RayPacket &packet, float t_min,
+                          PacketHit &result) const {
+    HitRecord record;
+    for (int i = 0; i < packet.count; i++) {
+        if (packet.active[i] &&
+            hit(packet.rays[i], Interval(t_min, result.t[i]), record)) {
+            result.t[i] = record.t;
+            result.object[i] = this;
+        }
+    }
+}
+
+void tracePacket(const IHittable &world, const Ray *rays, int count,
+                 Interval interval, HitRecord *records, bool *hits) {
+    RayPacket packet(rays, count);
+    PacketHit result(interval.max);
+    world.hitPacket(packet, interval.min, result);
+    for (int i = 0; i < count; i++) {
+        // a grazing ray can hit or miss in float where full precision does
+        // the opposite, trace it again on its own
+        if (result.uncertain[i]) {
+            hits[i] = world.hit(rays[i], interval, records[i]);
+            continue;
+        }
+        if (result.object[i] == nullptr) {
+            hits[i] = false;
+            continue;
+        }
+        // the packet kernels run in float, settle the winner in full precision
+        // and fall back to a single ray if the two disagree
+        float slack = 1e-4f * std::abs(result.t[i]) + 1e-4f;
+        hits[i] = result.object[i]->hit(
+            rays[i], Interval(interval.min, result.t[i] + slack), records[i]);
+        if (!hits[i])
+            hits[i] = world.hit(rays[i], interval, records[i]);
+    }
+}
+
+void Sphere::hitPacket(const RayPacket &packet, float t_min,
+                       PacketHit &result) const {
+    RAYTRACING_STAT(thread_stats.sphere_tests += packet.active.count());
+    PacketFloat cx = PacketFloat::Constant(position.x());
+    PacketFloat cy = PacketFloat::Constant(position.y());
+    PacketFloat cz = PacketFloat::Constant(position.z());
+    if (is_moving) {
+        cx += packet.time * direction_vec.x();
+        cy += packet.time * direction_vec.y();
+        cz += packet.time * direction_vec.z();
+    }
+    PacketFloat ocx = packet.ox - cx;
+    PacketFloat ocy = packet.oy - cy;
+    PacketFloat ocz = packet.oz - cz;
+    PacketFloat a =
+        packet.dx * packet.dx + packet.dy * packet.dy + packet.dz * packet.dz;
+    PacketFloat h = ocx * packet.dx + ocy * packet.dy + ocz * packet.dz;
+    PacketFloat c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+    PacketFloat discriminant = h * h - a * c;
+    PacketFloat discri_sqrt = discriminant.max(0.0f).sqrt();
+    PacketFloat near_root = (-h - discri_sqrt) / a;
+    PacketFloat far_root = (-h + discri_sqrt) / a;
+    PacketMask near_ok = (near_root > t_min) && (near_root < result.t);
+    PacketFloat root = near_ok.select(near_root, far_root);
+    PacketMask in_range =
+        packet.active && (root > t_min) && (root < result.t);
+    // the discriminant cancels badly at the silhouette
+    PacketFloat error = float_error * (h * h + (a * c).abs());
+    result.doubt(in_range && (discriminant.abs() <= error));
+    result.commit(in_range && (discriminant >= 0.0f), root, this);
+}
+
+void HitRecord::setFaceNormal(const Ray &r, const Vec3 &normal_out) {
     front_face = normal_out.dot(r.dir()) < 0;
     normal = front_face ? normal_out : -normal_out;
 }
@@ -76,6 +157,13 @@ bool HittableList::hit(const Ray &r, Interval interval,
     return if_hit;
 }
 
+void HittableList::hitPacket(const RayPacket &packet, float t_min,
+                             PacketHit &result) const {
+    for (const auto &i : objects) {
+        i->hitPacket(packet, t_min, result);
+    }
+}
+
 HittableList::HittableList(const std::shared_ptr<IHittable> &obj) {
     add(obj);
     bbox = obj->boundingBox();
@@ -88,30 +176,72 @@ void HittableList::add(const std::shared_ptr<IHittable> &obj) {
 
 void HittableList::clear() {
     objects.clear();
-    bbox = AABB();
+    bbox = AABB(empty, empty, empty);
 }
 
 auto HittableList::begin() { return objects.begin(); }
 AABB HittableList::boundingBox() const { return bbox; }
 
-Sphere::Sphere(float radius, const Point3 &init_position,
-               const Point3 &final_position, std::shared_ptr<IMaterial> mat)
-    : radius(radius), position(init_position), material(std::move(mat)) {
+void HittableList::gatherLights(std::vector<const IHittable *> &lights) const {
+    for (const auto &i : objects) {
+        i->gatherLights(lights);
+    }
+}
+
+Sphere::Sphere(Real radius, const Point3 &init_position,
+               const Point3 &final_position, const IMaterial *mat)
+    : radius(radius), position(init_position), material(mat) {
     direction_vec = final_position - init_position;
     is_moving = true;
-    auto rvec = Eigen::Vector3d{radius, radius, radius};
+    auto rvec = Vec3{radius, radius, radius};
     auto bbox1 = AABB(init_position - rvec, init_position + rvec);
     auto bbox2 = AABB(final_position - rvec, final_position + rvec);
     bbox = AABB(bbox1, bbox2);
 }
 
-Eigen::Vector3d Sphere::getPosition(float time) const {
+Vec3 Sphere::getPosition(Real time) const {
     return is_moving ? position + time * direction_vec : position;
 }
 
 AABB Sphere::boundingBox() const { return bbox; }
 
+Real Sphere::pdfValue(const Ray &r, Interval interval) const {
+    HitRecord record;
+    if (!hit(r, interval, record))
+        return 0;
+    auto dist_squared = (getPosition(r.time()) - r.pos()).squaredNorm();
+    if (dist_squared <= radius * radius)
+        return 0;
+    auto cos_theta_max = std::sqrt(1 - radius * radius / dist_squared);
+    return 1 / (2 * PI * (1 - cos_theta_max));
+}
+
+Vec3 Sphere::random(const Point3 &origin, Real time, PCG32 &rng) const {
+    // uniform over the cone the sphere covers seen from origin
+    Vec3 direction = getPosition(time) - origin;
+    auto dist_squared = direction.squaredNorm();
+    if (dist_squared <= radius * radius)
+        return direction;
+    auto cos_theta_max = std::sqrt(1 - radius * radius / dist_squared);
+    Real z = 1 + randomFloat(rng) * (cos_theta_max - 1);
+    Real phi = 2 * PI * randomFloat(rng);
+    Real sin_theta = std::sqrt(1 - z * z);
+    Vec3 axis = direction.normalized();
+    Vec3 tangent =
+        (std::abs(axis.x()) > 0.9 ? Vec3::UnitY() : Vec3::UnitX()).cross(axis);
+    tangent.normalize();
+    Vec3 bitangent = axis.cross(tangent);
+    return std::cos(phi) * sin_theta * tangent +
+           std::sin(phi) * sin_theta * bitangent + z * axis;
+}
+
+void Sphere::gatherLights(std::vector<const IHittable *> &lights) const {
+    if (material->isEmissive())
+        lights.push_back(this);
+}
+
 bool BVHNode::hit(const Ray &r, Interval interval, HitRecord &record) const {
+    RAYTRACING_STAT(thread_stats.bvh_nodes++);
     if (!bbox.hit(r, interval)) {
         return false;
     }
@@ -123,6 +253,13 @@ bool BVHNode::hit(const Ray &r, Interval interval, HitRecord &record) const {
 
 AABB BVHNode::boundingBox() const { return bbox; }
 
+void BVHNode::gatherLights(std::vector<const IHittable *> &lights) const {
+    left->gatherLights(lights);
+    // a single object is stored on both sides
+    if (right != left)
+        right->gatherLights(lights);
+}
+
 bool BVHNode::compare(const std::shared_ptr<IHittable> &a,
                       const std::shared_ptr<IHittable> &b, int axis) {
     return a->boundingBox().axis(axis).min < b->boundingBox().axis(axis).min;
@@ -143,12 +280,13 @@ bool BVHNode::compareZ(const std::shared_ptr<IHittable> &a,
     return compare(a, b, 2);
 }
 
-BVHNode::BVHNode(const HittableList &list)
-    : BVHNode(list.objects, 0, list.objects.size()) {}
+BVHNode::BVHNode(const HittableList &list) {
+    auto objects = list.objects;
+    *this = BVHNode(objects, 0, objects.size());
+}
 
-BVHNode::BVHNode(const std::vector<std::shared_ptr<IHittable>> &objects,
-                 size_t start, size_t end) {
-    auto modifiable_objects = objects;
+BVHNode::BVHNode(std::vector<std::shared_ptr<IHittable>> &objects, size_t start,
+                 size_t end) {
     auto axis = randomInt(0, 2);
     auto comparator = (axis == 0)   ? compareX
                       : (axis == 1) ? compareY
@@ -166,11 +304,10 @@ BVHNode::BVHNode(const std::vector<std::shared_ptr<IHittable>> &objects,
             right = objects[start];
         }
     } else {
-        std::sort(modifiable_objects.begin() + start,
-                  modifiable_objects.begin() + end, comparator);
+        std::sort(objects.begin() + start, objects.begin() + end, comparator);
         auto mid = start + object_span / 2;
-        left = std::make_shared<BVHNode>(modifiable_objects, start, mid);
-        right = std::make_shared<BVHNode>(modifiable_objects, mid, end);
+        left = std::make_shared<BVHNode>(objects, start, mid);
+        right = std::make_shared<BVHNode>(objects, mid, end);
     }
 
     bbox = AABB(left->boundingBox(), right->boundingBox());
@@ -178,10 +315,12 @@ BVHNode::BVHNode(const std::vector<std::shared_ptr<IHittable>> &objects,
 
 AABB Quad::boundingBox() const { return bbox; }
 
-void Quad::setBoundingBox() { bbox = AABB(Q, Q + u + v).pad(); }
+void Quad::setBoundingBox() {
+    bbox = AABB(AABB(Q, Q + u + v), AABB(Q + u, Q + v)).pad();
+}
 
-Quad::Quad(const Eigen::Vector3d &Q, const Eigen::Vector3d &u,
-           const Eigen::Vector3d &v, std::shared_ptr<IMaterial> mat)
+Quad::Quad(const Vec3 &Q, const Vec3 &u, const Vec3 &v,
+           const IMaterial *mat)
     : Q(Q), u(u), v(v), mat(mat) {
     auto n = u.cross(v);
     normal = n.normalized();
@@ -190,7 +329,7 @@ Quad::Quad(const Eigen::Vector3d &Q, const Eigen::Vector3d &u,
     setBoundingBox();
 }
 
-bool Quad::inside(float a, float b, HitRecord &rec) const {
+bool Quad::inside(Real a, Real b, HitRecord &rec) const {
     if (a < 0 || a > 1 || b < 0 || b > 1)
         return false;
     rec.u = a;
@@ -199,7 +338,8 @@ bool Quad::inside(float a, float b, HitRecord &rec) const {
 }
 
 bool Quad::hit(const Ray &r, Interval interval, HitRecord &record) const {
-    float denom = normal.dot(r.dir());
+    RAYTRACING_STAT(thread_stats.quad_tests++);
+    Real denom = normal.dot(r.dir());
     if (fabs(denom) < 1e-8) {
         return false;
     }
@@ -218,24 +358,81 @@ bool Quad::hit(const Ray &r, Interval interval, HitRecord &record) const {
     record.p = intersection;
     record.material = mat;
     record.setFaceNormal(r, normal);
+    // |w| is one over the area spanned by u and v
+    record.uv_density = static_cast<float>(std::sqrt(w.norm()));
 
     return true;
 }
 
-Triangle::Triangle(const Eigen::Vector3d &Q, const Eigen::Vector3d &u,
-                   const Eigen::Vector3d &v, std::shared_ptr<IMaterial> mat)
+Real Quad::pdfValue(const Ray &r, Interval interval) const {
+    HitRecord record;
+    if (!hit(r, interval, record))
+        return 0;
+    auto area = u.cross(v).norm();
+    auto dist_squared = record.t * record.t * r.dir().squaredNorm();
+    auto cosine = std::abs(r.dir().dot(normal)) / r.dir().norm();
+    return dist_squared / (cosine * area);
+}
+
+Vec3 Quad::random(const Point3 &origin, Real time, PCG32 &rng) const {
+    Real a = randomFloat(rng);
+    Real b = randomFloat(rng);
+    return Q + a * u + b * v - origin;
+}
+
+void Quad::gatherLights(std::vector<const IHittable *> &lights) const {
+    if (mat->isEmissive())
+        lights.push_back(this);
+}
+
+void Quad::hitPacket(const RayPacket &packet, float t_min,
+                     PacketHit &result) const {
+    RAYTRACING_STAT(thread_stats.quad_tests += packet.active.count());
+    PacketFloat denom =
+        normal.x() * packet.dx + normal.y() * packet.dy + normal.z() * packet.dz;
+    PacketFloat t = (D - (normal.x() * packet.ox + normal.y() * packet.oy +
+                          normal.z() * packet.oz)) /
+                    denom;
+    PacketFloat px = packet.ox + t * packet.dx - Q.x();
+    PacketFloat py = packet.oy + t * packet.dy - Q.y();
+    PacketFloat pz = packet.oz + t * packet.dz - Q.z();
+    // alpha = w . (p x v), beta = w . (u x p)
+    PacketFloat alpha = w.x() * (py * v.z() - pz * v.y()) +
+                        w.y() * (pz * v.x() - px * v.z()) +
+                        w.z() * (px * v.y() - py * v.x());
+    PacketFloat beta = w.x() * (u.y() * pz - u.z() * py) +
+                       w.y() * (u.z() * px - u.x() * pz) +
+                       w.z() * (u.x() * py - u.y() * px);
+    PacketMask in_range = packet.active && (denom.abs() >= 1e-8f) &&
+                          (t > t_min) && (t < result.t);
+    PacketMask near_edge =
+        (alpha.abs() <= edge_error) || ((alpha - 1.0f).abs() <= edge_error) ||
+        (beta.abs() <= edge_error) || ((beta - 1.0f).abs() <= edge_error);
+    PacketMask inside = (alpha >= 0.0f) && (alpha <= 1.0f) && (beta >= 0.0f) &&
+                        (beta <= 1.0f);
+    PacketMask loose = (alpha >= -edge_error) && (alpha <= 1.0f + edge_error) &&
+                       (beta >= -edge_error) && (beta <= 1.0f + edge_error);
+    result.doubt(in_range && loose && near_edge);
+    result.commit(in_range && inside, t, this);
+}
+
+Triangle::Triangle(const Vec3 &Q, const Vec3 &u, const Vec3 &v,
+                   const IMaterial *mat)
     : Q(Q), u(u), v(v), mat(mat) {
     auto n = v.cross(u);
     normal = n.normalized();
+    D = normal.dot(Q);
     w = n / n.dot(n);
     setBoundingBox();
 }
 
-void Triangle::setBoundingBox() { box = AABB(Q, Q + u + v).pad(); }
+void Triangle::setBoundingBox() {
+    box = AABB(AABB(Q, Q + u), AABB(Q, Q + v)).pad();
+}
 
 AABB Triangle::boundingBox() const { return box; }
 
-bool Triangle::inside(const Eigen::Vector3d &intersection) const {
+bool Triangle::inside(const Vec3 &intersection) const {
     auto side1 = v;
     auto side2 = u - v;
     auto side3 = -u;
@@ -248,7 +445,8 @@ bool Triangle::inside(const Eigen::Vector3d &intersection) const {
 }
 
 bool Triangle::hit(const Ray &r, Interval interval, HitRecord &record) const {
-    float denom = normal.dot(r.dir());
+    RAYTRACING_STAT(thread_stats.triangle_tests++);
+    Real denom = normal.dot(r.dir());
     if (fabs(denom) < 1e-8) {
         return false;
     }
@@ -272,12 +470,77 @@ bool Triangle::hit(const Ray &r, Interval interval, HitRecord &record) const {
     record.setFaceNormal(r, normal);
     record.u = alpha;
     record.v = beta;
+    record.uv_density = static_cast<float>(std::sqrt(w.norm()));
     return true;
 }
 
-Translate::Translate(std::shared_ptr<IHittable> obj,
-                     const Eigen::Vector3d &displacement)
+Real Triangle::pdfValue(const Ray &r, Interval interval) const {
+    HitRecord record;
+    if (!hit(r, interval, record))
+        return 0;
+    auto area = u.cross(v).norm() / 2;
+    auto dist_squared = record.t * record.t * r.dir().squaredNorm();
+    auto cosine = std::abs(r.dir().dot(normal)) / r.dir().norm();
+    return dist_squared / (cosine * area);
+}
+
+Vec3 Triangle::random(const Point3 &origin, Real time, PCG32 &rng) const {
+    Real a = randomFloat(rng);
+    Real b = randomFloat(rng);
+    // fold the far half of the parallelogram back onto the triangle
+    if (a + b > 1) {
+        a = 1 - a;
+        b = 1 - b;
+    }
+    return Q + a * u + b * v - origin;
+}
+
+void Triangle::gatherLights(std::vector<const IHittable *> &lights) const {
+    if (mat->isEmissive())
+        lights.push_back(this);
+}
+
+void Triangle::hitPacket(const RayPacket &packet, float t_min,
+                         PacketHit &result) const {
+    RAYTRACING_STAT(thread_stats.triangle_tests += packet.active.count());
+    PacketFloat denom =
+        normal.x() * packet.dx + normal.y() * packet.dy + normal.z() * packet.dz;
+    PacketFloat t = (D - (normal.x() * packet.ox + normal.y() * packet.oy +
+                          normal.z() * packet.oz)) /
+                    denom;
+    PacketFloat px = packet.ox + t * packet.dx;
+    PacketFloat py = packet.oy + t * packet.dy;
+    PacketFloat pz = packet.oz + t * packet.dz;
+    // same edge walk as inside(): Q -> Q + v -> Q + u -> Q. an edge function
+    // is the distance to the edge times its length
+    PacketMask inside = packet.active;
+    PacketMask loose = packet.active;
+    PacketMask near_edge = PacketMask::Constant(false);
+    auto edge = [&](const Vec3 &start, const Vec3 &side) {
+        PacketFloat ex = px - start.x();
+        PacketFloat ey = py - start.y();
+        PacketFloat ez = pz - start.z();
+        PacketFloat cx = side.y() * ez - side.z() * ey;
+        PacketFloat cy = side.z() * ex - side.x() * ez;
+        PacketFloat cz = side.x() * ey - side.y() * ex;
+        PacketFloat f = cx * normal.x() + cy * normal.y() + cz * normal.z();
+        auto error = edge_error * static_cast<float>(side.squaredNorm());
+        inside = inside && (f > 0.0f);
+        loose = loose && (f > -error);
+        near_edge = near_edge || (f.abs() <= error);
+    };
+    edge(Q, v);
+    edge(Q + v, u - v);
+    edge(Q + u, -u);
+    PacketMask in_range =
+        (denom.abs() >= 1e-8f) && (t > t_min) && (t < result.t);
+    result.doubt(in_range && loose && near_edge);
+    result.commit(in_range && inside, t, this);
+}
+
+Translate::Translate(std::shared_ptr<IHittable> obj, const Vec3 &displacement)
     : object(obj), offset(displacement) {
+    bbox = obj->boundingBox();
     bbox.x = Interval(bbox.x.min + offset.x(), bbox.x.max + offset.x());
     bbox.y = Interval(bbox.y.min + offset.y(), bbox.y.max + offset.y());
     bbox.z = Interval(bbox.z.min + offset.z(), bbox.z.max + offset.z());
@@ -302,22 +565,22 @@ Rotation::Rotation(std::shared_ptr<IHittable> obj, float psi, float theta,
     : object(obj), rotation_matrix(makeEulerRotationMatrixAboutPt(about_pt, psi,
                                                                   theta, phi)),
       inverse_rotation_matrix(
-          makeEulerRotationMatrixAboutPt(about_pt, -psi, -theta, -phi)) {
+          makeEulerRotationMatrixAboutPt(about_pt, -psi, -theta, -phi)),
+      normal_matrix(inverse_rotation_matrix.inverse().transpose()) {
+    // hit() maps world space into object space with rotation_matrix, so the
+    // world space box is the object box carried back by the inverse
     auto bbox_temp = obj->boundingBox();
-    auto min_vec =
-        Eigen::Vector4d{bbox_temp.x.min, bbox_temp.y.min, bbox_temp.z.min, 1};
-    auto max_vec =
-        Eigen::Vector4d{bbox_temp.x.max, bbox_temp.y.max, bbox_temp.z.max, 1};
-    min_vec = rotation_matrix * min_vec;
-    max_vec = rotation_matrix * max_vec;
-    auto new_min_vec = deHomo(min_vec);
-    auto new_max_vec = deHomo(max_vec);
-    bbox.x = Interval(std::min(bbox_temp.x.min, new_min_vec.x()),
-                      std::max(bbox_temp.x.max, new_max_vec.x()));
-    bbox.y = Interval(std::min(bbox_temp.y.min, new_min_vec.y()),
-                      std::max(bbox_temp.y.max, new_max_vec.y()));
-    bbox.z = Interval(std::min(bbox_temp.z.min, new_min_vec.z()),
-                      std::max(bbox_temp.z.max, new_max_vec.z()));
+    Point3 min{INF, INF, INF};
+    Point3 max{-INF, -INF, -INF};
+    for (int i = 0; i < 8; i++) {
+        auto corner = Point3{i & 1 ? bbox_temp.x.max : bbox_temp.x.min,
+                             i & 2 ? bbox_temp.y.max : bbox_temp.y.min,
+                             i & 4 ? bbox_temp.z.max : bbox_temp.z.min};
+        auto rotated = deHomo(inverse_rotation_matrix * makeHomo(corner));
+        min = min.cwiseMin(rotated);
+        max = max.cwiseMax(rotated);
+    }
+    bbox = AABB(min, max);
 }
 
 AABB Rotation::boundingBox() const { return bbox; }
@@ -333,9 +596,7 @@ bool Rotation::hit(const Ray &r, Interval interval, HitRecord &record) const {
     if (!object->hit(rotated, interval, record)) {
         return false;
     }
-    auto inverse_transpose =
-        Eigen::Matrix4d(inverse_rotation_matrix.inverse().transpose());
-    record.normal = deHomo(inverse_transpose * makeHomo(record.normal));
+    record.normal = deHomo(normal_matrix * makeHomo(record.normal));
     record.p = deHomo(inverse_rotation_matrix * makeHomo(record.p));
     return true;
 }
@@ -5,11 +5,16 @@
  * @brief
  */
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include <iostream>
 #include <sys/fcntl.h>
 #define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
 #include "ImageUtil.h"
+#include "stb_image_write.h"
 
 std::string getGreyScaleCharacter(float r, float g, float b) {
 	float sum = r * 255.0 * 0.299 + g * 255.0 * 0.587 + b * 255.0 * 0.114;
@@ -18,31 +23,126 @@ std::string getGreyScaleCharacter(float r, float g, float b) {
 	return ret.str();
 }
 
-float gammaCorrect(float c) { return std::pow(c, 1.0 / 2.0); }
+float gammaCorrect(float c) { return std::sqrt(c); }
 
+Color displayColor(const Pixel &p) {
+	auto unit = Interval(0, 1);
+	return Color{unit.clamp(gammaCorrect(p.r)), unit.clamp(gammaCorrect(p.g)), unit.clamp(gammaCorrect(p.b))};
+}
 
-std::string makePPM(int width, int height, const std::vector<std::vector<Color>> &img, const std::string &name,
-					const std::string &path) {
-	auto fout = std::ofstream();
+
+std::vector<unsigned char> quantizeRGB8(const Framebuffer &img) {
+	std::vector<unsigned char> out(static_cast<std::size_t>(img.width()) * img.height() * 3);
+	auto dst = out.data();
+	auto quantize = [](float c) {
+		return static_cast<unsigned char>(255.999f * gammaCorrect(std::clamp(c, 0.0f, 1.0f)));
+	};
+	for (int i = 0; i < img.height(); i++) {
+		auto row = img.row(i);
+		for (int j = 0; j < img.width(); j++) {
+			*dst++ = quantize(row[j].r);
+			*dst++ = quantize(row[j].g);
+			*dst++ = quantize(row[j].b);
+		}
+	}
+	return out;
+}
+
+namespace {
+	std::string writeWhole(const std::string &filepath, const std::string &header, const void *body,
+						   std::size_t body_size) {
+		auto fout = std::ofstream(filepath, std::ios::binary);
+		if (!fout) {
+			spdlog::error("cannot open {} for writing", filepath);
+			return "";
+		}
+		fout.write(header.data(), static_cast<std::streamsize>(header.size()));
+		fout.write(static_cast<const char *>(body), static_cast<std::streamsize>(body_size));
+		fout.close();
+		if (!fout) {
+			spdlog::error("writing {} failed", filepath);
+			return "";
+		}
+		std::cout << filepath << std::endl;
+		return filepath;
+	}
+} // namespace
+
+std::string imageExtension(ImageFormat format) {
+	switch (format) {
+		case ImageFormat::PPM:
+			return ".ppm";
+		case ImageFormat::PFM:
+			return ".pfm";
+		case ImageFormat::PNG:
+			return ".png";
+	}
+	return "";
+}
+
+std::string writeImage(const Framebuffer &img, const std::string &name, ImageFormat format, const std::string &path) {
+	auto filename = std::filesystem::path(name).replace_extension(imageExtension(format)).string();
+	switch (format) {
+		case ImageFormat::PPM:
+			return makePPM(img, filename, path);
+		case ImageFormat::PFM:
+			return makePFM(img, filename, path);
+		case ImageFormat::PNG:
+			return makePNG(img, filename, path);
+	}
+	return "";
+}
+
+std::string makePPM(const Framebuffer &img, const std::string &name, const std::string &path) {
 	std::string filepath = mkdir(path, name);
-	std::cout << filepath << std::endl;
+	auto header = "P6\n" + std::to_string(img.width()) + ' ' + std::to_string(img.height()) + "\n255\n";
+	auto body = quantizeRGB8(img);
+	return writeWhole(filepath, header, body.data(), body.size());
+}
 
-	fout.open(filepath);
-	fout << "P3\n" << width << ' ' << height << "\n255\n";
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			fout << makeColor(img[i][j]);
+std::string makePFM(const Framebuffer &img, const std::string &name, const std::string &path) {
+	std::string filepath = mkdir(path, name);
+	// the sign of the scale gives the byte order of the floats, negative for little endian. rows are stored bottom
+	// to top
+	auto scale = std::endian::native == std::endian::little ? "-1.0" : "1.0";
+	auto header = "PF\n" + std::to_string(img.width()) + ' ' + std::to_string(img.height()) + "\n" + scale + "\n";
+	std::vector<float> body(static_cast<std::size_t>(img.width()) * img.height() * 3);
+	auto dst = body.data();
+	for (int i = img.height() - 1; i >= 0; i--) {
+		auto row = img.row(i);
+		for (int j = 0; j < img.width(); j++) {
+			*dst++ = row[j].r;
+			*dst++ = row[j].g;
+			*dst++ = row[j].b;
 		}
 	}
-	fout.close();
-	return filepath;
+	return writeWhole(filepath, header, body.data(), body.size() * sizeof(float));
+}
+
+std::string makePNG(const Framebuffer &img, const std::string &name, const std::string &path) {
+	std::string filepath = mkdir(path, name);
+	auto pixels = quantizeRGB8(img);
+	std::vector<unsigned char> encoded;
+	encoded.reserve(pixels.size() / 2);
+	auto append = [](void *context, void *data, int size) {
+		auto out = static_cast<std::vector<unsigned char> *>(context);
+		auto bytes = static_cast<unsigned char *>(data);
+		out->insert(out->end(), bytes, bytes + size);
+	};
+	if (stbi_write_png_to_func(append, &encoded, img.width(), img.height(), 3, pixels.data(), img.width() * 3) == 0) {
+		spdlog::error("png encoding of {} failed", filepath);
+		return "";
+	}
+	return writeWhole(filepath, "", encoded.data(), encoded.size());
 }
 
-std::string makeGrayscaleString(int width, int height, std::vector<std::vector<Color>> img) {
+std::string makeGrayscaleString(const Framebuffer &img) {
 	std::stringstream ss;
-	for (int i = 0; i < height; ++i) {
-		for (int j = 0; j < width; ++j) {
-			ss << getGreyScaleCharacter(img[i][j][0], img[i][j][1], img[i][j][2]);
+	for (int i = 0; i < img.height(); ++i) {
+		auto row = img.row(i);
+		for (int j = 0; j < img.width(); ++j) {
+			auto c = displayColor(row[j]);
+			ss << getGreyScaleCharacter(c[0], c[1], c[2]);
 		}
 		ss << std::endl;
 	}
@@ -50,12 +150,11 @@ std::string makeGrayscaleString(int width, int height, std::vector<std::vector<C
 }
 
 
-std::string makeGrayscaleTxt(int width, int height, const std::vector<std::vector<Color>> &img, const std::string &name,
-							 const std::string &path) {
+std::string makeGrayscaleTxt(const Framebuffer &img, const std::string &name, const std::string &path) {
 	auto fout = std::ofstream();
 	std::string filepath = mkdir(path, name);
 	fout.open(filepath);
-	fout << makeGrayscaleString(width, height, img);
+	fout << makeGrayscaleString(img);
 	fout.close();
 	return filepath;
 }
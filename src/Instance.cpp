@@ -0,0 +1,50 @@
+/**
+ * @file Instance.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "Instance.h"
+#include <cmath>
+
+Instance::Instance(std::shared_ptr<IHittable> object, const Transform &object_to_world, const IMaterial *material) :
+	object(std::move(object)), to_world(object_to_world.matrix().topRows<3>()),
+	to_object(object_to_world.inverse(Eigen::Affine).matrix().topRows<3>()),
+	normal_matrix(to_object.leftCols<3>().transpose()),
+	density_scale(static_cast<float>(std::cbrt(std::abs(to_object.leftCols<3>().determinant())))),
+	material(material) {
+	auto box = this->object->boundingBox();
+	Point3 min{INF, INF, INF};
+	Point3 max{-INF, -INF, -INF};
+	for (int i = 0; i < 8; i++) {
+		Point3 corner{i & 1 ? box.x.max : box.x.min, i & 2 ? box.y.max : box.y.min, i & 4 ? box.z.max : box.z.min};
+		Point3 placed = to_world.leftCols<3>() * corner + to_world.col(3);
+		min = min.cwiseMin(placed);
+		max = max.cwiseMax(placed);
+	}
+	bbox = AABB(min, max);
+}
+
+Instance::Transform Instance::makeTransform(const Vec3 &translation, Real psi, Real theta, Real phi, Real scale) {
+	Eigen::AngleAxis<Real> yaw(psi, Vec3::UnitZ());
+	Eigen::AngleAxis<Real> pitch(theta, Vec3::UnitY());
+	Eigen::AngleAxis<Real> roll(phi, Vec3::UnitX());
+	return Transform(Eigen::Translation<Real, 3>(translation) * (yaw * pitch * roll) * Eigen::Scaling(scale));
+}
+
+bool Instance::hit(const Ray &r, Interval interval, HitRecord &record) const {
+	// the direction is not renormalized, so t means the same in both spaces
+	Ray local(to_object.leftCols<3>() * r.pos() + to_object.col(3), to_object.leftCols<3>() * r.dir(), r.time());
+	if (!object->hit(local, interval, record))
+		return false;
+	record.p = r.at(record.t);
+	// front_face carries over, the inverse transpose keeps the sign of the normal against the direction
+	record.normal = (normal_matrix * record.normal).normalized();
+	record.uv_density *= density_scale;
+	if (material != nullptr)
+		record.material = material;
+	return true;
+}
+
+AABB Instance::boundingBox() const { return bbox; }
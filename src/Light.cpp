@@ -0,0 +1,27 @@
+/**
+ * @file Light.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "Light.h"
+#include <algorithm>
+
+LightList::LightList(const IHittable &world) { world.gatherLights(lights); }
+
+bool LightList::empty() const { return lights.empty(); }
+
+size_t LightList::size() const { return lights.size(); }
+
+Vec3 LightList::random(const Point3 &origin, Real time, PCG32 &rng) const {
+	auto idx = std::min(static_cast<size_t>(randomFloat(rng) * lights.size()), lights.size() - 1);
+	return lights[idx]->random(origin, time, rng);
+}
+
+Real LightList::pdfValue(const Ray &r) const {
+	Real pdf = 0;
+	for (const auto *light: lights)
+		pdf += light->pdfValue(r, Interval(EPS, INF));
+	return pdf / lights.size();
+}
@@ -0,0 +1,80 @@
+/**
+ * @file MappedFile.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "spdlog/spdlog.h"
+
+MappedFile::MappedFile(const std::string &file) { open(file); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept :
+	bytes(std::exchange(other.bytes, nullptr)), length(std::exchange(other.length, 0)),
+	opened(std::exchange(other.opened, false)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	if (this != &other) {
+		close();
+		bytes = std::exchange(other.bytes, nullptr);
+		length = std::exchange(other.length, 0);
+		opened = std::exchange(other.opened, false);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &file) {
+	close();
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		spdlog::error("cannot open {}", file);
+		return false;
+	}
+	struct stat st {};
+	if (fstat(fd, &st) != 0) {
+		spdlog::error("cannot stat {}", file);
+		::close(fd);
+		return false;
+	}
+	length = static_cast<size_t>(st.st_size);
+	if (length > 0) {
+		void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			spdlog::error("cannot map {}", file);
+			::close(fd);
+			length = 0;
+			return false;
+		}
+		// the loaders read front to back, let the kernel read ahead aggressively
+		madvise(p, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char *>(p);
+	}
+	// the mapping stays valid after the descriptor is gone
+	::close(fd);
+	opened = true;
+	return true;
+}
+
+bool MappedFile::isOpen() const { return opened; }
+
+const char *MappedFile::data() const { return bytes; }
+
+size_t MappedFile::size() const { return length; }
+
+std::string_view MappedFile::view() const { return {bytes, length}; }
+
+void MappedFile::close() {
+	if (bytes != nullptr)
+		munmap(const_cast<char *>(bytes), length);
+	bytes = nullptr;
+	length = 0;
+	opened = false;
+}
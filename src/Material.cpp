@@ -10,36 +10,94 @@
 #include "MathUtil.h"
 #include "Texture.h"
 #include <memory>
+#include <typeinfo>
+
+namespace {
+// the scattering of each material, shared by its class and the flat path
+
+Ray diffuseRay(const Ray &r_in, const HitRecord &record, PCG32 &rng) {
+    Vec3 ray_dir = record.normal + randomUnitVec3(rng);
+    if (verySmall(ray_dir)) {
+        ray_dir = record.normal;
+    }
+    return Ray(record.p, ray_dir, r_in.time());
+}
+
+Real diffusePdf(const HitRecord &record, const Ray &scattered) {
+    // normal + a random unit vector is cosine distributed about the normal
+    auto cosine = record.normal.dot(scattered.dir().normalized());
+    return cosine < 0 ? 0 : cosine / PI;
+}
+
+Ray metalRay(const Ray &r_in, const HitRecord &record, float fuzz,
+             PCG32 &rng) {
+    auto ray_dir = reflect(
+        r_in.dir().normalized() + randomUnitVec3(rng) * fuzz, record.normal);
+    return Ray(record.p, ray_dir, r_in.time());
+}
+
+float reflectance(float cosine, float refr_idx) {
+    auto r0 = (1 - refr_idx) / (1 + refr_idx);
+    r0 *= r0;
+    return r0 + (1 - r0) * std::pow(1 - cosine, 5);
+}
+
+Ray dielectricRay(const Ray &r_in, const HitRecord &record, float ir,
+                  PCG32 &rng) {
+    float ref_ratio = record.front_face ? (1.0 / ir) : ir;
+    auto unit = r_in.dir().normalized();
+
+    float cos = fmin((-unit).dot(record.normal), 1.0);
+    float sin = sqrt(1 - cos * cos);
+
+    bool can_refr = ref_ratio * sin < 1.0;
+    Vec3 dir;
+    if (can_refr && reflectance(cos, ref_ratio) < randomFloat(rng))
+        dir = refract(r_in.dir().normalized(), record.normal, ref_ratio);
+    else
+        dir = reflect(r_in.dir().normalized(), record.normal);
+
+    return Ray(record.p, dir, r_in.time());
+}
+} // namespace
 
 Color IMaterial::emitted(float u, float v, const Point3 &p) const {
-    return Eigen::Vector3d{0, 0, 0};
+    return Vec3{0, 0, 0};
+}
+
+Real IMaterial::scatteringPdf(const Ray &r_in, const HitRecord &record,
+                              const Ray &scattered) const {
+    return 0;
 }
 
+bool IMaterial::isEmissive() const { return false; }
+
 Lambertian::Lambertian(Color albedo)
     : albedo(std::make_shared<SolidColor>(std::move(albedo))) {}
 
 Lambertian::Lambertian(std::shared_ptr<ITexture> tex) : albedo(tex) {}
 
 bool Lambertian::scatter(const Ray &r_in, const HitRecord &record,
-                         Eigen::Vector3d &attenuation, Ray &scattered) const {
-    Eigen::Vector3d ray_dir = record.normal + randomUnitVec3();
-    if (verySmall(ray_dir)) {
-        ray_dir = record.normal;
-    }
-    scattered = Ray(record.p, ray_dir, r_in.time());
-    attenuation = albedo->value(record.u, record.v, record.p);
+                         Vec3 &attenuation, Ray &scattered, PCG32 &rng) const {
+    scattered = diffuseRay(r_in, record, rng);
+    attenuation =
+        albedo->filteredValue(record.u, record.v, record.p, record.footprint);
     return true;
 }
 
+Real Lambertian::scatteringPdf(const Ray &r_in, const HitRecord &record,
+                               const Ray &scattered) const {
+    return diffusePdf(record, scattered);
+}
+
 Metal::Metal(const Color &albedo, float fuzz)
     : albedo(std::make_shared<SolidColor>(albedo)), fuzz(fuzz) {}
 
 bool Metal::scatter(const Ray &r_in, const HitRecord &record,
-                    Eigen::Vector3d &attenuation, Ray &scattered) const {
-    auto ray_dir = reflect(r_in.dir().normalized() + randomUnitVec3() * fuzz,
-                           record.normal);
-    scattered = Ray(record.p, ray_dir, r_in.time());
-    attenuation = albedo->value(record.u, record.v, record.p);
+                    Vec3 &attenuation, Ray &scattered, PCG32 &rng) const {
+    scattered = metalRay(r_in, record, fuzz, rng);
+    attenuation =
+        albedo->filteredValue(record.u, record.v, record.p, record.footprint);
     return true;
 }
 Metal::Metal(const std::shared_ptr<ITexture> &albedo, float fuzz)
@@ -52,40 +110,113 @@ Dielectric::Dielectric(float idx, const Color &albedo)
     : ir(idx), albedo(std::make_shared<SolidColor>(albedo)) {}
 
 bool Dielectric::scatter(const Ray &r_in, const HitRecord &record,
-                         Eigen::Vector3d &attenuation, Ray &scattered) const {
-    attenuation = albedo->value(record.u, record.v, record.p);
-    float ref_ratio = record.front_face ? (1.0 / ir) : ir;
-    auto unit = r_in.dir().normalized();
-
-    float cos = fmin((-unit).dot(record.normal), 1.0);
-    float sin = sqrt(1 - cos * cos);
-
-    bool can_refr = ref_ratio * sin < 1.0;
-    Eigen::Vector3d dir;
-    if (can_refr && reflectance(cos, ref_ratio) < randomFloat())
-        dir = refract(r_in.dir().normalized(), record.normal, ref_ratio);
-    else
-        dir = reflect(r_in.dir().normalized(), record.normal);
-
-    scattered = Ray(record.p, dir, r_in.time());
+                         Vec3 &attenuation, Ray &scattered, PCG32 &rng) const {
+    attenuation =
+        albedo->filteredValue(record.u, record.v, record.p, record.footprint);
+    scattered = dielectricRay(r_in, record, ir, rng);
     return true;
 }
 
-float Dielectric::reflectance(float cosine, float refr_idx) {
-    auto r0 = (1 - refr_idx) / (1 + refr_idx);
-    r0 *= r0;
-    return r0 + (1 - r0) * std::pow(1 - cosine, 5);
-}
-
 DiffuseLight::DiffuseLight(std::shared_ptr<ITexture> t) : emit(t) {}
 
 DiffuseLight::DiffuseLight(Color c) : emit(std::make_shared<SolidColor>(c)) {}
 
 bool DiffuseLight::scatter(const Ray &r_in, const HitRecord &record,
-                           Eigen::Vector3d &attenuation, Ray &scattered) const {
+                           Vec3 &attenuation, Ray &scattered,
+                           PCG32 &rng) const {
     return false;
 }
 
 Color DiffuseLight::emitted(float u, float v, const Point3 &p) const {
     return emit->value(u, v, p);
 }
+
+bool DiffuseLight::isEmissive() const { return true; }
+
+void MaterialTable::compileLast() {
+    IMaterial &material = *materials.back();
+    auto &textures = compiled->textures;
+    FlatMaterial flat;
+    // exact types only, a subclass may override any of the virtuals
+    const auto &type = typeid(material);
+    if (type == typeid(Lambertian)) {
+        flat.kind = FlatMaterial::Kind::Lambertian;
+        flat.texture =
+            textures.add(static_cast<Lambertian &>(material).albedo.get());
+    } else if (type == typeid(Metal)) {
+        auto &metal = static_cast<Metal &>(material);
+        flat.kind = FlatMaterial::Kind::Metal;
+        flat.texture = textures.add(metal.albedo.get());
+        flat.fuzz = metal.fuzz;
+    } else if (type == typeid(Dielectric)) {
+        auto &dielectric = static_cast<Dielectric &>(material);
+        flat.kind = FlatMaterial::Kind::Dielectric;
+        flat.texture = textures.add(dielectric.albedo.get());
+        flat.ir = dielectric.ir;
+    } else if (type == typeid(DiffuseLight)) {
+        flat.kind = FlatMaterial::Kind::DiffuseLight;
+        flat.texture =
+            textures.add(static_cast<DiffuseLight &>(material).emit.get());
+    }
+    material.compiled = compiled.get();
+    material.compiled_index =
+        static_cast<uint32_t>(compiled->materials.size());
+    compiled->materials.push_back(flat);
+}
+
+bool MaterialTable::scatter(const IMaterial &material, const Ray &r_in,
+                            const HitRecord &record, Vec3 &attenuation,
+                            Ray &scattered, PCG32 &rng) {
+    if (material.compiled == nullptr)
+        return material.scatter(r_in, record, attenuation, scattered, rng);
+    const auto &flat = material.compiled->materials[material.compiled_index];
+    switch (flat.kind) {
+    case FlatMaterial::Kind::Lambertian:
+        scattered = diffuseRay(r_in, record, rng);
+        break;
+    case FlatMaterial::Kind::Metal:
+        scattered = metalRay(r_in, record, flat.fuzz, rng);
+        break;
+    case FlatMaterial::Kind::Dielectric:
+        scattered = dielectricRay(r_in, record, flat.ir, rng);
+        break;
+    case FlatMaterial::Kind::DiffuseLight:
+        return false;
+    default:
+        return material.scatter(r_in, record, attenuation, scattered, rng);
+    }
+    attenuation = material.compiled->textures.filteredValue(
+        flat.texture, record.u, record.v, record.p, record.footprint);
+    return true;
+}
+
+Color MaterialTable::emitted(const IMaterial &material, float u, float v,
+                             const Point3 &p) {
+    if (material.compiled == nullptr)
+        return material.emitted(u, v, p);
+    const auto &flat = material.compiled->materials[material.compiled_index];
+    switch (flat.kind) {
+    case FlatMaterial::Kind::DiffuseLight:
+        return material.compiled->textures.value(flat.texture, u, v, p);
+    case FlatMaterial::Kind::Other:
+        return material.emitted(u, v, p);
+    default:
+        return Color{0, 0, 0};
+    }
+}
+
+Real MaterialTable::scatteringPdf(const IMaterial &material, const Ray &r_in,
+                                  const HitRecord &record,
+                                  const Ray &scattered) {
+    if (material.compiled == nullptr)
+        return material.scatteringPdf(r_in, record, scattered);
+    const auto &flat = material.compiled->materials[material.compiled_index];
+    switch (flat.kind) {
+    case FlatMaterial::Kind::Lambertian:
+        return diffusePdf(record, scattered);
+    case FlatMaterial::Kind::Other:
+        return material.scatteringPdf(r_in, record, scattered);
+    default:
+        return 0;
+    }
+}
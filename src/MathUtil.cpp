@@ -9,34 +9,34 @@
 #include <cmath>
 #include <iostream>
 
-std::ostream &operator<<(std::ostream &out, const Eigen::Vector3d &other) {
+std::ostream &operator<<(std::ostream &out, const Vec3 &other) {
     out << "Vec3: " << other[0] << " " << other[1] << " " << other[2];
     return out;
 }
 
-Ray::Ray(Eigen::Vector3d pos, Eigen::Vector3d dir)
+Ray::Ray(Vec3 pos, Vec3 dir)
     : position(std::move(pos)), direction(std::move(dir)), tm(0) {}
 
-Ray::Ray(Eigen::Vector3d pos, Eigen::Vector3d dir, double time)
+Ray::Ray(Vec3 pos, Vec3 dir, Real time)
     : position(std::move(pos)), direction(std::move(dir)), tm(time) {}
 
-Point3 Ray::at(double t) const { return position + direction * t; }
+Point3 Ray::at(Real t) const { return position + direction * t; }
 
-Eigen::Vector3d Ray::dir() const { return direction; }
+Vec3 Ray::dir() const { return direction; }
 
-double Ray::time() const { return tm; }
+Real Ray::time() const { return tm; }
 
-Eigen::Vector3d Ray::pos() const { return position; }
+Vec3 Ray::pos() const { return position; }
 Interval::Interval() : min(-INF), max(INF) {}
-Interval::Interval(float min, float max) : min(min), max(max) {}
-bool Interval::within(float x) const { return (min <= x) && (x <= max); }
-bool Interval::surround(float x) const { return (min < x) && (x < max); }
+Interval::Interval(Real min, Real max) : min(min), max(max) {}
+bool Interval::within(Real x) const { return (min <= x) && (x <= max); }
+bool Interval::surround(Real x) const { return (min < x) && (x < max); }
 Interval::Interval(const Interval &first, const Interval &second) {
     min = fmin(first.min, second.min);
     max = fmax(first.max, second.max);
 }
 
-float Interval::clamp(float x) const {
+Real Interval::clamp(Real x) const {
     if (x < min)
         return min;
     if (x > max)
@@ -44,7 +44,7 @@ float Interval::clamp(float x) const {
     return x;
 }
 
-Interval Interval::expand(float delta) {
+Interval Interval::expand(Real delta) {
     auto padding = delta / 2;
     return Interval(min - padding, max + padding);
 }
@@ -111,7 +111,7 @@ AABB AABB::pad() {
     return AABB(new_x, new_y, new_z);
 }
 
-float Perlin::gradientDotProd(int hash, const Eigen::Vector3d &pt) const {
+float Perlin::gradientDotProd(int hash, const Vec3 &pt) const {
     auto x = pt[0];
     auto y = pt[1];
     auto z = pt[2];
@@ -205,16 +205,74 @@ float Perlin::rawNoise(const Point3 &p) const {
     return out;
 }
 
+Perlin::NoiseLanes Perlin::rawNoise(const NoiseLanes &x, const NoiseLanes &y,
+                                    const NoiseLanes &z) const {
+    // the gradients gradientDotProd picks, one row per hash & 0xF
+    static constexpr float gradients[16][3] = {
+        {1, 1, 0},  {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0}, {1, 0, 1},  {-1, 0, 1},
+        {1, 0, -1}, {-1, 0, -1}, {0, 1, 1}, {0, -1, 1},  {0, 1, -1}, {0, -1, -1},
+        {1, 1, 0},  {0, -1, 1}, {-1, 1, 0}, {0, -1, -1}};
+    NoiseLanes fx = x.floor(), fy = y.floor(), fz = z.floor();
+    NoiseLanes rx = x - fx, ry = y - fy, rz = z - fz;
+    // gradient components of the eight corners, indexed by the corner bits
+    // x | y << 1 | z << 2
+    NoiseLanes gx[8], gy[8], gz[8];
+    for (int i = 0; i < octave_lanes; i++) {
+        int xi = static_cast<int>(fx[i]) & 255;
+        int yi = static_cast<int>(fy[i]) & 255;
+        int zi = static_cast<int>(fz[i]) & 255;
+        int a = perm[xi] + yi, b = perm[xi + 1] + yi;
+        int corners[4] = {perm[a] + zi, perm[b] + zi, perm[a + 1] + zi,
+                          perm[b + 1] + zi};
+        for (int c = 0; c < 8; c++) {
+            const float *g = gradients[perm[corners[c & 3] + (c >> 2)] & 0xF];
+            gx[c][i] = g[0];
+            gy[c][i] = g[1];
+            gz[c][i] = g[2];
+        }
+    }
+    NoiseLanes dots[8];
+    for (int c = 0; c < 8; c++) {
+        NoiseLanes dx = (c & 1) ? NoiseLanes(rx - 1) : rx;
+        NoiseLanes dy = (c & 2) ? NoiseLanes(ry - 1) : ry;
+        NoiseLanes dz = (c & 4) ? NoiseLanes(rz - 1) : rz;
+        dots[c] = gx[c] * dx + gy[c] * dy + gz[c] * dz;
+    }
+    auto fade = [](const NoiseLanes &t) -> NoiseLanes {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+    };
+    NoiseLanes u = fade(rx), v = fade(ry), w = fade(rz);
+    auto lerp = [](const NoiseLanes &begin, const NoiseLanes &end,
+                   const NoiseLanes &weight) -> NoiseLanes {
+        return begin + weight * (end - begin);
+    };
+    NoiseLanes y0 = lerp(lerp(dots[0], dots[1], u), lerp(dots[2], dots[3], u), v);
+    NoiseLanes y1 = lerp(lerp(dots[4], dots[5], u), lerp(dots[6], dots[7], u), v);
+    return lerp(y0, y1, w);
+}
+
 float Perlin::octaveNoise(const Point3 &p, float frequency, int octave_count,
                           float persistence) const {
     float sum = 0;
     float max_value = 0;
     float amplitude = 1;
-    for (int i = 0; i < octave_count; ++i) {
-        sum += rawNoise(p * frequency) * amplitude;
-        max_value += amplitude;
-        amplitude *= persistence;
-        frequency *= 2;
+    for (int first = 0; first < octave_count; first += octave_lanes) {
+        NoiseLanes x, y, z, weight;
+        for (int i = 0; i < octave_lanes; i++) {
+            if (first + i < octave_count) {
+                // the same rounding as rawNoise(p * frequency)
+                x[i] = static_cast<float>(p[0] * frequency);
+                y[i] = static_cast<float>(p[1] * frequency);
+                z[i] = static_cast<float>(p[2] * frequency);
+                weight[i] = amplitude;
+                max_value += amplitude;
+                amplitude *= persistence;
+                frequency *= 2;
+            } else {
+                x[i] = y[i] = z[i] = weight[i] = 0;
+            }
+        }
+        sum += (rawNoise(x, y, z) * weight).sum();
     }
     return sum / max_value;
 }
@@ -0,0 +1,703 @@
+/**
+ * @file MeshLoader.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "MeshLoader.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+	// smaller chunks cost more in thread startup than they save
+	constexpr size_t min_chunk_bytes = 1 << 20;
+
+	size_t workerCount(size_t work, size_t min_work) {
+		size_t threads = std::max(1u, std::thread::hardware_concurrency());
+		return std::clamp<size_t>(work / std::max<size_t>(min_work, 1), 1, threads);
+	}
+
+	/**
+	 * @brief run f(begin, end) over count items split evenly across workers
+	 */
+	template<typename F>
+	void parallelRanges(size_t count, size_t workers, F &&f) {
+		std::vector<std::future<void>> futures;
+		for (size_t w = 1; w < workers; w++)
+			futures.push_back(std::async(std::launch::async, f, count * w / workers, count * (w + 1) / workers));
+		f(0, count / workers);
+		for (auto &future: futures)
+			future.get();
+	}
+
+	double elapsedMs(std::chrono::steady_clock::time_point since) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+	}
+
+	const char *skipSpaces(const char *p, const char *end) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	}
+
+	bool parseFloat(const char *&p, const char *end, float &value) {
+		p = skipSpaces(p, end);
+		auto [next, ec] = std::from_chars(p, end, value);
+		if (ec != std::errc())
+			return false;
+		p = next;
+		return true;
+	}
+
+	// --- OBJ ---
+
+	// a face index as written, with negative indices already made relative to the chunk start. the low bit marks
+	// those, they get the count of the earlier chunks added when merging
+	using RawIndex = int64_t;
+	constexpr RawIndex missing_index = INT64_MIN;
+
+	struct ObjChunk {
+		std::vector<Eigen::Vector3f> positions;
+		std::vector<Eigen::Vector3f> normals;
+		std::vector<Eigen::Vector2f> uvs;
+		std::vector<RawIndex> indices;
+		std::vector<RawIndex> normal_indices;
+		std::vector<RawIndex> uv_indices;
+		// local triangle index where each usemtl takes effect
+		std::vector<std::pair<uint32_t, std::string>> material_switches;
+		size_t error_offset = 0;
+		bool ok = true;
+	};
+
+	bool parseIndex(const char *&p, const char *end, size_t count, RawIndex &index) {
+		int64_t value;
+		auto [next, ec] = std::from_chars(p, end, value);
+		if (ec != std::errc() || value == 0)
+			return false;
+		p = next;
+		index = value > 0 ? (value - 1) << 1 : (static_cast<int64_t>(count) + value) * 2 + 1;
+		return true;
+	}
+
+	/**
+	 * @brief parse one face vertex, v, v/vt, v//vn or v/vt/vn
+	 */
+	bool parseFaceVertex(const char *&p, const char *end, const ObjChunk &chunk, RawIndex (&vertex)[3]) {
+		vertex[1] = vertex[2] = missing_index;
+		if (!parseIndex(p, end, chunk.positions.size(), vertex[0]))
+			return false;
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p != '/' && !parseIndex(p, end, chunk.uvs.size(), vertex[1]))
+				return false;
+			if (p < end && *p == '/') {
+				p++;
+				if (!parseIndex(p, end, chunk.normals.size(), vertex[2]))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void parseObjChunk(const char *begin, const char *end, ObjChunk &chunk) {
+		RawIndex face[3][3];
+		for (const char *line = begin; line < end;) {
+			auto *line_end = static_cast<const char *>(std::memchr(line, '\n', end - line));
+			if (line_end == nullptr)
+				line_end = end;
+			auto *p = skipSpaces(line, line_end);
+			bool ok = true;
+			if (line_end - p > 2 && p[0] == 'v' && p[1] == ' ') {
+				p += 2;
+				auto &v = chunk.positions.emplace_back();
+				ok = parseFloat(p, line_end, v.x()) && parseFloat(p, line_end, v.y()) && parseFloat(p, line_end, v.z());
+			} else if (line_end - p > 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+				p += 3;
+				auto &n = chunk.normals.emplace_back();
+				ok = parseFloat(p, line_end, n.x()) && parseFloat(p, line_end, n.y()) && parseFloat(p, line_end, n.z());
+			} else if (line_end - p > 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ') {
+				p += 3;
+				auto &uv = chunk.uvs.emplace_back();
+				ok = parseFloat(p, line_end, uv.x());
+				// the v coordinate is optional
+				if (ok && !parseFloat(p, line_end, uv.y()))
+					uv.y() = 0;
+			} else if (line_end - p > 2 && p[0] == 'f' && p[1] == ' ') {
+				p += 2;
+				int corners = 0;
+				while (ok) {
+					p = skipSpaces(p, line_end);
+					if (p == line_end || *p == '\r' || *p == '#')
+						break;
+					// fan around the first corner, the previous corner stays in face[1]
+					auto &vertex = face[std::min(corners, 2)];
+					ok = parseFaceVertex(p, line_end, chunk, vertex);
+					if (ok && ++corners >= 3) {
+						for (int i = 0; i < 3; i++) {
+							chunk.indices.push_back(face[i][0]);
+							chunk.uv_indices.push_back(face[i][1]);
+							chunk.normal_indices.push_back(face[i][2]);
+						}
+						std::copy(std::begin(face[2]), std::end(face[2]), std::begin(face[1]));
+					}
+				}
+				ok = ok && corners >= 3;
+			} else if (line_end - p > 7 && std::memcmp(p, "usemtl ", 7) == 0) {
+				auto *name = skipSpaces(p + 7, line_end);
+				auto *name_end = line_end;
+				while (name_end > name && (name_end[-1] == '\r' || name_end[-1] == ' ' || name_end[-1] == '\t'))
+					name_end--;
+				chunk.material_switches.emplace_back(chunk.indices.size() / 3, std::string(name, name_end));
+			}
+			if (!ok) {
+				chunk.ok = false;
+				chunk.error_offset = line - begin;
+				return;
+			}
+			line = line_end + 1;
+		}
+	}
+
+	/**
+	 * @brief resolve raw into an index of a buffer of count entries, base is the count of the earlier chunks
+	 */
+	bool resolveIndex(RawIndex raw, size_t base, size_t count, uint32_t &index) {
+		int64_t value = (raw >> 1) + ((raw & 1) ? static_cast<int64_t>(base) : 0);
+		if (value < 0 || static_cast<size_t>(value) >= count)
+			return false;
+		index = static_cast<uint32_t>(value);
+		return true;
+	}
+
+	// --- PLY ---
+
+	enum class PlyType : uint8_t { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+	PlyType plyType(std::string_view name) {
+		if (name == "char" || name == "int8")
+			return PlyType::Int8;
+		if (name == "uchar" || name == "uint8")
+			return PlyType::UInt8;
+		if (name == "short" || name == "int16")
+			return PlyType::Int16;
+		if (name == "ushort" || name == "uint16")
+			return PlyType::UInt16;
+		if (name == "int" || name == "int32")
+			return PlyType::Int32;
+		if (name == "uint" || name == "uint32")
+			return PlyType::UInt32;
+		if (name == "float" || name == "float32")
+			return PlyType::Float32;
+		if (name == "double" || name == "float64")
+			return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	size_t plySize(PlyType type) {
+		constexpr size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+		return sizes[static_cast<int>(type)];
+	}
+
+	template<typename T>
+	T load(const char *p, bool swap) {
+		using Bits = std::conditional_t<sizeof(T) == 1, uint8_t,
+										std::conditional_t<sizeof(T) == 2, uint16_t,
+														   std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+		Bits bits;
+		std::memcpy(&bits, p, sizeof(T));
+		if (swap)
+			bits = std::byteswap(bits);
+		T value;
+		std::memcpy(&value, &bits, sizeof(T));
+		return value;
+	}
+
+	double loadScalar(const char *p, PlyType type, bool swap) {
+		switch (type) {
+			case PlyType::Int8:
+				return load<int8_t>(p, swap);
+			case PlyType::UInt8:
+				return load<uint8_t>(p, swap);
+			case PlyType::Int16:
+				return load<int16_t>(p, swap);
+			case PlyType::UInt16:
+				return load<uint16_t>(p, swap);
+			case PlyType::Int32:
+				return load<int32_t>(p, swap);
+			case PlyType::UInt32:
+				return load<uint32_t>(p, swap);
+			case PlyType::Float32:
+				return load<float>(p, swap);
+			case PlyType::Float64:
+				return load<double>(p, swap);
+			default:
+				return 0;
+		}
+	}
+
+	struct PlyProperty {
+		std::string name;
+		PlyType type = PlyType::Invalid;
+		// list properties only
+		PlyType count_type = PlyType::Invalid;
+		bool is_list = false;
+	};
+
+	struct PlyElement {
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+
+		// 0 when a list makes the rows vary in size
+		size_t stride() const {
+			size_t size = 0;
+			for (const auto &property: properties) {
+				if (property.is_list)
+					return 0;
+				size += plySize(property.type);
+			}
+			return size;
+		}
+
+		int find(std::string_view property) const {
+			for (size_t i = 0; i < properties.size(); i++)
+				if (properties[i].name == property)
+					return static_cast<int>(i);
+			return -1;
+		}
+	};
+
+	/**
+	 * @brief byte size of property stored at p, 0 when a list count runs past end
+	 */
+	size_t propertySize(const PlyProperty &property, const char *p, const char *end, bool swap) {
+		if (!property.is_list)
+			return plySize(property.type);
+		if (p + plySize(property.count_type) > end)
+			return 0;
+		auto count = static_cast<size_t>(loadScalar(p, property.count_type, swap));
+		return plySize(property.count_type) + count * plySize(property.type);
+	}
+
+	/**
+	 * @brief byte size of one row of element starting at p, walking its lists
+	 */
+	size_t rowSize(const PlyElement &element, const char *p, const char *end, bool swap) {
+		size_t size = 0;
+		for (const auto &property: element.properties) {
+			auto property_size = propertySize(property, p + size, end, swap);
+			if (property_size == 0)
+				return 0;
+			size += property_size;
+		}
+		return size;
+	}
+
+	bool parsePlyHeader(std::string_view text, std::vector<PlyElement> &elements, bool &big_endian,
+						size_t &header_size, const std::string &file) {
+		auto header_end = text.find("end_header");
+		if (text.substr(0, 3) != "ply" || header_end == std::string_view::npos) {
+			spdlog::error("{} is not a PLY file", file);
+			return false;
+		}
+		auto data_start = text.find('\n', header_end);
+		if (data_start == std::string_view::npos) {
+			spdlog::error("{} has no data after the PLY header", file);
+			return false;
+		}
+		header_size = data_start + 1;
+		bool has_format = false;
+		size_t pos = 0;
+		while (pos < header_end) {
+			auto line_end = text.find('\n', pos);
+			auto line = text.substr(pos, line_end - pos);
+			pos = line_end + 1;
+			std::vector<std::string_view> words;
+			for (size_t i = 0; i < line.size();) {
+				while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+					i++;
+				auto start = i;
+				while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+					i++;
+				if (i > start)
+					words.push_back(line.substr(start, i - start));
+			}
+			if (words.empty())
+				continue;
+			if (words[0] == "format" && words.size() >= 2) {
+				if (words[1] == "ascii") {
+					spdlog::error("{} is an ASCII PLY file, only binary PLY is supported", file);
+					return false;
+				}
+				big_endian = words[1] == "binary_big_endian";
+				has_format = big_endian || words[1] == "binary_little_endian";
+			} else if (words[0] == "element" && words.size() >= 3) {
+				auto &element = elements.emplace_back();
+				element.name = words[1];
+				std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count);
+			} else if (words[0] == "property" && !elements.empty()) {
+				PlyProperty property;
+				if (words.size() >= 5 && words[1] == "list") {
+					property.is_list = true;
+					property.count_type = plyType(words[2]);
+					property.type = plyType(words[3]);
+					property.name = words[4];
+				} else if (words.size() >= 3) {
+					property.type = plyType(words[1]);
+					property.name = words[2];
+				}
+				if (property.type == PlyType::Invalid || (property.is_list && property.count_type == PlyType::Invalid)) {
+					spdlog::error("{}: unsupported PLY property '{}'", file, line);
+					return false;
+				}
+				elements.back().properties.push_back(std::move(property));
+			}
+		}
+		if (!has_format) {
+			spdlog::error("{} has no binary PLY format line", file);
+			return false;
+		}
+		return true;
+	}
+
+	bool readPlyVertices(const PlyElement &element, const char *p, const char *end, bool swap, MeshData &mesh,
+						 const std::string &file) {
+		auto stride = element.stride();
+		int x = element.find("x"), y = element.find("y"), z = element.find("z");
+		if (stride == 0 || x < 0 || y < 0 || z < 0) {
+			spdlog::error("{}: the PLY vertex element needs fixed size x, y and z", file);
+			return false;
+		}
+		if (static_cast<size_t>(end - p) < stride * element.count) {
+			spdlog::error("{} is truncated in the vertex data", file);
+			return false;
+		}
+		int nx = element.find("nx"), ny = element.find("ny"), nz = element.find("nz");
+		int u = element.find("u"), v = element.find("v");
+		if (u < 0 || v < 0) {
+			u = element.find("s");
+			v = element.find("t");
+		}
+		if (u < 0 || v < 0) {
+			u = element.find("texture_u");
+			v = element.find("texture_v");
+		}
+		bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+		bool has_uvs = u >= 0 && v >= 0;
+
+		std::vector<size_t> offsets;
+		for (size_t i = 0, offset = 0; i < element.properties.size(); i++) {
+			offsets.push_back(offset);
+			offset += plySize(element.properties[i].type);
+		}
+		auto read = [&](const char *row, int property) {
+			return static_cast<float>(loadScalar(row + offsets[property], element.properties[property].type, swap));
+		};
+
+		mesh.positions.resize(element.count);
+		if (has_normals)
+			mesh.normals.resize(element.count);
+		if (has_uvs)
+			mesh.uvs.resize(element.count);
+		parallelRanges(element.count, workerCount(stride * element.count, min_chunk_bytes), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				const char *row = p + i * stride;
+				mesh.positions[i] = {read(row, x), read(row, y), read(row, z)};
+				if (has_normals)
+					mesh.normals[i] = {read(row, nx), read(row, ny), read(row, nz)};
+				if (has_uvs)
+					mesh.uvs[i] = {read(row, u), read(row, v)};
+			}
+		});
+		return true;
+	}
+
+	/**
+	 * @brief faces made only of triangles have a fixed stride and decode in parallel, anything else falls back to a
+	 * serial walk that fans polygons
+	 */
+	bool readPlyFaces(const PlyElement &element, const char *p, const char *end, bool swap, MeshData &mesh,
+					  const std::string &file) {
+		int list = element.find("vertex_indices");
+		if (list < 0)
+			list = element.find("vertex_index");
+		if (list < 0 || !element.properties[list].is_list) {
+			spdlog::error("{}: the PLY face element has no vertex_indices list", file);
+			return false;
+		}
+		const auto &indices = element.properties[list];
+		auto count_size = plySize(indices.count_type);
+		auto index_size = plySize(indices.type);
+		auto vertex_count = mesh.positions.size();
+
+		if (element.properties.size() == 1) {
+			auto stride = count_size + 3 * index_size;
+			if (static_cast<size_t>(end - p) >= stride * element.count) {
+				mesh.indices.resize(3 * element.count);
+				std::atomic<bool> fixed = true;
+				parallelRanges(element.count, workerCount(stride * element.count, min_chunk_bytes),
+							   [&](size_t begin, size_t end) {
+								   for (size_t i = begin; i < end && fixed.load(std::memory_order_relaxed); i++) {
+									   const char *row = p + i * stride;
+									   if (loadScalar(row, indices.count_type, swap) != 3) {
+										   fixed = false;
+										   return;
+									   }
+									   for (int k = 0; k < 3; k++) {
+										   auto index = static_cast<int64_t>(
+												   loadScalar(row + count_size + k * index_size, indices.type, swap));
+										   if (index < 0 || static_cast<size_t>(index) >= vertex_count) {
+											   fixed = false;
+											   return;
+										   }
+										   mesh.indices[3 * i + k] = static_cast<uint32_t>(index);
+									   }
+								   }
+							   });
+				if (fixed)
+					return true;
+				mesh.indices.clear();
+			}
+		}
+
+		for (size_t i = 0; i < element.count; i++) {
+			auto size = rowSize(element, p, end, swap);
+			if (size == 0 || p + size > end) {
+				spdlog::error("{} is truncated in the face data", file);
+				return false;
+			}
+			const char *row = p;
+			for (int k = 0; k < list; k++)
+				row += propertySize(element.properties[k], row, end, swap);
+			auto corners = static_cast<size_t>(loadScalar(row, indices.count_type, swap));
+			uint32_t first = 0, previous = 0;
+			for (size_t k = 0; k < corners; k++) {
+				auto index = static_cast<int64_t>(loadScalar(row + count_size + k * index_size, indices.type, swap));
+				if (index < 0 || static_cast<size_t>(index) >= vertex_count) {
+					spdlog::error("{}: face {} refers to vertex {} of {}", file, i, index, vertex_count);
+					return false;
+				}
+				auto current = static_cast<uint32_t>(index);
+				if (k == 0)
+					first = current;
+				else if (k >= 2)
+					mesh.indices.insert(mesh.indices.end(), {first, previous, current});
+				previous = current;
+			}
+			p += size;
+		}
+		return true;
+	}
+} // namespace
+
+std::shared_ptr<MeshData> loadObj(const std::string &file) {
+	auto start = std::chrono::steady_clock::now();
+	MappedFile mapped;
+	if (!mapped.open(file))
+		return nullptr;
+	auto text = mapped.view();
+
+	// cut at line starts so every chunk parses on its own
+	auto workers = workerCount(text.size(), min_chunk_bytes);
+	std::vector<size_t> cuts = {0};
+	for (size_t w = 1; w < workers; w++) {
+		auto cut = text.find('\n', std::max(cuts.back(), text.size() * w / workers));
+		if (cut == std::string_view::npos)
+			break;
+		cuts.push_back(cut + 1);
+	}
+	cuts.push_back(text.size());
+	std::vector<ObjChunk> chunks(cuts.size() - 1);
+	parallelRanges(chunks.size(), chunks.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			parseObjChunk(text.data() + cuts[i], text.data() + cuts[i + 1], chunks[i]);
+	});
+
+	struct Offsets {
+		size_t positions = 0, normals = 0, uvs = 0, triangles = 0;
+		uint16_t material = 0;
+	};
+	auto mesh = std::make_shared<MeshData>();
+	std::unordered_map<std::string, uint16_t> material_ids;
+	std::vector<Offsets> offsets(chunks.size() + 1);
+	bool all_uvs = true, all_normals = true;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		const auto &chunk = chunks[i];
+		if (!chunk.ok) {
+			spdlog::error("{}: cannot parse the line at byte {}", file, cuts[i] + chunk.error_offset);
+			return nullptr;
+		}
+		all_uvs = all_uvs && std::ranges::find(chunk.uv_indices, missing_index) == chunk.uv_indices.end();
+		all_normals = all_normals && std::ranges::find(chunk.normal_indices, missing_index) == chunk.normal_indices.end();
+		offsets[i + 1] = {offsets[i].positions + chunk.positions.size(), offsets[i].normals + chunk.normals.size(),
+						  offsets[i].uvs + chunk.uvs.size(), offsets[i].triangles + chunk.indices.size() / 3,
+						  offsets[i].material};
+		for (const auto &[triangle, name]: chunk.material_switches) {
+			auto [it, inserted] = material_ids.try_emplace(name, static_cast<uint16_t>(mesh->material_names.size()));
+			if (inserted)
+				mesh->material_names.push_back(name);
+			offsets[i + 1].material = it->second;
+		}
+	}
+	const auto &total = offsets.back();
+	if (total.triangles == 0) {
+		spdlog::error("{} has no faces", file);
+		return nullptr;
+	}
+	if (!all_uvs && total.uvs > 0)
+		spdlog::warn("{}: some faces have no texture coordinates, dropping all of them", file);
+	if (!all_normals && total.normals > 0)
+		spdlog::warn("{}: some faces have no normals, dropping all of them", file);
+	all_uvs = all_uvs && total.uvs > 0;
+	all_normals = all_normals && total.normals > 0;
+
+	mesh->positions.resize(total.positions);
+	mesh->indices.resize(3 * total.triangles);
+	if (all_normals) {
+		mesh->normals.resize(total.normals);
+		mesh->normal_indices.resize(3 * total.triangles);
+	}
+	if (all_uvs) {
+		mesh->uvs.resize(total.uvs);
+		mesh->uv_indices.resize(3 * total.triangles);
+	}
+	if (!mesh->material_names.empty())
+		mesh->material_ids.resize(total.triangles);
+
+	// every chunk writes its own slice of the merged buffers
+	std::atomic<bool> valid = true;
+	parallelRanges(chunks.size(), chunks.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			auto &chunk = chunks[i];
+			const auto &offset = offsets[i];
+			std::ranges::copy(chunk.positions, mesh->positions.begin() + offset.positions);
+			auto first = 3 * offset.triangles;
+			for (size_t k = 0; k < chunk.indices.size(); k++) {
+				bool ok = resolveIndex(chunk.indices[k], offset.positions, total.positions, mesh->indices[first + k]);
+				if (all_normals) {
+					ok = ok && resolveIndex(chunk.normal_indices[k], offset.normals, total.normals,
+											mesh->normal_indices[first + k]);
+				}
+				if (all_uvs)
+					ok = ok && resolveIndex(chunk.uv_indices[k], offset.uvs, total.uvs, mesh->uv_indices[first + k]);
+				if (!ok) {
+					valid = false;
+					return;
+				}
+			}
+			if (all_normals)
+				std::ranges::copy(chunk.normals, mesh->normals.begin() + offset.normals);
+			if (all_uvs)
+				std::ranges::copy(chunk.uvs, mesh->uvs.begin() + offset.uvs);
+			if (!mesh->material_ids.empty()) {
+				auto material = offset.material;
+				size_t triangle = 0;
+				for (const auto &[next, name]: chunk.material_switches) {
+					std::fill(mesh->material_ids.begin() + offset.triangles + triangle,
+							  mesh->material_ids.begin() + offset.triangles + next, material);
+					triangle = next;
+					material = material_ids.at(name);
+				}
+				std::fill(mesh->material_ids.begin() + offset.triangles + triangle,
+						  mesh->material_ids.begin() + offsets[i + 1].triangles, material);
+			}
+			// the raw indices are the largest part, free them as soon as they are merged
+			chunk = ObjChunk();
+		}
+	});
+	if (!valid) {
+		spdlog::error("{} has a face index out of range", file);
+		return nullptr;
+	}
+	spdlog::info("loaded {} in {:.1f}ms with {} threads: {} vertices, {} triangles, {} materials, {:.1f}MB", file,
+				 elapsedMs(start), chunks.size(), mesh->positions.size(), mesh->triangleCount(),
+				 mesh->material_names.size(), mesh->memoryUsage() / 1048576.0);
+	return mesh;
+}
+
+std::shared_ptr<MeshData> loadPly(const std::string &file) {
+	auto start = std::chrono::steady_clock::now();
+	MappedFile mapped;
+	if (!mapped.open(file))
+		return nullptr;
+	auto text = mapped.view();
+
+	std::vector<PlyElement> elements;
+	bool big_endian = false;
+	size_t header_size = 0;
+	if (!parsePlyHeader(text, elements, big_endian, header_size, file))
+		return nullptr;
+	bool swap = big_endian != (std::endian::native == std::endian::big);
+
+	auto mesh = std::make_shared<MeshData>();
+	const char *p = text.data() + header_size;
+	const char *end = text.data() + text.size();
+	bool has_vertices = false, has_faces = false;
+	for (const auto &element: elements) {
+		if (element.name == "vertex") {
+			if (!readPlyVertices(element, p, end, swap, *mesh, file))
+				return nullptr;
+			has_vertices = true;
+		} else if (element.name == "face") {
+			if (!has_vertices) {
+				spdlog::error("{}: the PLY face element comes before the vertices", file);
+				return nullptr;
+			}
+			if (!readPlyFaces(element, p, end, swap, *mesh, file))
+				return nullptr;
+			has_faces = true;
+		}
+		if (has_vertices && has_faces)
+			break;
+		// step over the element just read, or one we do not use
+		if (auto stride = element.stride(); stride > 0) {
+			p += stride * element.count;
+		} else {
+			for (size_t i = 0; i < element.count && p < end; i++) {
+				auto size = rowSize(element, p, end, swap);
+				if (size == 0)
+					break;
+				p += size;
+			}
+		}
+		if (p > end) {
+			spdlog::error("{} is truncated in element {}", file, element.name);
+			return nullptr;
+		}
+	}
+	if (mesh->triangleCount() == 0) {
+		spdlog::error("{} has no faces", file);
+		return nullptr;
+	}
+	// PLY attributes are per vertex, so the positions index them too
+	if (!mesh->normals.empty())
+		mesh->normal_indices = mesh->indices;
+	if (!mesh->uvs.empty())
+		mesh->uv_indices = mesh->indices;
+	spdlog::info("loaded {} in {:.1f}ms: {} vertices, {} triangles, {:.1f}MB", file, elapsedMs(start),
+				 mesh->positions.size(), mesh->triangleCount(), mesh->memoryUsage() / 1048576.0);
+	return mesh;
+}
+
+std::shared_ptr<MeshData> loadMesh(const std::string &file) {
+	auto dot = file.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : file.substr(dot + 1);
+	std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	if (extension == "obj")
+		return loadObj(file);
+	if (extension == "ply")
+		return loadPly(file);
+	spdlog::error("unknown mesh format of {}", file);
+	return nullptr;
+}
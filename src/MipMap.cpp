@@ -0,0 +1,114 @@
+/**
+ * @file MipMap.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "MipMap.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+#include "ImageUtil.h"
+#include "spdlog/spdlog.h"
+
+MipMap::MipMap(int width, int height, const std::vector<Eigen::Vector3f> &texels) {
+	levels.push_back(makeLevel(width, height));
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			levels[0].texel(x, y) = texels[y * width + x];
+	// box filter every level down to a single texel, odd edges repeat their last texel
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		const auto &fine = levels.back();
+		auto coarse = makeLevel(std::max(1, fine.width / 2), std::max(1, fine.height / 2));
+		for (int y = 0; y < coarse.height; y++) {
+			for (int x = 0; x < coarse.width; x++) {
+				int x0 = std::min(2 * x, fine.width - 1), x1 = std::min(2 * x + 1, fine.width - 1);
+				int y0 = std::min(2 * y, fine.height - 1), y1 = std::min(2 * y + 1, fine.height - 1);
+				coarse.texel(x, y) =
+						(fine.texel(x0, y0) + fine.texel(x1, y0) + fine.texel(x0, y1) + fine.texel(x1, y1)) / 4;
+			}
+		}
+		levels.push_back(std::move(coarse));
+	}
+}
+
+MipMap::Level MipMap::makeLevel(int width, int height) {
+	Level level;
+	level.width = width;
+	level.height = height;
+	level.tiles_x = (width + tile_size - 1) >> tile_shift;
+	int tiles_y = (height + tile_size - 1) >> tile_shift;
+	level.texels.resize(static_cast<size_t>(level.tiles_x) * tiles_y * tile_size * tile_size, Eigen::Vector3f::Zero());
+	return level;
+}
+
+Color MipMap::bilinear(int level, float u, float v) const {
+	const auto &l = levels[std::clamp(level, 0, levelCount() - 1)];
+	float x = std::clamp(u, 0.0f, 1.0f) * l.width - 0.5f;
+	float y = (1 - std::clamp(v, 0.0f, 1.0f)) * l.height - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float dx = x - fx, dy = y - fy;
+	int x0 = std::max(static_cast<int>(fx), 0), x1 = std::min(static_cast<int>(fx) + 1, l.width - 1);
+	int y0 = std::max(static_cast<int>(fy), 0), y1 = std::min(static_cast<int>(fy) + 1, l.height - 1);
+	Eigen::Vector3f top = l.texel(x0, y0) * (1 - dx) + l.texel(x1, y0) * dx;
+	Eigen::Vector3f bottom = l.texel(x0, y1) * (1 - dx) + l.texel(x1, y1) * dx;
+	return (top * (1 - dy) + bottom * dy).cast<Real>();
+}
+
+Color MipMap::trilinear(float u, float v, float footprint) const {
+	// level 0 texels are 1 / max(width, height) wide, every level doubles that
+	float level = std::log2(std::max(footprint * std::max(width(), height()), 1.0f));
+	if (level <= 0)
+		return bilinear(0, u, v);
+	if (level >= levelCount() - 1)
+		return bilinear(levelCount() - 1, u, v);
+	int fine = static_cast<int>(level);
+	float t = level - fine;
+	return bilinear(fine, u, v) * (1 - t) + bilinear(fine + 1, u, v) * t;
+}
+
+int MipMap::levelCount() const { return static_cast<int>(levels.size()); }
+
+int MipMap::width() const { return levels[0].width; }
+
+int MipMap::height() const { return levels[0].height; }
+
+size_t MipMap::memoryUsage() const {
+	size_t bytes = 0;
+	for (const auto &level: levels)
+		bytes += level.texels.size() * sizeof(Eigen::Vector3f);
+	return bytes;
+}
+
+std::shared_ptr<const MipMap> TextureCache::load(const std::string &name, const std::string &parent) {
+	static std::mutex mutex;
+	static std::unordered_map<std::string, std::weak_ptr<const MipMap>> cache;
+	auto path = mkdir(parent, name);
+	std::lock_guard lock(mutex);
+	if (auto texture = cache[path].lock())
+		return texture;
+
+	Image image;
+	if (!image.load(name, parent)) {
+		spdlog::error("cannot load image from path: {}", path);
+		return nullptr;
+	}
+	// 8-bit files are gamma encoded the way images are written, undo it once here instead of on every lookup
+	float linear[256];
+	for (int i = 0; i < 256; i++)
+		linear[i] = (i / 255.0f) * (i / 255.0f);
+	std::vector<Eigen::Vector3f> texels(static_cast<size_t>(image.width()) * image.height());
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			auto pixel = image.pixelData(x, y);
+			texels[y * image.width() + x] = {linear[pixel[0]], linear[pixel[1]], linear[pixel[2]]};
+		}
+	}
+	auto texture = std::make_shared<const MipMap>(image.width(), image.height(), texels);
+	spdlog::info("texture {} loaded: {}x{}, {} levels, {:.1f}MB", path, texture->width(), texture->height(),
+				 texture->levelCount(), texture->memoryUsage() / 1048576.0);
+	cache[path] = texture;
+	return texture;
+}
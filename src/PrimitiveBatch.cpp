@@ -0,0 +1,200 @@
+/**
+ * @file PrimitiveBatch.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "PrimitiveBatch.h"
+#include <algorithm>
+#include <cmath>
+#include <typeinfo>
+#include "RenderStats.h"
+
+namespace {
+	// (a x b) . c for every lane
+	BatchReal crossDot(const BatchReal &ax, const BatchReal &ay, const BatchReal &az, const BatchReal &bx,
+					   const BatchReal &by, const BatchReal &bz, const BatchReal &cx, const BatchReal &cy,
+					   const BatchReal &cz) {
+		return (ay * bz - az * by) * cx + (az * bx - ax * bz) * cy + (ax * by - ay * bx) * cz;
+	}
+} // namespace
+
+PrimitiveBatch::PrimitiveBatch(const std::vector<std::shared_ptr<IHittable>> &primitives) {
+	kinds.resize(primitives.size());
+	// padded by a full batch so the last load of a run never reads past the end
+	for (auto &field : fields)
+		field.assign(primitives.size() + batch_width, 0);
+	auto store = [&](Field first, size_t i, const Vec3 &value) {
+		fields[first][i] = value.x();
+		fields[first + 1][i] = value.y();
+		fields[first + 2][i] = value.z();
+	};
+	for (size_t i = 0; i < primitives.size(); i++) {
+		const auto &object = *primitives[i];
+		kinds[i] = kindOf(object);
+		switch (kinds[i]) {
+			case PrimitiveKind::Sphere: {
+				const auto &sphere = static_cast<const Sphere &>(object);
+				store(px, i, sphere.position);
+				if (sphere.is_moving)
+					store(ux, i, sphere.direction_vec);
+				fields[s][i] = sphere.radius * sphere.radius;
+				break;
+			}
+			case PrimitiveKind::Quad: {
+				const auto &quad = static_cast<const Quad &>(object);
+				store(px, i, quad.Q);
+				store(ux, i, quad.u);
+				store(vx, i, quad.v);
+				store(nx, i, quad.normal);
+				store(wx, i, quad.w);
+				fields[s][i] = quad.D;
+				break;
+			}
+			case PrimitiveKind::Triangle: {
+				const auto &triangle = static_cast<const Triangle &>(object);
+				store(px, i, triangle.Q);
+				store(ux, i, triangle.u);
+				store(vx, i, triangle.v);
+				store(nx, i, triangle.normal);
+				store(wx, i, triangle.w);
+				fields[s][i] = triangle.D;
+				break;
+			}
+			case PrimitiveKind::Other:
+				break;
+		}
+	}
+}
+
+PrimitiveKind PrimitiveBatch::kindOf(const IHittable &object) {
+	// subclasses may override hit, only the exact types are safe to batch
+	const auto &type = typeid(object);
+	if (type == typeid(Sphere))
+		return PrimitiveKind::Sphere;
+	if (type == typeid(Quad))
+		return PrimitiveKind::Quad;
+	if (type == typeid(Triangle))
+		return PrimitiveKind::Triangle;
+	return PrimitiveKind::Other;
+}
+
+int64_t PrimitiveBatch::hit(PrimitiveKind kind, const Ray &r, uint32_t begin, uint32_t end, Real t_min,
+							Real &closest_t) const {
+	switch (kind) {
+		case PrimitiveKind::Sphere:
+			return hitSpheres(r, begin, end, t_min, closest_t);
+		case PrimitiveKind::Quad:
+		case PrimitiveKind::Triangle:
+			return hitPlanar(kind, r, begin, end, t_min, closest_t);
+		case PrimitiveKind::Other:
+			break;
+	}
+	return -1;
+}
+
+void PrimitiveBatch::countTests([[maybe_unused]] PrimitiveKind kind, [[maybe_unused]] uint32_t count) {
+	switch (kind) {
+		case PrimitiveKind::Sphere:
+			RAYTRACING_STAT(thread_stats.sphere_tests += count);
+			break;
+		case PrimitiveKind::Quad:
+			RAYTRACING_STAT(thread_stats.quad_tests += count);
+			break;
+		case PrimitiveKind::Triangle:
+			RAYTRACING_STAT(thread_stats.triangle_tests += count);
+			break;
+		case PrimitiveKind::Other:
+			break;
+	}
+}
+
+int64_t PrimitiveBatch::hitSpheres(const Ray &r, uint32_t begin, uint32_t end, Real t_min, Real &closest_t) const {
+	auto pos = r.pos();
+	auto dir = r.dir();
+	auto time = r.time();
+	auto a = dir.squaredNorm();
+	int64_t best = -1;
+	for (uint32_t i = begin; i < end; i += batch_width) {
+		BatchReal ocx = pos.x() - (load(px, i) + time * load(ux, i));
+		BatchReal ocy = pos.y() - (load(py, i) + time * load(uy, i));
+		BatchReal ocz = pos.z() - (load(pz, i) + time * load(uz, i));
+		BatchReal h = ocx * dir.x() + ocy * dir.y() + ocz * dir.z();
+		BatchReal c = ocx * ocx + ocy * ocy + ocz * ocz - load(s, i);
+		BatchReal discriminant = h * h - a * c;
+		BatchReal discri_sqrt = discriminant.max(0).sqrt();
+		BatchReal near_root = (-h - discri_sqrt) / a;
+		BatchReal far_root = (-h + discri_sqrt) / a;
+		// the arithmetic above runs on whole registers, picking the closest lane is cheaper done one by one
+		auto lanes = std::min<uint32_t>(batch_width, end - i);
+		for (uint32_t k = 0; k < lanes; k++) {
+			if (discriminant[k] < 0)
+				continue;
+			auto t = near_root[k];
+			if (!(t > t_min && t < closest_t)) {
+				t = far_root[k];
+				if (!(t > t_min && t < closest_t))
+					continue;
+			}
+			closest_t = t;
+			best = i + k;
+		}
+	}
+	return best;
+}
+
+int64_t PrimitiveBatch::hitPlanar(PrimitiveKind kind, const Ray &r, uint32_t begin, uint32_t end, Real t_min,
+								  Real &closest_t) const {
+	auto pos = r.pos();
+	auto dir = r.dir();
+	int64_t best = -1;
+	for (uint32_t i = begin; i < end; i += batch_width) {
+		BatchReal n_x = load(nx, i), n_y = load(ny, i), n_z = load(nz, i);
+		BatchReal denom = n_x * dir.x() + n_y * dir.y() + n_z * dir.z();
+		BatchReal t = (load(s, i) - (n_x * pos.x() + n_y * pos.y() + n_z * pos.z())) / denom;
+		auto lanes = std::min<uint32_t>(batch_width, end - i);
+		uint32_t candidates = 0;
+		for (uint32_t k = 0; k < lanes; k++) {
+			if (std::abs(denom[k]) >= 1e-8 && t[k] > t_min && t[k] < closest_t)
+				candidates |= 1u << k;
+		}
+		// most planes are behind the ray or past the closest hit, skip the inside test for them
+		if (candidates == 0)
+			continue;
+		BatchReal q_x = load(px, i), q_y = load(py, i), q_z = load(pz, i);
+		BatchReal u_x = load(ux, i), u_y = load(uy, i), u_z = load(uz, i);
+		BatchReal v_x = load(vx, i), v_y = load(vy, i), v_z = load(vz, i);
+		BatchReal hit_x = pos.x() + dir.x() * t;
+		BatchReal hit_y = pos.y() + dir.y() * t;
+		BatchReal hit_z = pos.z() + dir.z() * t;
+		if (kind == PrimitiveKind::Quad) {
+			BatchReal p_x = hit_x - q_x, p_y = hit_y - q_y, p_z = hit_z - q_z;
+			BatchReal w_x = load(wx, i), w_y = load(wy, i), w_z = load(wz, i);
+			BatchReal alpha = crossDot(p_x, p_y, p_z, v_x, v_y, v_z, w_x, w_y, w_z);
+			BatchReal beta = crossDot(u_x, u_y, u_z, p_x, p_y, p_z, w_x, w_y, w_z);
+			for (uint32_t k = 0; k < lanes; k++) {
+				if ((candidates >> k & 1) && alpha[k] >= 0 && alpha[k] <= 1 && beta[k] >= 0 && beta[k] <= 1 &&
+					t[k] < closest_t) {
+					closest_t = t[k];
+					best = i + k;
+				}
+			}
+			continue;
+		}
+		// same three edge tests as Triangle::inside, walking Q, Q + v, Q + u
+		BatchReal c2_x = q_x + v_x, c2_y = q_y + v_y, c2_z = q_z + v_z;
+		BatchReal s2_x = u_x - v_x, s2_y = u_y - v_y, s2_z = u_z - v_z;
+		BatchReal c3_x = c2_x + s2_x, c3_y = c2_y + s2_y, c3_z = c2_z + s2_z;
+		BatchReal edge0 = crossDot(v_x, v_y, v_z, hit_x - q_x, hit_y - q_y, hit_z - q_z, n_x, n_y, n_z);
+		BatchReal edge1 = crossDot(s2_x, s2_y, s2_z, hit_x - c2_x, hit_y - c2_y, hit_z - c2_z, n_x, n_y, n_z);
+		BatchReal edge2 = crossDot(-u_x, -u_y, -u_z, hit_x - c3_x, hit_y - c3_y, hit_z - c3_z, n_x, n_y, n_z);
+		for (uint32_t k = 0; k < lanes; k++) {
+			if ((candidates >> k & 1) && edge0[k] > 0 && edge1[k] > 0 && edge2[k] > 0 && t[k] < closest_t) {
+				closest_t = t[k];
+				best = i + k;
+			}
+		}
+	}
+	return best;
+}
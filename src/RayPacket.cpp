@@ -0,0 +1,32 @@
+/**
+ * @file RayPacket.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "RayPacket.h"
+
+RayPacket::RayPacket(const Ray *rays, int count) : rays(rays), count(count) {
+	for (int i = 0; i < packet_size; i++) {
+		// inactive lanes repeat the first ray so every lane holds finite values
+		const auto &r = rays[i < count ? i : 0];
+		auto pos = r.pos();
+		auto dir = r.dir();
+		ox[i] = static_cast<float>(pos[0]);
+		oy[i] = static_cast<float>(pos[1]);
+		oz[i] = static_cast<float>(pos[2]);
+		dx[i] = static_cast<float>(dir[0]);
+		dy[i] = static_cast<float>(dir[1]);
+		dz[i] = static_cast<float>(dir[2]);
+		time[i] = static_cast<float>(r.time());
+		active[i] = i < count;
+	}
+	inv_dx = dx.inverse();
+	inv_dy = dy.inverse();
+	inv_dz = dz.inverse();
+}
+
+PacketHit::PacketHit(float t_max) : t(PacketFloat::Constant(t_max)), uncertain(PacketMask::Constant(false)) {
+	object.fill(nullptr);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file RenderPool.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "RenderPool.h"
+
+RenderPool::RenderPool(int thread_count) {
+	std::lock_guard lock(mutex);
+	grow(thread_count);
+}
+
+RenderPool::~RenderPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads)
+		thread.join();
+}
+
+void RenderPool::run(int worker_count, const std::function<void(int)> &job) {
+	if (worker_count <= 0)
+		return;
+	std::lock_guard serial(run_mutex);
+	std::unique_lock lock(mutex);
+	grow(worker_count);
+	this->job = &job;
+	job_workers = worker_count;
+	remaining = worker_count;
+	generation++;
+	wake.notify_all();
+	done.wait(lock, [this] { return remaining == 0; });
+	this->job = nullptr;
+}
+
+int RenderPool::threadCount() const {
+	std::lock_guard lock(mutex);
+	return static_cast<int>(threads.size());
+}
+
+RenderPool &RenderPool::shared() {
+	static RenderPool pool;
+	return pool;
+}
+
+void RenderPool::grow(int count) {
+	// new threads wait for the generation after the current one, like the running ones
+	while (static_cast<int>(threads.size()) < count)
+		threads.emplace_back(&RenderPool::work, this, static_cast<int>(threads.size()), generation);
+}
+
+void RenderPool::work(int index, uint64_t seen) {
+	std::unique_lock lock(mutex);
+	while (true) {
+		wake.wait(lock, [&] { return stopping || generation != seen; });
+		if (stopping)
+			return;
+		seen = generation;
+		if (index >= job_workers)
+			continue;
+		const auto &current = *job;
+		lock.unlock();
+		current(index);
+		lock.lock();
+		if (--remaining == 0)
+			done.notify_one();
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ * @file RenderStats.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "RenderStats.h"
+#include <algorithm>
+#include <fstream>
+#include "spdlog/spdlog.h"
+
+#ifdef RAYTRACING_STATS
+constinit thread_local RenderStats thread_stats;
+#endif
+
+void RenderStats::merge(const RenderStats &other) {
+	primary_rays += other.primary_rays;
+	secondary_rays += other.secondary_rays;
+	shadow_rays += other.shadow_rays;
+	bvh_nodes += other.bvh_nodes;
+	sphere_tests += other.sphere_tests;
+	quad_tests += other.quad_tests;
+	triangle_tests += other.triangle_tests;
+	path_vertices += other.path_vertices;
+	tiles += other.tiles;
+	tile_ms += other.tile_ms;
+	max_tile_ms = std::max(max_tile_ms, other.max_tile_ms);
+}
+
+uint64_t RenderStats::rays() const { return primary_rays + secondary_rays + shadow_rays; }
+
+bool writeRenderStats(const std::vector<RenderStats> &workers, double seconds, const std::string &file) {
+	RenderStats total;
+	for (const auto &worker: workers)
+		total.merge(worker);
+	auto per = [](double count, uint64_t over) { return over == 0 ? 0.0 : count / static_cast<double>(over); };
+	std::ofstream out(file);
+	if (!out) {
+		spdlog::error("cannot write render stats to {}", file);
+		return false;
+	}
+	out << fmt::format("{{\n  \"threads\": {},\n  \"seconds\": {:.3f},\n", workers.size(), seconds);
+	out << fmt::format("  \"rays\": {{\"primary\": {}, \"secondary\": {}, \"shadow\": {}, \"total\": {}, "
+					   "\"per_second\": {:.0f}}},\n",
+					   total.primary_rays, total.secondary_rays, total.shadow_rays, total.rays(),
+					   seconds > 0 ? total.rays() / seconds : 0.0);
+	out << fmt::format("  \"bvh_nodes_visited\": {},\n  \"bvh_nodes_per_ray\": {:.2f},\n", total.bvh_nodes,
+					   per(total.bvh_nodes, total.rays()));
+	out << fmt::format("  \"primitive_tests\": {{\"sphere\": {}, \"quad\": {}, \"triangle\": {}}},\n",
+					   total.sphere_tests, total.quad_tests, total.triangle_tests);
+	out << fmt::format("  \"average_path_depth\": {:.3f},\n", per(total.path_vertices, total.primary_rays));
+	out << fmt::format("  \"tiles\": {{\"count\": {}, \"average_ms\": {:.3f}, \"max_ms\": {:.3f}}},\n", total.tiles,
+					   per(total.tile_ms, total.tiles), total.max_tile_ms);
+	// uneven busy times point at tiles that are too large for the scene
+	out << "  \"workers\": [";
+	for (size_t i = 0; i < workers.size(); i++) {
+		const auto &worker = workers[i];
+		out << fmt::format("{}\n    {{\"tiles\": {}, \"busy_ms\": {:.3f}, \"rays\": {}}}", i ? "," : "",
+						   worker.tiles, worker.tile_ms, worker.rays());
+	}
+	out << "\n  ]\n}\n";
+	return static_cast<bool>(out);
+}
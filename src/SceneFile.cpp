@@ -0,0 +1,968 @@
+/**
+ * @file SceneFile.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "SceneFile.h"
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include "BVH.h"
+#include "Instance.h"
+#include "MappedFile.h"
+#include "MeshLoader.h"
+#include "Texture.h"
+#include "TriangleMesh.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+	constexpr char cache_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+	constexpr uint32_t cache_version = 1;
+	constexpr uint32_t none = UINT32_MAX;
+	// each octave doubles the frequency, past this they are finer than float noise can resolve
+	constexpr int32_t max_octaves = 32;
+
+	bool validOctaves(double octaves) { return octaves >= 1 && octaves <= max_octaves && octaves == std::trunc(octaves); }
+
+	// everything below is written to the cache as is, so the fields are laid out without implicit padding
+
+	struct CacheHeader {
+		char magic[8];
+		uint32_t version;
+		// the trees are built over the boxes of one precision
+		uint32_t real_size;
+		uint64_t source_size;
+		int64_t source_time;
+	};
+
+	struct CameraDesc {
+		int32_t width = 400;
+		int32_t samples = 20;
+		int32_t depth = 50;
+		// 0 keeps the camera default
+		int32_t threads = 0;
+		int32_t chunk = 16;
+		uint32_t pad = 0;
+		double aspect = 16.0 / 9.0;
+		double fov = 40;
+		double from[3] = {0, 0, -10};
+		double at[3] = {0, 0, 0};
+		double dof = 0;
+		// 0 focuses on the target
+		double focus = 0;
+		double shutter = 1;
+		double background[3] = {0.7, 0.8, 1};
+	};
+
+	enum class TextureKind : uint32_t { Solid, Checker, Image, Noise, Terrain };
+
+	struct TextureDesc {
+		TextureKind kind;
+		// even and odd of Checker
+		uint32_t refs[2] = {none, none};
+		// string of Image
+		uint32_t file = none;
+		// color of Solid, scale of Checker, frequency, octaves and persistence of the noises
+		double params[3] = {};
+	};
+
+	enum class MaterialKind : uint32_t { Lambertian, Metal, Dielectric, Light };
+
+	struct MaterialDesc {
+		MaterialKind kind;
+		uint32_t texture;
+		// fuzz of Metal, index of refraction of Dielectric
+		double param = 0;
+	};
+
+	enum class ShapeKind : uint32_t { Sphere, MovingSphere, Quad, Triangle, Box, Mesh, Instance };
+
+	struct ShapeDesc {
+		ShapeKind kind;
+		// none keeps the materials of an instanced object
+		uint32_t material = none;
+		// mesh of Mesh, group of Instance
+		uint32_t ref = none;
+		uint32_t pad = 0;
+		// points and vectors in the order of the directive, translation, rotation and scale of Instance
+		double values[10] = {};
+	};
+
+	// a range of shapes, group 0 is the world and the rest are objects
+	struct GroupDesc {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct MeshDesc {
+		uint32_t file;
+		// range of mesh_materials
+		uint32_t first_material;
+		uint32_t material_count;
+		uint32_t pad = 0;
+		// of the mesh file when the scene was parsed
+		uint64_t file_size = 0;
+		int64_t file_time = 0;
+	};
+
+	struct SceneDesc {
+		uint32_t output = none;
+		CameraDesc camera;
+		std::vector<std::string> strings;
+		std::vector<TextureDesc> textures;
+		std::vector<MaterialDesc> materials;
+		std::vector<ShapeDesc> shapes;
+		std::vector<GroupDesc> groups;
+		std::vector<MeshDesc> meshes;
+		std::vector<uint32_t> mesh_materials;
+	};
+
+	struct Tree {
+		std::vector<LinearBVHNode> nodes;
+		std::vector<uint32_t> order;
+	};
+
+	// what a cache holds besides the description, in the order of the description
+	struct CachedTrees {
+		std::vector<std::shared_ptr<MeshData>> meshes;
+		std::vector<Tree> mesh_trees;
+		std::vector<Tree> group_trees;
+	};
+
+	struct BuiltScene {
+		Scene scene;
+		std::vector<std::shared_ptr<TriangleMesh>> meshes;
+		std::vector<std::shared_ptr<LinearBVH>> groups;
+		// what every group was built over, the trees refer to it
+		std::vector<std::vector<std::shared_ptr<IHittable>>> group_objects;
+	};
+
+	bool fileStamp(const std::string &file, uint64_t &size, int64_t &time) {
+		std::error_code error;
+		auto file_size = std::filesystem::file_size(file, error);
+		if (error)
+			return false;
+		auto file_time = std::filesystem::last_write_time(file, error);
+		if (error)
+			return false;
+		size = file_size;
+		time = file_time.time_since_epoch().count();
+		return true;
+	}
+
+	Vec3 toVec3(const double *v) {
+		return Vec3{static_cast<Real>(v[0]), static_cast<Real>(v[1]), static_cast<Real>(v[2])};
+	}
+
+	class SceneParser {
+	public:
+		SceneParser(const std::string &file, SceneDesc &desc) : file(file), desc(desc) {}
+
+		bool parse(std::string_view text) {
+			while (!text.empty()) {
+				auto end = text.find('\n');
+				auto line_text = text.substr(0, end);
+				text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+				line++;
+				line_text = line_text.substr(0, line_text.find('#'));
+				tokens.clear();
+				next = 0;
+				size_t i = 0;
+				while (i < line_text.size()) {
+					while (i < line_text.size() && std::isspace(static_cast<unsigned char>(line_text[i])))
+						i++;
+					auto start = i;
+					while (i < line_text.size() && !std::isspace(static_cast<unsigned char>(line_text[i])))
+						i++;
+					if (i > start)
+						tokens.push_back(line_text.substr(start, i - start));
+				}
+				if (tokens.empty())
+					continue;
+				if (!directive())
+					return false;
+				if (next < tokens.size())
+					return error(fmt::format("unexpected '{}'", tokens[next]));
+			}
+			if (current_group != 0)
+				return error("object without end");
+			for (auto &shapes : groups) {
+				desc.groups.push_back({static_cast<uint32_t>(desc.shapes.size()), static_cast<uint32_t>(shapes.size())});
+				desc.shapes.insert(desc.shapes.end(), shapes.begin(), shapes.end());
+			}
+			if (desc.output == none) {
+				auto stem = std::filesystem::path(file).stem().string();
+				desc.output = addString(stem + ".ppm");
+			}
+			return true;
+		}
+
+	private:
+		bool error(const std::string &message) const {
+			spdlog::error("{}:{}: {}", file, line, message);
+			return false;
+		}
+
+		bool word(std::string_view &value) {
+			if (next >= tokens.size())
+				return error("unexpected end of line");
+			value = tokens[next++];
+			return true;
+		}
+
+		bool isNumber() const {
+			double value;
+			return next < tokens.size() &&
+				   std::from_chars(tokens[next].data(), tokens[next].data() + tokens[next].size(), value).ec ==
+						   std::errc();
+		}
+
+		bool number(double &value) {
+			std::string_view token;
+			if (!word(token))
+				return false;
+			auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+			if (ec != std::errc() || end != token.data() + token.size() || !std::isfinite(value))
+				return error(fmt::format("'{}' is not a number", token));
+			return true;
+		}
+
+		bool integer(int32_t &value) {
+			double d;
+			if (!number(d))
+				return false;
+			if (!(d >= INT32_MIN && d <= INT32_MAX) || d != std::trunc(d))
+				return error(fmt::format("{} is not an integer", d));
+			value = static_cast<int32_t>(d);
+			return true;
+		}
+
+		bool vec3(double *value) { return number(value[0]) && number(value[1]) && number(value[2]); }
+
+		uint32_t addString(const std::string &value) {
+			desc.strings.push_back(value);
+			return static_cast<uint32_t>(desc.strings.size() - 1);
+		}
+
+		bool lookup(const std::unordered_map<std::string, uint32_t> &names, const char *what, uint32_t &index) {
+			std::string_view name;
+			if (!word(name))
+				return false;
+			auto it = names.find(std::string(name));
+			if (it == names.end())
+				return error(fmt::format("unknown {} '{}'", what, name));
+			index = it->second;
+			return true;
+		}
+
+		// a texture name, or an inline color that gets a texture of its own
+		bool texture(uint32_t &index) {
+			if (!isNumber())
+				return lookup(textures, "texture", index);
+			TextureDesc desc_texture{TextureKind::Solid};
+			if (!vec3(desc_texture.params))
+				return false;
+			index = static_cast<uint32_t>(desc.textures.size());
+			desc.textures.push_back(desc_texture);
+			return true;
+		}
+
+		bool defineName(std::unordered_map<std::string, uint32_t> &names, const char *what, std::string_view name,
+						uint32_t index) {
+			if (!names.emplace(std::string(name), index).second)
+				return error(fmt::format("{} '{}' is defined twice", what, name));
+			return true;
+		}
+
+		bool directive() {
+			std::string_view keyword;
+			word(keyword);
+			if (keyword == "output") {
+				std::string_view name;
+				if (!word(name))
+					return false;
+				desc.output = addString(std::string(name));
+				return true;
+			}
+			if (keyword == "camera")
+				return camera();
+			if (keyword == "texture")
+				return textureDirective();
+			if (keyword == "material")
+				return materialDirective();
+			if (keyword == "object") {
+				std::string_view name;
+				if (!word(name))
+					return false;
+				if (current_group != 0)
+					return error("objects cannot be nested");
+				current_group = static_cast<uint32_t>(groups.size());
+				groups.emplace_back();
+				return defineName(objects, "object", name, current_group);
+			}
+			if (keyword == "end") {
+				if (current_group == 0)
+					return error("end without object");
+				if (groups[current_group].empty())
+					return error("empty object");
+				current_group = 0;
+				return true;
+			}
+			ShapeDesc shape{};
+			bool parsed;
+			if (keyword == "sphere") {
+				shape.kind = ShapeKind::Sphere;
+				parsed = vec3(shape.values) && number(shape.values[3]) && lookup(materials, "material", shape.material);
+			} else if (keyword == "moving_sphere") {
+				shape.kind = ShapeKind::MovingSphere;
+				parsed = vec3(shape.values) && vec3(shape.values + 3) && number(shape.values[6]) &&
+						 lookup(materials, "material", shape.material);
+			} else if (keyword == "quad" || keyword == "triangle") {
+				shape.kind = keyword == "quad" ? ShapeKind::Quad : ShapeKind::Triangle;
+				parsed = vec3(shape.values) && vec3(shape.values + 3) && vec3(shape.values + 6) &&
+						 lookup(materials, "material", shape.material);
+			} else if (keyword == "box") {
+				shape.kind = ShapeKind::Box;
+				parsed = vec3(shape.values) && vec3(shape.values + 3) && lookup(materials, "material", shape.material);
+			} else if (keyword == "mesh") {
+				shape.kind = ShapeKind::Mesh;
+				parsed = mesh(shape);
+			} else if (keyword == "instance") {
+				shape.kind = ShapeKind::Instance;
+				parsed = instance(shape);
+			} else {
+				return error(fmt::format("unknown directive '{}'", keyword));
+			}
+			if (parsed)
+				groups[current_group].push_back(shape);
+			return parsed;
+		}
+
+		bool camera() {
+			auto &c = desc.camera;
+			while (next < tokens.size()) {
+				std::string_view key;
+				word(key);
+				bool parsed;
+				if (key == "width")
+					parsed = integer(c.width) && (c.width > 0 || error("width has to be positive"));
+				else if (key == "aspect")
+					parsed = number(c.aspect) && (c.aspect > 0 || error("aspect has to be positive"));
+				else if (key == "fov")
+					parsed = number(c.fov);
+				else if (key == "from")
+					parsed = vec3(c.from);
+				else if (key == "at")
+					parsed = vec3(c.at);
+				else if (key == "dof")
+					parsed = number(c.dof);
+				else if (key == "focus")
+					parsed = number(c.focus);
+				else if (key == "samples")
+					parsed = integer(c.samples) && (c.samples > 0 || error("samples have to be positive"));
+				else if (key == "depth")
+					parsed = integer(c.depth);
+				else if (key == "threads")
+					parsed = integer(c.threads);
+				else if (key == "chunk")
+					parsed = integer(c.chunk) && (c.chunk > 0 || error("chunk has to be positive"));
+				else if (key == "shutter")
+					parsed = number(c.shutter);
+				else if (key == "background")
+					parsed = vec3(c.background);
+				else
+					return error(fmt::format("unknown camera setting '{}'", key));
+				if (!parsed)
+					return false;
+			}
+			return true;
+		}
+
+		bool textureDirective() {
+			std::string_view name, kind;
+			if (!word(name) || !word(kind))
+				return false;
+			TextureDesc texture{};
+			bool parsed;
+			if (kind == "solid") {
+				texture.kind = TextureKind::Solid;
+				parsed = vec3(texture.params);
+			} else if (kind == "checker") {
+				texture.kind = TextureKind::Checker;
+				parsed = number(texture.params[0]) && this->texture(texture.refs[0]) && this->texture(texture.refs[1]);
+			} else if (kind == "image") {
+				texture.kind = TextureKind::Image;
+				std::string_view image;
+				parsed = word(image);
+				texture.file = addString(std::string(image));
+			} else if (kind == "noise" || kind == "terrain") {
+				texture.kind = kind == "noise" ? TextureKind::Noise : TextureKind::Terrain;
+				int32_t octaves = 0;
+				parsed = number(texture.params[0]) && integer(octaves) &&
+						 (validOctaves(octaves) ||
+						  error(fmt::format("octaves have to be between 1 and {}", max_octaves))) &&
+						 number(texture.params[2]);
+				texture.params[1] = octaves;
+			} else {
+				return error(fmt::format("unknown texture kind '{}'", kind));
+			}
+			if (!parsed)
+				return false;
+			desc.textures.push_back(texture);
+			return defineName(textures, "texture", name, static_cast<uint32_t>(desc.textures.size() - 1));
+		}
+
+		bool materialDirective() {
+			std::string_view name, kind;
+			if (!word(name) || !word(kind))
+				return false;
+			MaterialDesc material{};
+			bool parsed;
+			if (kind == "lambertian") {
+				material.kind = MaterialKind::Lambertian;
+				parsed = texture(material.texture);
+			} else if (kind == "metal") {
+				material.kind = MaterialKind::Metal;
+				parsed = texture(material.texture) && number(material.param);
+			} else if (kind == "dielectric") {
+				material.kind = MaterialKind::Dielectric;
+				parsed = number(material.param);
+				if (parsed && next == tokens.size()) {
+					TextureDesc white{TextureKind::Solid};
+					white.params[0] = white.params[1] = white.params[2] = 1;
+					material.texture = static_cast<uint32_t>(desc.textures.size());
+					desc.textures.push_back(white);
+				} else {
+					parsed = parsed && texture(material.texture);
+				}
+			} else if (kind == "light") {
+				material.kind = MaterialKind::Light;
+				parsed = texture(material.texture);
+			} else {
+				return error(fmt::format("unknown material kind '{}'", kind));
+			}
+			if (!parsed)
+				return false;
+			desc.materials.push_back(material);
+			return defineName(materials, "material", name, static_cast<uint32_t>(desc.materials.size() - 1));
+		}
+
+		bool mesh(ShapeDesc &shape) {
+			std::string_view name;
+			if (!word(name))
+				return false;
+			std::filesystem::path path(name);
+			if (path.is_relative())
+				path = std::filesystem::path(file).parent_path() / path;
+			MeshDesc mesh{addString(path.string()), static_cast<uint32_t>(desc.mesh_materials.size()), 0};
+			if (!fileStamp(desc.strings[mesh.file], mesh.file_size, mesh.file_time))
+				return error(fmt::format("cannot open {}", desc.strings[mesh.file]));
+			do {
+				uint32_t material;
+				if (!lookup(materials, "material", material))
+					return false;
+				desc.mesh_materials.push_back(material);
+				mesh.material_count++;
+			} while (next < tokens.size());
+			shape.ref = static_cast<uint32_t>(desc.meshes.size());
+			desc.meshes.push_back(mesh);
+			return true;
+		}
+
+		bool instance(ShapeDesc &shape) {
+			if (!lookup(objects, "object", shape.ref))
+				return false;
+			shape.values[6] = 1;
+			while (next < tokens.size()) {
+				std::string_view key;
+				word(key);
+				bool parsed;
+				if (key == "translate")
+					parsed = vec3(shape.values);
+				else if (key == "rotate")
+					parsed = vec3(shape.values + 3);
+				else if (key == "scale")
+					parsed = number(shape.values[6]) &&
+							 (static_cast<Real>(shape.values[6]) != 0 || error("scale cannot be 0"));
+				else if (key == "material")
+					parsed = lookup(materials, "material", shape.material);
+				else
+					return error(fmt::format("unknown instance setting '{}'", key));
+				if (!parsed)
+					return false;
+			}
+			return true;
+		}
+
+		const std::string &file;
+		SceneDesc &desc;
+		std::vector<std::string_view> tokens;
+		size_t next = 0;
+		int line = 0;
+		std::unordered_map<std::string, uint32_t> textures, materials, objects;
+		// shapes of the world and of every object, concatenated into desc at the end
+		std::vector<std::vector<ShapeDesc>> groups = std::vector<std::vector<ShapeDesc>>(1);
+		uint32_t current_group = 0;
+	};
+
+	bool validTree(const Tree &tree, size_t primitive_count) {
+		if (tree.order.size() != primitive_count || tree.nodes.empty() != (primitive_count == 0))
+			return false;
+		for (auto i : tree.order)
+			if (i >= primitive_count)
+				return false;
+		// children come after their parent, so the depth of a node is known once it is reached. the traversal stacks
+		// only hold LinearBVH::max_depth entries
+		std::vector<int> depth(tree.nodes.size(), 1);
+		for (size_t i = 0; i < tree.nodes.size(); i++) {
+			const auto &node = tree.nodes[i];
+			if (node.isLeaf()) {
+				if (node.primitive_offset + node.primitive_count > primitive_count)
+					return false;
+				continue;
+			}
+			if (node.second_child_offset <= i + 1 || node.second_child_offset >= tree.nodes.size() ||
+				depth[i] >= LinearBVH::max_depth)
+				return false;
+			depth[i + 1] = depth[node.second_child_offset] = depth[i] + 1;
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool allBelow(const std::vector<T> &values, size_t bound) {
+		for (auto value : values)
+			if (value >= bound)
+				return false;
+		return true;
+	}
+
+	std::optional<BuiltScene> buildScene(const SceneDesc &desc, const std::string &file, CachedTrees *cached) {
+		auto invalid = [&](const char *what) {
+			spdlog::error("{}: invalid {}", file, what);
+			return std::nullopt;
+		};
+		auto string = [&](uint32_t index) -> const std::string * {
+			return index < desc.strings.size() ? &desc.strings[index] : nullptr;
+		};
+		std::vector<std::shared_ptr<ITexture>> textures;
+		for (const auto &texture : desc.textures) {
+			const auto &p = texture.params;
+			switch (texture.kind) {
+				case TextureKind::Solid:
+					textures.push_back(std::make_shared<SolidColor>(toVec3(p)));
+					break;
+				case TextureKind::Checker:
+					if (texture.refs[0] >= textures.size() || texture.refs[1] >= textures.size())
+						return invalid("texture");
+					textures.push_back(std::make_shared<CheckerTexture>(static_cast<float>(p[0]),
+																		textures[texture.refs[0]],
+																		textures[texture.refs[1]]));
+					break;
+				case TextureKind::Image:
+					if (string(texture.file) == nullptr)
+						return invalid("texture");
+					textures.push_back(std::make_shared<ImageTexture>(*string(texture.file)));
+					break;
+				case TextureKind::Noise:
+					if (!validOctaves(p[1]))
+						return invalid("texture");
+					textures.push_back(std::make_shared<NoiseTexture>(static_cast<float>(p[0]), static_cast<int>(p[1]),
+																	  static_cast<float>(p[2])));
+					break;
+				case TextureKind::Terrain:
+					if (!validOctaves(p[1]))
+						return invalid("texture");
+					textures.push_back(std::make_shared<TerrainTexture>(static_cast<float>(p[0]), static_cast<int>(p[1]),
+																		static_cast<float>(p[2])));
+					break;
+				default:
+					return invalid("texture");
+			}
+		}
+
+		MaterialTable table;
+		std::vector<const IMaterial *> materials;
+		for (const auto &material : desc.materials) {
+			if (material.texture >= textures.size())
+				return invalid("material");
+			const auto &texture = textures[material.texture];
+			auto param = static_cast<float>(material.param);
+			switch (material.kind) {
+				case MaterialKind::Lambertian:
+					materials.push_back(table.add<Lambertian>(texture));
+					break;
+				case MaterialKind::Metal:
+					materials.push_back(table.add<Metal>(texture, param));
+					break;
+				case MaterialKind::Dielectric:
+					materials.push_back(table.add<Dielectric>(param, texture));
+					break;
+				case MaterialKind::Light:
+					materials.push_back(table.add<DiffuseLight>(texture));
+					break;
+				default:
+					return invalid("material");
+			}
+		}
+
+		std::vector<std::shared_ptr<TriangleMesh>> meshes;
+		for (size_t i = 0; i < desc.meshes.size(); i++) {
+			const auto &mesh = desc.meshes[i];
+			if (string(mesh.file) == nullptr || mesh.material_count == 0 ||
+				mesh.first_material + mesh.material_count > desc.mesh_materials.size())
+				return invalid("mesh");
+			std::vector<const IMaterial *> mesh_materials;
+			for (uint32_t m = 0; m < mesh.material_count; m++) {
+				auto material = desc.mesh_materials[mesh.first_material + m];
+				if (material >= materials.size())
+					return invalid("mesh");
+				mesh_materials.push_back(materials[material]);
+			}
+			if (cached != nullptr) {
+				meshes.push_back(std::make_shared<TriangleMesh>(cached->meshes[i], std::move(mesh_materials),
+																	  std::move(cached->mesh_trees[i].nodes),
+																	  std::move(cached->mesh_trees[i].order)));
+				continue;
+			}
+			auto data = loadMesh(*string(mesh.file));
+			if (data == nullptr)
+				return std::nullopt;
+			meshes.push_back(std::make_shared<TriangleMesh>(std::move(data), std::move(mesh_materials)));
+		}
+
+		// objects are built in order, so instances can refer to any object before them, and the world last
+		std::vector<std::shared_ptr<LinearBVH>> groups(desc.groups.size());
+		std::vector<std::vector<std::shared_ptr<IHittable>>> group_objects(desc.groups.size());
+		for (size_t n = 1; n <= desc.groups.size(); n++) {
+			auto g = n % desc.groups.size();
+			const auto &group = desc.groups[g];
+			if (group.first + group.count > desc.shapes.size())
+				return invalid("object");
+			auto &objects = group_objects[g];
+			for (uint32_t s = group.first; s < group.first + group.count; s++) {
+				const auto &shape = desc.shapes[s];
+				const auto &v = shape.values;
+				bool needs_material = shape.kind != ShapeKind::Mesh && shape.kind != ShapeKind::Instance;
+				if ((needs_material || shape.material != none) && shape.material >= materials.size())
+					return invalid("shape");
+				auto material = shape.material == none ? nullptr : materials[shape.material];
+				switch (shape.kind) {
+					case ShapeKind::Sphere:
+						objects.push_back(std::make_shared<Sphere>(static_cast<Real>(v[3]), toVec3(v), material));
+						break;
+					case ShapeKind::MovingSphere:
+						objects.push_back(
+								std::make_shared<Sphere>(static_cast<Real>(v[6]), toVec3(v), toVec3(v + 3), material));
+						break;
+					case ShapeKind::Quad:
+						objects.push_back(std::make_shared<Quad>(toVec3(v), toVec3(v + 3), toVec3(v + 6), material));
+						break;
+					case ShapeKind::Triangle:
+						objects.push_back(std::make_shared<Triangle>(toVec3(v), toVec3(v + 3), toVec3(v + 6), material));
+						break;
+					case ShapeKind::Box: {
+						// the sides go into the tree on their own
+						auto sides = box(toVec3(v), toVec3(v + 3), material);
+						objects.insert(objects.end(), sides->objects.begin(), sides->objects.end());
+						break;
+					}
+					case ShapeKind::Mesh:
+						if (shape.ref >= meshes.size())
+							return invalid("shape");
+						objects.push_back(meshes[shape.ref]);
+						break;
+					case ShapeKind::Instance: {
+						if (shape.ref == 0 || shape.ref >= groups.size() || (g != 0 && shape.ref >= g))
+							return invalid("shape");
+						// a zero scale makes the transform singular
+						if (!std::isfinite(v[6]) || static_cast<Real>(v[6]) == 0)
+							return invalid("instance scale");
+						auto transform = Instance::makeTransform(
+								toVec3(v), deg2Rad(static_cast<float>(v[3])), deg2Rad(static_cast<float>(v[4])),
+								deg2Rad(static_cast<float>(v[5])), static_cast<Real>(v[6]));
+						objects.push_back(std::make_shared<Instance>(groups[shape.ref], transform, material));
+						break;
+					}
+					default:
+						return invalid("shape");
+				}
+			}
+			if (cached != nullptr) {
+				auto &tree = cached->group_trees[g];
+				if (!validTree(tree, objects.size()))
+					return invalid("tree");
+				groups[g] = std::make_shared<LinearBVH>(objects, std::move(tree.nodes), tree.order);
+			} else {
+				groups[g] = std::make_shared<LinearBVH>(objects);
+			}
+		}
+
+		const auto &c = desc.camera;
+		Camera camera(c.width, static_cast<float>(c.aspect), static_cast<float>(c.fov), toVec3(c.from), toVec3(c.at),
+					  static_cast<float>(c.dof));
+		camera.setSampleCount(c.samples);
+		camera.setRenderDepth(c.depth);
+		if (c.threads > 0)
+			camera.setRenderThreadCount(c.threads);
+		camera.setChunkDimension(c.chunk);
+		camera.setShutterSpeed(static_cast<float>(c.shutter));
+		camera.setBackground(toVec3(c.background));
+		if (c.focus > 0)
+			camera.setFocalLen(static_cast<float>(c.focus));
+		if (string(desc.output) == nullptr)
+			return invalid("output");
+		Scene scene{*string(desc.output), std::move(table), HittableList(groups[0]), camera};
+		return BuiltScene{std::move(scene), std::move(meshes), std::move(groups), std::move(group_objects)};
+	}
+
+	class CacheWriter {
+	public:
+		template<typename T>
+		void write(const T &value) {
+			append(&value, sizeof(T));
+		}
+
+		template<typename T>
+		void writeArray(const std::vector<T> &values) {
+			write(static_cast<uint64_t>(values.size()));
+			// arrays start on a node boundary of the mapping
+			bytes.resize((bytes.size() + alignof(LinearBVHNode) - 1) / alignof(LinearBVHNode) * alignof(LinearBVHNode));
+			append(values.data(), values.size() * sizeof(T));
+		}
+
+		void writeStrings(const std::vector<std::string> &strings) {
+			write(static_cast<uint64_t>(strings.size()));
+			for (const auto &s : strings) {
+				write(static_cast<uint64_t>(s.size()));
+				append(s.data(), s.size());
+			}
+		}
+
+		bool save(const std::string &file) const {
+			// written aside and renamed, a reader never maps half a cache
+			auto temporary = file + ".tmp";
+			{
+				std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+				if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+					return false;
+			}
+			std::error_code error;
+			std::filesystem::rename(temporary, file, error);
+			return !error;
+		}
+
+		size_t size() const { return bytes.size(); }
+
+	private:
+		void append(const void *data, size_t size) {
+			auto p = static_cast<const char *>(data);
+			bytes.insert(bytes.end(), p, p + size);
+		}
+
+		std::vector<char> bytes;
+	};
+
+	class CacheReader {
+	public:
+		explicit CacheReader(std::string_view bytes) : bytes(bytes) {}
+
+		template<typename T>
+		bool read(T &value) {
+			if (bytes.size() - offset < sizeof(T))
+				return false;
+			std::memcpy(&value, bytes.data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		bool readArray(std::vector<T> &values) {
+			uint64_t count;
+			if (!read(count))
+				return false;
+			offset = (offset + alignof(LinearBVHNode) - 1) / alignof(LinearBVHNode) * alignof(LinearBVHNode);
+			if (offset > bytes.size() || count > (bytes.size() - offset) / sizeof(T))
+				return false;
+			values.resize(count);
+			std::memcpy(static_cast<void *>(values.data()), bytes.data() + offset, count * sizeof(T));
+			offset += count * sizeof(T);
+			return true;
+		}
+
+		bool readStrings(std::vector<std::string> &strings) {
+			uint64_t count;
+			if (!read(count) || count > bytes.size())
+				return false;
+			strings.resize(count);
+			for (auto &s : strings) {
+				uint64_t length;
+				if (!read(length) || length > bytes.size() - offset)
+					return false;
+				s.assign(bytes.data() + offset, length);
+				offset += length;
+			}
+			return true;
+		}
+
+	private:
+		std::string_view bytes;
+		size_t offset = 0;
+	};
+
+	bool writeCache(const std::string &cache, const CacheHeader &header, const SceneDesc &desc,
+					const BuiltScene &built) {
+		CacheWriter writer;
+		writer.write(header);
+		writer.write(desc.output);
+		writer.write(desc.camera);
+		writer.writeStrings(desc.strings);
+		writer.writeArray(desc.textures);
+		writer.writeArray(desc.materials);
+		writer.writeArray(desc.shapes);
+		writer.writeArray(desc.groups);
+		writer.writeArray(desc.meshes);
+		writer.writeArray(desc.mesh_materials);
+		for (const auto &mesh : built.meshes) {
+			const auto &data = mesh->meshData();
+			writer.writeArray(data.positions);
+			writer.writeArray(data.normals);
+			writer.writeArray(data.uvs);
+			writer.writeArray(data.indices);
+			writer.writeArray(data.normal_indices);
+			writer.writeArray(data.uv_indices);
+			writer.writeArray(data.material_ids);
+			writer.writeStrings(data.material_names);
+			writer.writeArray(mesh->flatNodes());
+			writer.writeArray(mesh->triangleOrder());
+		}
+		for (size_t g = 0; g < built.groups.size(); g++) {
+			writer.writeArray(built.groups[g]->flatNodes());
+			writer.writeArray(built.groups[g]->primitiveOrder(built.group_objects[g]));
+		}
+		if (!writer.save(cache)) {
+			spdlog::error("cannot write {}", cache);
+			return false;
+		}
+		spdlog::info("scene cache written to {}: {:.1f}MB", cache, writer.size() / 1048576.0);
+		return true;
+	}
+
+	/**
+	 * @return false when the cache is missing, stale or damaged
+	 */
+	bool readCache(const std::string &cache, const CacheHeader &expected, SceneDesc &desc, CachedTrees &trees) {
+		MappedFile mapping;
+		{
+			std::error_code error;
+			if (!std::filesystem::exists(cache, error) || !mapping.open(cache))
+				return false;
+		}
+		CacheReader reader(mapping.view());
+		CacheHeader header;
+		if (!reader.read(header) || std::memcmp(&header, &expected, sizeof(header)) != 0)
+			return false;
+		if (!reader.read(desc.output) || !reader.read(desc.camera) || !reader.readStrings(desc.strings) ||
+			!reader.readArray(desc.textures) || !reader.readArray(desc.materials) || !reader.readArray(desc.shapes) ||
+			!reader.readArray(desc.groups) || !reader.readArray(desc.meshes) || !reader.readArray(desc.mesh_materials))
+			return false;
+		if (desc.groups.empty())
+			return false;
+		for (const auto &mesh : desc.meshes) {
+			uint64_t size;
+			int64_t time;
+			if (mesh.file >= desc.strings.size() || !fileStamp(desc.strings[mesh.file], size, time) ||
+				size != mesh.file_size || time != mesh.file_time)
+				return false;
+		}
+		for (size_t i = 0; i < desc.meshes.size(); i++) {
+			auto data = std::make_shared<MeshData>();
+			Tree tree;
+			if (!reader.readArray(data->positions) || !reader.readArray(data->normals) || !reader.readArray(data->uvs) ||
+				!reader.readArray(data->indices) || !reader.readArray(data->normal_indices) ||
+				!reader.readArray(data->uv_indices) || !reader.readArray(data->material_ids) ||
+				!reader.readStrings(data->material_names) || !reader.readArray(tree.nodes) ||
+				!reader.readArray(tree.order))
+				return false;
+			auto triangles = data->triangleCount();
+			if (data->indices.size() != 3 * triangles || !allBelow(data->indices, data->positions.size()) ||
+				!(data->normal_indices.empty() || data->normal_indices.size() == data->indices.size()) ||
+				!allBelow(data->normal_indices, data->normals.size()) ||
+				!(data->uv_indices.empty() || data->uv_indices.size() == data->indices.size()) ||
+				!allBelow(data->uv_indices, data->uvs.size()) ||
+				!(data->material_ids.empty() || data->material_ids.size() == triangles) || !validTree(tree, triangles))
+				return false;
+			trees.meshes.push_back(std::move(data));
+			trees.mesh_trees.push_back(std::move(tree));
+		}
+		trees.group_trees.resize(desc.groups.size());
+		for (auto &tree : trees.group_trees)
+			if (!reader.readArray(tree.nodes) || !reader.readArray(tree.order))
+				return false;
+		return true;
+	}
+
+	bool readText(const std::string &file, SceneDesc &desc) {
+		MappedFile mapping;
+		if (!mapping.open(file))
+			return false;
+		return SceneParser(file, desc).parse(mapping.view());
+	}
+} // namespace
+
+std::optional<Scene> loadSceneFile(const std::string &file) {
+	auto begin = std::chrono::steady_clock::now();
+	SceneDesc desc;
+	if (!readText(file, desc))
+		return std::nullopt;
+	auto built = buildScene(desc, file, nullptr);
+	if (!built)
+		return std::nullopt;
+	auto end = std::chrono::steady_clock::now();
+	spdlog::info("scene {} loaded in {:.1f}ms", file, std::chrono::duration<double, std::milli>(end - begin).count());
+	return std::move(built->scene);
+}
+
+std::optional<Scene> loadScene(const std::string &file, const std::string &cache) {
+	auto begin = std::chrono::steady_clock::now();
+	CacheHeader header{};
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.real_size = sizeof(Real);
+	if (!fileStamp(file, header.source_size, header.source_time)) {
+		spdlog::error("cannot open {}", file);
+		return std::nullopt;
+	}
+
+	SceneDesc desc;
+	CachedTrees trees;
+	if (readCache(cache, header, desc, trees)) {
+		if (auto built = buildScene(desc, cache, &trees)) {
+			auto end = std::chrono::steady_clock::now();
+			spdlog::info("scene {} loaded from {} in {:.1f}ms", file, cache,
+						 std::chrono::duration<double, std::milli>(end - begin).count());
+			return std::move(built->scene);
+		}
+	}
+
+	desc = SceneDesc();
+	if (!readText(file, desc))
+		return std::nullopt;
+	auto built = buildScene(desc, file, nullptr);
+	if (!built)
+		return std::nullopt;
+	auto end = std::chrono::steady_clock::now();
+	spdlog::info("scene {} parsed and built in {:.1f}ms", file,
+				 std::chrono::duration<double, std::milli>(end - begin).count());
+	writeCache(cache, header, desc, *built);
+	return std::move(built->scene);
+}
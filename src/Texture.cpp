@@ -7,6 +7,10 @@
 
 #include "Texture.h"
 #include "MathUtil.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
 
 SolidColor::SolidColor(const Color &c) : color_val(c) {}
 
@@ -19,6 +23,14 @@ Color CheckerTexture::value(float u, float v, const Point3 &p) const {
 	bool is_even = (u_int + v_int) % 2 == 0;
 	return is_even ? even->value(u, v, p) : odd->value(u, v, p);
 }
+
+Color CheckerTexture::filteredValue(float u, float v, const Point3 &p, float footprint) const {
+	auto u_int = static_cast<int>(u * 50 * inv_scale);
+	auto v_int = static_cast<int>(v * 50 * inv_scale);
+
+	bool is_even = (u_int + v_int) % 2 == 0;
+	return is_even ? even->filteredValue(u, v, p, footprint) : odd->filteredValue(u, v, p, footprint);
+}
 CheckerTexture::CheckerTexture(float scale, std::shared_ptr<ITexture> even_tex, std::shared_ptr<ITexture> odd_tex) :
 	inv_scale(1 / scale), even(std::move(even_tex)), odd(std::move(odd_tex)) {}
 
@@ -29,35 +41,37 @@ CheckerTexture::CheckerTexture(float scale, const Color &even_color, const Color
 
 
 Color ImageTexture::value(float u, float v, const Point3 &p) const {
-	if (img.height() <= 0)
+	if (texture == nullptr)
 		return Color{0, 1, 1};
-
-	u = Interval(0, 1).clamp(u);
-	v = 1.0 - Interval(0, 1).clamp(v);
-
-	auto i = static_cast<int>(u * img.width());
-	auto j = static_cast<int>(v * img.height());
-	auto pixel = img.pixelData(i, j);
-
-	float color_scale = 1.0 / 255.0;
-	return Color{color_scale * pixel[0], color_scale * pixel[1], color_scale * pixel[2]};
+	return texture->bilinear(0, u, v);
 }
 
+Color ImageTexture::filteredValue(float u, float v, const Point3 &p, float footprint) const {
+	if (texture == nullptr)
+		return Color{0, 1, 1};
+	return texture->trilinear(u, v, footprint);
+}
 
-ImageTexture::ImageTexture(const std::string &image, const std::string &parent) : img(Image(image, parent)) {}
+ImageTexture::ImageTexture(const std::string &image, const std::string &parent) :
+	texture(TextureCache::load(image, parent)) {}
 
 NoiseTexture::NoiseTexture(float frequency, int octave_count, float presistence) :
 	frequency(frequency), octave_count(octave_count), persistence(presistence) {}
 
 Color NoiseTexture::value(float u, float v, const Point3 &p) const {
-	return Color{1, 1, 1} * fabs(sin(10 * noise.octaveNoise(p, frequency, octave_count, persistence) + 5));
+	float n = volume != nullptr ? volume->value(p) : noise.octaveNoise(p, frequency, octave_count, persistence);
+	return Color{1, 1, 1} * fabs(sin(10 * n + 5));
+}
+
+void NoiseTexture::bake(const AABB &region, int resolution) {
+	volume = std::make_shared<NoiseVolume>(noise, frequency, octave_count, persistence, region, resolution);
 }
 
 TerrainTexture::TerrainTexture(float frequency, int octave_count, float presistence) :
 	frequency(frequency), octave_count(octave_count), persistence(presistence) {}
 
 Color TerrainTexture::value(float u, float v, const Point3 &p) const {
-	float height = noise.octaveNoise(p, frequency, octave_count, persistence);
+	float height = volume != nullptr ? volume->value(p) : noise.octaveNoise(p, frequency, octave_count, persistence);
 	if (Interval(-1, 0).within(height)) {
 		return Color{0, 0, 1} + Color{0, 0, 0xee / 255.0} * height;
 	}
@@ -72,3 +86,94 @@ Color TerrainTexture::value(float u, float v, const Point3 &p) const {
 		return Color{0, 0, 0};
 	}
 }
+
+void TerrainTexture::bake(const AABB &region, int resolution) {
+	volume = std::make_shared<NoiseVolume>(noise, frequency, octave_count, persistence, region, resolution);
+}
+
+NoiseVolume::NoiseVolume(const Perlin &noise, float frequency, int octave_count, float persistence,
+						 const AABB &region, int resolution) :
+	noise(noise), frequency(frequency), octave_count(octave_count), persistence(persistence),
+	origin(region.x.min, region.y.min, region.z.min) {
+	auto begin = std::chrono::steady_clock::now();
+	Real longest = std::max({region.x.max - region.x.min, region.y.max - region.y.min, region.z.max - region.z.min});
+	cells_per_unit = resolution / longest;
+	for (int i = 0; i < 3; i++)
+		size[i] = std::max(2, static_cast<int>(std::ceil((region.axis(i).max - region.axis(i).min) * cells_per_unit)) + 1);
+	samples.resize(static_cast<size_t>(size[0]) * size[1] * size[2]);
+	// slabs of constant z are independent
+	auto bakeSlabs = [&](int z_begin, int z_end) {
+		for (int k = z_begin; k < z_end; k++)
+			for (int j = 0; j < size[1]; j++)
+				for (int i = 0; i < size[0]; i++) {
+					Point3 p = origin + Vec3(i, j, k) / cells_per_unit;
+					samples[(static_cast<size_t>(k) * size[1] + j) * size[0] + i] =
+							noise.octaveNoise(p, frequency, octave_count, persistence);
+				}
+	};
+	int workers = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::future<void>> futures;
+	for (int w = 1; w < workers; w++)
+		futures.push_back(std::async(std::launch::async, bakeSlabs, size[2] * w / workers, size[2] * (w + 1) / workers));
+	bakeSlabs(0, size[2] / workers);
+	for (auto &future: futures)
+		future.get();
+	auto end = std::chrono::steady_clock::now();
+	spdlog::info("noise baked in {:.1f}ms: {}x{}x{} samples, {:.1f}MB",
+				 std::chrono::duration<double, std::milli>(end - begin).count(), size[0], size[1], size[2],
+				 memoryUsage() / 1048576.0);
+}
+
+float NoiseVolume::value(const Point3 &p) const {
+	Vec3 grid = (p - origin) * cells_per_unit;
+	int cell[3];
+	float t[3];
+	for (int i = 0; i < 3; i++) {
+		if (!(grid[i] >= 0 && grid[i] <= size[i] - 1))
+			return noise.octaveNoise(p, frequency, octave_count, persistence);
+		cell[i] = std::min(static_cast<int>(grid[i]), size[i] - 2);
+		t[i] = static_cast<float>(grid[i] - cell[i]);
+	}
+	auto at = [&](int dx, int dy, int dz) {
+		return samples[(static_cast<size_t>(cell[2] + dz) * size[1] + cell[1] + dy) * size[0] + cell[0] + dx];
+	};
+	float x00 = at(0, 0, 0) + t[0] * (at(1, 0, 0) - at(0, 0, 0));
+	float x10 = at(0, 1, 0) + t[0] * (at(1, 1, 0) - at(0, 1, 0));
+	float x01 = at(0, 0, 1) + t[0] * (at(1, 0, 1) - at(0, 0, 1));
+	float x11 = at(0, 1, 1) + t[0] * (at(1, 1, 1) - at(0, 1, 1));
+	float y0 = x00 + t[1] * (x10 - x00);
+	float y1 = x01 + t[1] * (x11 - x01);
+	return y0 + t[2] * (y1 - y0);
+}
+
+size_t NoiseVolume::memoryUsage() const { return samples.size() * sizeof(float); }
+
+uint32_t TextureTable::add(const ITexture *texture) {
+	if (auto it = indices.find(texture); it != indices.end())
+		return it->second;
+	FlatTexture flat;
+	flat.texture = texture;
+	// exact types only, a subclass may override value
+	const auto &type = typeid(*texture);
+	if (type == typeid(SolidColor)) {
+		flat.kind = FlatTexture::Kind::Solid;
+		flat.color = static_cast<const SolidColor *>(texture)->color_val;
+	} else if (type == typeid(CheckerTexture)) {
+		auto checker = static_cast<const CheckerTexture *>(texture);
+		flat.kind = FlatTexture::Kind::Checker;
+		flat.inv_scale = checker->inv_scale;
+		flat.even = add(checker->even.get());
+		flat.odd = add(checker->odd.get());
+	} else if (type == typeid(ImageTexture)) {
+		flat.kind = FlatTexture::Kind::Image;
+		flat.image = static_cast<const ImageTexture *>(texture)->texture.get();
+	} else if (type == typeid(NoiseTexture)) {
+		flat.kind = FlatTexture::Kind::Noise;
+	} else if (type == typeid(TerrainTexture)) {
+		flat.kind = FlatTexture::Kind::Terrain;
+	}
+	auto index = static_cast<uint32_t>(textures.size());
+	textures.push_back(flat);
+	indices.emplace(texture, index);
+	return index;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file TileScheduler.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief
+ */
+
+#include "TileScheduler.h"
+#include <algorithm>
+
+TileScheduler::TileScheduler(int width, int height, int tile_dimension, int worker_count, SchedulePolicy policy) :
+	width(width), height(height), tile_dimension(std::max(1, tile_dimension)), worker_count(std::max(1, worker_count)),
+	policy(policy) {
+	tiles_x = (width + this->tile_dimension - 1) / this->tile_dimension;
+	int tiles_y = (height + this->tile_dimension - 1) / this->tile_dimension;
+	tile_count = tiles_x * tiles_y;
+	ranges = std::make_unique<WorkerRange[]>(this->worker_count);
+	for (int i = 0; i < this->worker_count; i++) {
+		auto begin = static_cast<uint32_t>(static_cast<int64_t>(tile_count) * i / this->worker_count);
+		auto end = static_cast<uint32_t>(static_cast<int64_t>(tile_count) * (i + 1) / this->worker_count);
+		ranges[i].range.store(pack(begin, end), std::memory_order_relaxed);
+	}
+}
+
+uint64_t TileScheduler::pack(uint32_t begin, uint32_t end) {
+	return static_cast<uint64_t>(end) << 32 | begin;
+}
+
+bool TileScheduler::popFront(int worker, int &idx) {
+	auto &range = ranges[worker].range;
+	auto current = range.load(std::memory_order_relaxed);
+	while (true) {
+		auto begin = static_cast<uint32_t>(current);
+		auto end = static_cast<uint32_t>(current >> 32);
+		if (begin >= end)
+			return false;
+		if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel,
+										std::memory_order_relaxed)) {
+			idx = static_cast<int>(begin);
+			return true;
+		}
+	}
+}
+
+bool TileScheduler::stealBack(int victim, int &idx) {
+	auto &range = ranges[victim].range;
+	auto current = range.load(std::memory_order_relaxed);
+	while (true) {
+		auto begin = static_cast<uint32_t>(current);
+		auto end = static_cast<uint32_t>(current >> 32);
+		if (begin >= end)
+			return false;
+		if (range.compare_exchange_weak(current, pack(begin, end - 1), std::memory_order_acq_rel,
+										std::memory_order_relaxed)) {
+			idx = static_cast<int>(end - 1);
+			return true;
+		}
+	}
+}
+
+bool TileScheduler::next(int worker, Tile &tile) {
+	int idx;
+	if (policy == SchedulePolicy::SharedCounter) {
+		idx = counter.fetch_add(1, std::memory_order_relaxed);
+		if (idx >= tile_count)
+			return false;
+		tile = makeTile(idx);
+		return true;
+	}
+	if (popFront(worker, idx)) {
+		tile = makeTile(idx);
+		return true;
+	}
+	for (int i = 1; i < worker_count; i++) {
+		if (stealBack((worker + i) % worker_count, idx)) {
+			tile = makeTile(idx);
+			return true;
+		}
+	}
+	return false;
+}
+
+Tile TileScheduler::makeTile(int idx) const {
+	Tile tile;
+	tile.idx = idx;
+	tile.startx = (idx % tiles_x) * tile_dimension;
+	tile.starty = (idx / tiles_x) * tile_dimension;
+	tile.width = std::min(tile_dimension, width - tile.startx);
+	tile.height = std::min(tile_dimension, height - tile.starty);
+	return tile;
+}
+
+int TileScheduler::tileCount() const { return tile_count; }
+
+int TileScheduler::workerCount() const { return worker_count; }
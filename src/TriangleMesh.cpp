@@ -0,0 +1,150 @@
+/**
+ * @file TriangleMesh.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief
+ */
+
+#include "TriangleMesh.h"
+#include <algorithm>
+#include <cmath>
+#include "RenderStats.h"
+#include "spdlog/spdlog.h"
+
+size_t MeshData::memoryUsage() const {
+	return positions.size() * sizeof(positions[0]) + normals.size() * sizeof(normals[0]) +
+		   uvs.size() * sizeof(uvs[0]) +
+		   (indices.size() + normal_indices.size() + uv_indices.size()) * sizeof(uint32_t) +
+		   material_ids.size() * sizeof(uint16_t);
+}
+
+TriangleMesh::TriangleMesh(std::shared_ptr<const MeshData> data, std::vector<const IMaterial *> materials) :
+	data(std::move(data)), materials(std::move(materials)) {
+	if (this->materials.empty()) {
+		spdlog::error("mesh without materials, it is left empty");
+		return;
+	}
+	const auto &mesh = *this->data;
+	std::vector<AABB> boxes(mesh.triangleCount());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		const auto &p0 = mesh.positions[mesh.indices[3 * i]];
+		const auto &p1 = mesh.positions[mesh.indices[3 * i + 1]];
+		const auto &p2 = mesh.positions[mesh.indices[3 * i + 2]];
+		Eigen::Vector3f min = p0.cwiseMin(p1).cwiseMin(p2);
+		Eigen::Vector3f max = p0.cwiseMax(p1).cwiseMax(p2);
+		boxes[i] = AABB(min.cast<Real>(), max.cast<Real>());
+	}
+	BVHBuildReport report;
+	nodes = LinearBVH::buildNodes(boxes, order, report);
+	if (nodes.empty())
+		return;
+	setBoundingBox();
+	spdlog::info("mesh bvh built in {}ms: {} triangles, {} nodes, depth {}, {:.1f}MB", report.build_time_ms,
+				 report.primitive_count, report.node_count, report.depth,
+				 (mesh.memoryUsage() + memoryUsage()) / 1048576.0);
+}
+
+TriangleMesh::TriangleMesh(std::shared_ptr<const MeshData> data, std::vector<const IMaterial *> materials,
+						   std::vector<LinearBVHNode> nodes, std::vector<uint32_t> order) :
+	data(std::move(data)), materials(std::move(materials)), nodes(std::move(nodes)), order(std::move(order)) {
+	if (this->materials.empty()) {
+		spdlog::error("mesh without materials, it is left empty");
+		this->nodes.clear();
+		return;
+	}
+	if (!this->nodes.empty())
+		setBoundingBox();
+}
+
+void TriangleMesh::setBoundingBox() {
+	const auto &root = nodes.front();
+	bbox = AABB(Point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+				Point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+}
+
+bool TriangleMesh::hit(const Ray &r, Interval interval, HitRecord &record) const {
+	if (nodes.empty())
+		return false;
+	bool if_hit = false;
+	auto closest_t = interval.max;
+	LinearBVH::traverseNodes(nodes, 0, r, interval.min, closest_t, [&](const LinearBVHNode &node) {
+		for (uint32_t i = node.primitive_offset; i < node.primitive_offset + node.primitive_count; i++) {
+			if (hitTriangle(order[i], r, Interval(interval.min, closest_t), record)) {
+				if_hit = true;
+				closest_t = record.t;
+			}
+		}
+	});
+	return if_hit;
+}
+
+bool TriangleMesh::hitTriangle(uint32_t triangle, const Ray &r, Interval interval, HitRecord &record) const {
+	RAYTRACING_STAT(thread_stats.triangle_tests++);
+	const auto &mesh = *data;
+	const uint32_t *idx = &mesh.indices[3 * triangle];
+	Vec3 p0 = mesh.positions[idx[0]].cast<Real>();
+	Vec3 e1 = mesh.positions[idx[1]].cast<Real>() - p0;
+	Vec3 e2 = mesh.positions[idx[2]].cast<Real>() - p0;
+	// Moller-Trumbore, the barycentrics fall out of the same determinants as t
+	Vec3 pvec = r.dir().cross(e2);
+	Real det = e1.dot(pvec);
+	if (std::abs(det) < 1e-12)
+		return false;
+	Real inv_det = 1 / det;
+	Vec3 tvec = r.pos() - p0;
+	Real b1 = tvec.dot(pvec) * inv_det;
+	if (b1 < 0 || b1 > 1)
+		return false;
+	Vec3 qvec = tvec.cross(e1);
+	Real b2 = r.dir().dot(qvec) * inv_det;
+	if (b2 < 0 || b1 + b2 > 1)
+		return false;
+	Real t = e2.dot(qvec) * inv_det;
+	if (!interval.surround(t))
+		return false;
+
+	Real b0 = 1 - b1 - b2;
+	record.t = t;
+	record.p = r.at(t);
+	// the geometric normal decides the side, interpolated normals only shade
+	Vec3 geometric = e1.cross(e2);
+	Real area = geometric.norm();
+	record.setFaceNormal(r, geometric / area);
+	if (!mesh.normal_indices.empty()) {
+		const uint32_t *n = &mesh.normal_indices[3 * triangle];
+		Vec3 shading = (b0 * mesh.normals[n[0]].cast<Real>() + b1 * mesh.normals[n[1]].cast<Real>() +
+						b2 * mesh.normals[n[2]].cast<Real>());
+		if (shading.squaredNorm() > 0)
+			record.normal = record.front_face ? Vec3(shading.normalized()) : Vec3(-shading.normalized());
+	}
+	if (!mesh.uv_indices.empty()) {
+		const uint32_t *uv = &mesh.uv_indices[3 * triangle];
+		Eigen::Vector2f coord = static_cast<float>(b0) * mesh.uvs[uv[0]] + static_cast<float>(b1) * mesh.uvs[uv[1]] +
+								static_cast<float>(b2) * mesh.uvs[uv[2]];
+		record.u = coord.x();
+		record.v = coord.y();
+		Eigen::Vector2f d1 = mesh.uvs[uv[1]] - mesh.uvs[uv[0]], d2 = mesh.uvs[uv[2]] - mesh.uvs[uv[0]];
+		record.uv_density = std::sqrt(std::abs(d1.x() * d2.y() - d1.y() * d2.x()) / static_cast<float>(area));
+	} else {
+		record.u = static_cast<float>(b1);
+		record.v = static_cast<float>(b2);
+		record.uv_density = static_cast<float>(1 / std::sqrt(area));
+	}
+	size_t material = mesh.material_ids.empty() ? 0 : mesh.material_ids[triangle];
+	record.material = materials[std::min(material, materials.size() - 1)];
+	return true;
+}
+
+AABB TriangleMesh::boundingBox() const { return bbox; }
+
+size_t TriangleMesh::triangleCount() const { return data->triangleCount(); }
+
+size_t TriangleMesh::memoryUsage() const {
+	return nodes.size() * sizeof(LinearBVHNode) + order.size() * sizeof(uint32_t);
+}
+
+const MeshData &TriangleMesh::meshData() const { return *data; }
+
+const std::vector<LinearBVHNode> &TriangleMesh::flatNodes() const { return nodes; }
+
+const std::vector<uint32_t> &TriangleMesh::triangleOrder() const { return order; }
@@ -1,6 +1,17 @@
+#include <string>
+#include "SceneFile.h"
 #include "scenes.h"
 
-int main() {
+int main(int argc, char **argv) {
+	// a scene file on the command line replaces the bundled scenes, its cache sits next to it
+	if (argc > 1) {
+		std::string file = argv[1];
+		auto scene = loadScene(file, file + ".cache");
+		if (!scene)
+			return 1;
+		render(*scene);
+		return 0;
+	}
 
 	switch (9) {
 		case 0:
@@ -39,6 +50,9 @@ int main() {
 		case 11:
 			targetingTest();
 			break;
+		case 12:
+			instances();
+			break;
 		default:
 			break;
 	}
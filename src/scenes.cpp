@@ -9,10 +9,14 @@
 #include <memory>
 #include <spdlog/fmt/fmt.h>
 #include <string>
+#include <utility>
+#include "BVH.h"
 #include "Camera.h"
+#include "FrameSequence.h"
 #include "GlobUtil.hpp"
 #include "GraphicObjects.h"
 #include "ImageUtil.h"
+#include "Instance.h"
 #include "Material.h"
 #include "MathUtil.h"
 #include "Texture.h"
@@ -28,7 +32,10 @@ void render(HittableList world, Camera camera, const std::string &name = "test.p
 #endif
 }
 
-void randomSpheres() {
+void render(const Scene &scene) { render(scene.world, scene.camera, scene.name); }
+
+Scene makeRandomSpheres() {
+	MaterialTable materials;
 
 	auto camera = Camera(1920, 16.0 / 9.0, 30, {-13, 2, 3}, {4, 1, 0}, 0.6);
 
@@ -40,37 +47,36 @@ void randomSpheres() {
 	camera.setBackground(Color{0.7, 0.8, 1});
 	auto world = HittableList();
 	auto checker = std::make_shared<CheckerTexture>(0.1, Color{0.05, 0.1, 0.1}, Color{0.9, 0.9, 0.9});
-	auto ground_material = std::make_shared<Lambertian>(Lambertian(checker));
-	auto left_ball_material = std::make_shared<Lambertian>(Color{0.357, 0.816, 0.98});
-	auto center_ball_material = std::make_shared<Metal>(Metal(Color{0.965, 0.671, 0.729}, 0.4));
-	auto right_ball_material = std::make_shared<Dielectric>(Dielectric(1.5, Color{0.8, 0.8, 0.8}));
-	world.add(std::make_shared<Quad>(Eigen::Vector3d{-500, 0, -500}, Eigen::Vector3d{0, 0, 1000},
-									 Eigen::Vector3d{1000, 0, 0}, ground_material));
-	world.add(std::make_shared<Sphere>(Sphere(1, Eigen::Vector3d{0, 1, 0}, center_ball_material)));
-	world.add(std::make_shared<Sphere>(Sphere(1, Eigen::Vector3d{4, 1, 0}, right_ball_material)));
-	world.add(std::make_shared<Sphere>(Sphere(1, Eigen::Vector3d{-4, 1, 0}, left_ball_material)));
+	auto ground_material = materials.add<Lambertian>(checker);
+	auto left_ball_material = materials.add<Lambertian>(Color{0.357, 0.816, 0.98});
+	auto center_ball_material = materials.add<Metal>(Color{0.965, 0.671, 0.729}, 0.4);
+	auto right_ball_material = materials.add<Dielectric>(1.5, Color{0.8, 0.8, 0.8});
+	world.add(std::make_shared<Quad>(Vec3{-500, 0, -500}, Vec3{0, 0, 1000}, Vec3{1000, 0, 0}, ground_material));
+	world.add(std::make_shared<Sphere>(1, Vec3{0, 1, 0}, center_ball_material));
+	world.add(std::make_shared<Sphere>(1, Vec3{4, 1, 0}, right_ball_material));
+	world.add(std::make_shared<Sphere>(1, Vec3{-4, 1, 0}, left_ball_material));
 	int obj = 0;
 	for (int i = -22; i < 22; i += 2) {
 		for (int j = -22; j < 22; j += 2) {
 			obj++;
-			auto coord = Eigen::Vector3d{(i + randomFloat(-1, 1)), 0.2, (j + randomFloat(-1, 1))};
-			auto displacement = Eigen::Vector3d{0, randomFloat(0, 0), 0};
+			auto coord = Vec3{(i + randomFloat(-1, 1)), 0.2, (j + randomFloat(-1, 1))};
+			auto displacement = Vec3{0, randomFloat(0, 0), 0};
 			auto material = static_cast<int>(3.0 * randomFloat());
-			if ((coord - Eigen::Vector3d{0, 1, 0}).norm() > 0.9) {
-				Eigen::Vector3d color = randomVec3().cwiseProduct(randomVec3());
-				std::shared_ptr<IMaterial> sphere_mat;
+			if ((coord - Vec3{0, 1, 0}).norm() > 0.9) {
+				Vec3 color = randomVec3().cwiseProduct(randomVec3());
+				const IMaterial *sphere_mat;
 				switch (material) {
 					case 0:
-						sphere_mat = std::make_shared<Lambertian>(color);
+						sphere_mat = materials.add<Lambertian>(color);
 						world.add(std::make_shared<Sphere>(0.2, coord, coord + displacement, sphere_mat));
 						break;
 					case 1:
-						sphere_mat = std::make_shared<Metal>(color, randomFloat(0.2, 0.5));
+						sphere_mat = materials.add<Metal>(color, randomFloat(0.2, 0.5));
 						world.add(std::make_shared<Sphere>(0.2, coord, coord + displacement, sphere_mat));
 						break;
 					case 2:
 						color = randomVec3(0.7, 1);
-						sphere_mat = std::make_shared<Dielectric>(randomFloat(1, 2), color);
+						sphere_mat = materials.add<Dielectric>(randomFloat(1, 2), color);
 						world.add(std::make_shared<Sphere>(0.2, coord, coord + displacement, sphere_mat));
 						break;
 					default:
@@ -79,11 +85,14 @@ void randomSpheres() {
 			}
 		}
 	}
-	world = HittableList(std::make_shared<BVHNode>(world));
-	render(world, camera, "randomSpheres.ppm");
+	world = HittableList(std::make_shared<LinearBVH>(world));
+	return {"randomSpheres.ppm", std::move(materials), world, camera};
 }
 
-void twoSpheres() {
+void randomSpheres() { render(makeRandomSpheres()); }
+
+Scene makeTwoSpheres() {
+	MaterialTable materials;
 	auto camera = Camera(400, 16.0 / 9.0, 30, {0, 0, 0}, {0, 0, -30}, 0.6);
 	camera.setSampleCount(100);
 	camera.setShutterSpeed(1.0 / 24.0);
@@ -94,14 +103,17 @@ void twoSpheres() {
 
 	auto world = HittableList();
 	auto checker = std::make_shared<CheckerTexture>(2, Color{0.1, 0.1, 0.1}, Color{0.9, 0.9, 0.9});
-	auto sphere_material = std::make_shared<Lambertian>(Lambertian(checker));
+	auto sphere_material = materials.add<Lambertian>(checker);
 	world.add(std::make_shared<Sphere>(20.0, Point3{0, -20.0, -30}, sphere_material));
 	world.add(std::make_shared<Sphere>(20.0, Point3{0, 20.0, -30}, sphere_material));
-	world = HittableList(std::make_shared<BVHNode>(world));
-	render(world, camera, "twoSpheres.ppm");
+	world = HittableList(std::make_shared<LinearBVH>(world));
+	return {"twoSpheres.ppm", std::move(materials), world, camera};
 }
 
-void huajiSphere() {
+void twoSpheres() { render(makeTwoSpheres()); }
+
+Scene makeHuajiSphere() {
+	MaterialTable materials;
 	auto camera = Camera(400, 16.0 / 9.0, 45, {30, 0, -30}, {0, 0, 0}, 0.1);
 	camera.setSampleCount(100);
 	camera.setShutterSpeed(1.0 / 24.0);
@@ -111,13 +123,16 @@ void huajiSphere() {
 	camera.setBackground(Color{0.7, 0.8, 1});
 	auto world = HittableList();
 	auto huaji_texture = std::make_shared<ImageTexture>("huaji.jpeg");
-	auto huaji_material = std::make_shared<Lambertian>(huaji_texture);
+	auto huaji_material = materials.add<Lambertian>(huaji_texture);
 	world.add(std::make_shared<Sphere>(10.0, Point3{0, 0, -30}, huaji_material));
-	world = HittableList(std::make_shared<BVHNode>(world));
-	render(world, camera, "huajiSphere.ppm");
+	world = HittableList(std::make_shared<LinearBVH>(world));
+	return {"huajiSphere.ppm", std::move(materials), world, camera};
 }
 
-void perlinSpheres() {
+void huajiSphere() { render(makeHuajiSphere()); }
+
+static Scene perlinSpheresScene(bool baked) {
+	MaterialTable materials;
 	HittableList world;
 	Camera camera(1920, 16.0 / 9.0, 20, Point3{-13, 2, 3}, Point3{0, 0, 0}, 0);
 	camera.setSampleCount(100);
@@ -127,13 +142,22 @@ void perlinSpheres() {
 	camera.setChunkDimension(64);
 	camera.setBackground(Color{0.7, 0.8, 1});
 	auto tex = std::make_shared<NoiseTexture>(1, 10, 0.5);
-	world.add(std::make_shared<Sphere>(1000, Point3{0, -1000, 0}, std::make_shared<Lambertian>(tex)));
-	world.add(std::make_shared<Sphere>(2, Point3{0, 2, 0}, std::make_shared<Lambertian>(tex)));
+	if (baked)
+		tex->bake(AABB{Point3{-15, -0.5, -15}, Point3{15, 4.5, 15}}, 256);
+	world.add(std::make_shared<Sphere>(1000, Point3{0, -1000, 0}, materials.add<Lambertian>(tex)));
+	world.add(std::make_shared<Sphere>(2, Point3{0, 2, 0}, materials.add<Lambertian>(tex)));
 
-	render(world, camera, "perlinSpheres.ppm");
+	return {baked ? "bakedPerlinSpheres.ppm" : "perlinSpheres.ppm", std::move(materials), world, camera};
 }
 
-void terrain() {
+Scene makePerlinSpheres() { return perlinSpheresScene(false); }
+
+Scene makeBakedPerlinSpheres() { return perlinSpheresScene(true); }
+
+void perlinSpheres() { render(makePerlinSpheres()); }
+
+static Scene terrainScene(bool baked) {
+	MaterialTable materials;
 	HittableList world;
 	Camera camera(400, 16.0 / 9.0, 20, Point3{0, 0, -50}, Point3{0, 0, 0}, 0);
 	camera.setSampleCount(10);
@@ -143,12 +167,21 @@ void terrain() {
 	camera.setChunkDimension(64);
 	camera.setBackground(Color{0.7, 0.8, 1});
 	auto tex = std::make_shared<TerrainTexture>(0.5, 10, 0.5);
-	world.add(std::make_shared<Sphere>(10, Point3{0, 0, 0}, std::make_shared<Lambertian>(tex)));
+	if (baked)
+		tex->bake(AABB{Point3{-10, -10, -10}, Point3{10, 10, 10}}, 160);
+	world.add(std::make_shared<Sphere>(10, Point3{0, 0, 0}, materials.add<Lambertian>(tex)));
 
-	render(world, camera, "terrain.ppm");
+	return {baked ? "bakedTerrain.ppm" : "terrain.ppm", std::move(materials), world, camera};
 }
 
+Scene makeTerrain() { return terrainScene(false); }
+
+Scene makeBakedTerrain() { return terrainScene(true); }
+
+void terrain() { render(makeTerrain()); }
+
 void rotationTest() {
+	MaterialTable materials;
 	HittableList world;
 	Camera camera(400, 16.0 / 9.0, 70, {0, 0, 0}, {0, 0, 1}, 0);
 	camera.setSampleCount(10);
@@ -158,12 +191,12 @@ void rotationTest() {
 	camera.setChunkDimension(34);
 	camera.setBackground(Color{0.3, 0.4, 0.5});
 	auto tex = std::make_shared<ImageTexture>("huaji.jpeg");
-	auto mat_posz = std::make_shared<Lambertian>(Color{0, 0, 1});
-	auto mat_negz = std::make_shared<Lambertian>(Color{0, 0, 0.2});
-	auto mat_posx = std::make_shared<Lambertian>(Color{1, 0, 0});
-	auto mat_negx = std::make_shared<Lambertian>(Color{0.2, 0, 0});
-	auto mat_posy = std::make_shared<Lambertian>(Color{0, 1, 0});
-	auto mat_negy = std::make_shared<Lambertian>(Color{0, 0.2, 0});
+	auto mat_posz = materials.add<Lambertian>(Color{0, 0, 1});
+	auto mat_negz = materials.add<Lambertian>(Color{0, 0, 0.2});
+	auto mat_posx = materials.add<Lambertian>(Color{1, 0, 0});
+	auto mat_negx = materials.add<Lambertian>(Color{0.2, 0, 0});
+	auto mat_posy = materials.add<Lambertian>(Color{0, 1, 0});
+	auto mat_negy = materials.add<Lambertian>(Color{0, 0.2, 0});
 	world.add(std::make_shared<Sphere>(1, Point3{0, 0, 5}, mat_posz));
 	world.add(std::make_shared<Sphere>(1, Point3{0, 0, -5}, mat_negz));
 	world.add(std::make_shared<Sphere>(1, Point3{0, 5, 0}, mat_posy));
@@ -171,30 +204,22 @@ void rotationTest() {
 	world.add(std::make_shared<Sphere>(1, Point3{5, 0, 0}, mat_posx));
 	world.add(std::make_shared<Sphere>(1, Point3{-5, 0, 0}, mat_negx));
 
-	world = HittableList(std::make_shared<BVHNode>(world));
-	auto rot_init = Eigen::Vector3d{0, 2 * PI / 36, 0};
-	for (int i = 0; i < 36; ++i) {
-		camera.setRotation(rot_init * i);
-		render(world, camera, "frame_" + std::to_string(i) + "_" + vecToStr(camera.getRotation()) + ".ppm",
-			   std::string(IMG_OUTPUT_DIR) + "/theta");
-	}
-	camera.setRotation({0, 0, 0});
-	rot_init = Eigen::Vector3d{2 * PI / 36, 0, 0};
-	for (int i = 0; i < 36; ++i) {
-		camera.setRotation(rot_init * i);
-		render(world, camera, "frame_" + std::to_string(i) + "_" + vecToStr(camera.getRotation()) + ".ppm",
-			   std::string(IMG_OUTPUT_DIR) + "/phi");
-	}
-	camera.setRotation({0, 0, 0});
-	rot_init = Eigen::Vector3d{0, 0, 2 * PI / 36};
-	for (int i = 0; i < 36; ++i) {
-		camera.setRotation(rot_init * i);
-		render(world, camera, "frame_" + std::to_string(i) + "_" + vecToStr(camera.getRotation()) + ".ppm",
-			   std::string(IMG_OUTPUT_DIR) + "/psi");
+	world = HittableList(std::make_shared<LinearBVH>(world));
+	// each sweep renders its next frame while the previous one is written
+	const std::pair<Vec3, const char *> sweeps[] = {
+			{Vec3{0, 2 * PI / 36, 0}, "theta"}, {Vec3{2 * PI / 36, 0, 0}, "phi"}, {Vec3{0, 0, 2 * PI / 36}, "psi"}};
+	for (const auto &[step, dir]: sweeps) {
+		std::vector<Frame> frames;
+		for (int i = 0; i < 36; ++i) {
+			camera.setRotation(step * i);
+			frames.push_back({camera, "frame_" + std::to_string(i) + "_" + vecToStr(camera.getRotation()) + ".ppm"});
+		}
+		renderSequence(world, frames, std::string(IMG_OUTPUT_DIR) + "/" + dir);
 	}
 }
 
 void targetingTest() {
+	MaterialTable materials;
 	auto camera = Camera(400, 16.0 / 9.0, 20, {0, 0, 0}, {0, 0, -1}, 0);
 	camera.setBackground(Color{0.7, 0.8, 1});
 	camera.setSampleCount(20);
@@ -202,19 +227,19 @@ void targetingTest() {
 	auto ball_dist = 8;
 	auto ball_rad = 1;
 	auto world = HittableList();
-	std::vector<Eigen::Vector3d> pos1;
-	std::vector<Eigen::Vector3d> pos2;
-	for (double i = 0; i < 2 * PI; i += 2 * PI / ball_cnt) {
-		double x = ball_dist * cos(i);
-		double z = ball_dist * sin(i);
+	std::vector<Vec3> pos1;
+	std::vector<Vec3> pos2;
+	for (Real i = 0; i < 2 * PI; i += 2 * PI / ball_cnt) {
+		Real x = ball_dist * cos(i);
+		Real z = ball_dist * sin(i);
 		pos1.emplace_back(x, 0, z);
 		pos2.emplace_back(0, x, z);
 		auto color = Color{i / (2 * PI), 0, 0};
 		auto color2 = Color{0, i / (2 * PI), 0};
-		auto mat = std::make_shared<Lambertian>(color);
-		auto mat2 = std::make_shared<Lambertian>(color2);
-		world.add(std::make_shared<Sphere>(ball_rad, Eigen::Vector3d{x, 0, z}, mat));
-		world.add(std::make_shared<Sphere>(ball_rad, Eigen::Vector3d{0, x, z}, mat2));
+		auto mat = materials.add<Lambertian>(color);
+		auto mat2 = materials.add<Lambertian>(color2);
+		world.add(std::make_shared<Sphere>(ball_rad, Vec3{x, 0, z}, mat));
+		world.add(std::make_shared<Sphere>(ball_rad, Vec3{0, x, z}, mat2));
 	}
 
 	Camera overview = camera;
@@ -245,18 +270,19 @@ void targetingTest() {
 	}
 }
 
-void quads() {
+Scene makeQuads() {
+	MaterialTable materials;
 	HittableList world;
 
-	auto blue = std::make_shared<Lambertian>(Color{0.36, 0.81, 0.98});
-	auto pink = std::make_shared<Lambertian>(Color{0.96, 0.66, 0.72});
-	auto white = std::make_shared<Lambertian>(Color{1, 1, 1});
+	auto blue = materials.add<Lambertian>(Color{0.36, 0.81, 0.98});
+	auto pink = materials.add<Lambertian>(Color{0.96, 0.66, 0.72});
+	auto white = materials.add<Lambertian>(Color{1, 1, 1});
 
-	world.add(std::make_shared<Quad>(Point3{-3, -2, 5}, Eigen::Vector3d{0, 0, -4}, Eigen::Vector3d{0, 4, 0}, blue));
-	world.add(std::make_shared<Quad>(Point3{-2, -2, 0}, Eigen::Vector3d{4, 0, 0}, Eigen::Vector3d{0, 4, 0}, white));
-	world.add(std::make_shared<Quad>(Point3{3, -2, 1}, Eigen::Vector3d{0, 0, 4}, Eigen::Vector3d{0, 4, 0}, pink));
-	world.add(std::make_shared<Quad>(Point3{-2, 3, 1}, Eigen::Vector3d{4, 0, 0}, Eigen::Vector3d{0, 0, 4}, blue));
-	world.add(std::make_shared<Quad>(Point3{-2, -3, 5}, Eigen::Vector3d{4, 0, 0}, Eigen::Vector3d{0, 0, -4}, pink));
+	world.add(std::make_shared<Quad>(Point3{-3, -2, 5}, Vec3{0, 0, -4}, Vec3{0, 4, 0}, blue));
+	world.add(std::make_shared<Quad>(Point3{-2, -2, 0}, Vec3{4, 0, 0}, Vec3{0, 4, 0}, white));
+	world.add(std::make_shared<Quad>(Point3{3, -2, 1}, Vec3{0, 0, 4}, Vec3{0, 4, 0}, pink));
+	world.add(std::make_shared<Quad>(Point3{-2, 3, 1}, Vec3{4, 0, 0}, Vec3{0, 0, 4}, blue));
+	world.add(std::make_shared<Quad>(Point3{-2, -3, 5}, Vec3{4, 0, 0}, Vec3{0, 0, -4}, pink));
 	Camera camera(1920, 9.0 / 9.0, 90, {0, 0, 9}, {0, 0, 0}, 0);
 	camera.setSampleCount(100);
 	camera.setShutterSpeed(1.0 / 24.0);
@@ -264,20 +290,22 @@ void quads() {
 	camera.setRenderThreadCount(12);
 	camera.setChunkDimension(64);
 	camera.setBackground(Color{0.7, 0.8, 1});
-	render(world, camera, "quads.ppm");
+	return {"quads.ppm", std::move(materials), world, camera};
 }
 
-void triangles() {
+void quads() { render(makeQuads()); }
+
+Scene makeTriangles() {
+	MaterialTable materials;
 	HittableList world;
 
-	auto blue = std::make_shared<Lambertian>(Color{0.36, 0.81, 0.98});
-	auto pink = std::make_shared<Lambertian>(Color{0.96, 0.66, 0.72});
-	auto white = std::make_shared<Lambertian>(Color{1, 1, 1});
+	auto blue = materials.add<Lambertian>(Color{0.36, 0.81, 0.98});
+	auto pink = materials.add<Lambertian>(Color{0.96, 0.66, 0.72});
 
 	Point3 p1{1.5, 1.5, 0};
 	Point3 p2{-1.5, -1.5, 0};
-	Eigen::Vector3d vertical{3, 0, 0};
-	Eigen::Vector3d horizontal{0, 3, 0};
+	Vec3 vertical{3, 0, 0};
+	Vec3 horizontal{0, 3, 0};
 
 	world.add(std::make_shared<Triangle>(p1, -vertical, -horizontal, blue));
 	world.add(std::make_shared<Triangle>(p2, vertical, horizontal, pink));
@@ -288,77 +316,139 @@ void triangles() {
 	camera.setRenderThreadCount(12);
 	camera.setChunkDimension(64);
 	camera.setBackground(Color{0.7, 0.8, 1});
-	render(world, camera, "triangle.ppm");
+	return {"triangle.ppm", std::move(materials), world, camera};
 }
 
-void cornellBox() {
-	auto red = std::make_shared<Lambertian>(Color{.65, .05, .05});
-	auto white = std::make_shared<Lambertian>(Color{.73, .73, .73});
-	auto green = std::make_shared<Lambertian>(Color{.12, .45, .15});
-	auto light = std::make_shared<DiffuseLight>(Color{15, 15, 15});
+void triangles() { render(makeTriangles()); }
+
+Scene makeCornellBox() {
+	MaterialTable materials;
+	auto red = materials.add<Lambertian>(Color{.65, .05, .05});
+	auto white = materials.add<Lambertian>(Color{.73, .73, .73});
+	auto green = materials.add<Lambertian>(Color{.12, .45, .15});
+	auto light = materials.add<DiffuseLight>(Color{15, 15, 15});
 	HittableList world;
 
-	world.add(std::make_shared<Quad>(Point3{555, 0, 0}, Eigen::Vector3d{0, 555, 0}, Eigen::Vector3d{0, 0, 555}, green));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Eigen::Vector3d{0, 555, 0}, Eigen::Vector3d{0, 0, 555}, red));
-	world.add(std::make_shared<Quad>(Point3{343, 554, 332}, Eigen::Vector3d{-130, 0, 0}, Eigen::Vector3d{0, 0, -105},
-									 light));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Eigen::Vector3d{555, 0, 0}, Eigen::Vector3d{0, 0, 555}, white));
-	world.add(std::make_shared<Quad>(Point3{555, 555, 555}, Eigen::Vector3d{-555, 0, 0}, Eigen::Vector3d{0, 0, -555},
-									 white));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 555}, Eigen::Vector3d{555, 0, 0}, Eigen::Vector3d{0, 555, 0}, white));
+	world.add(std::make_shared<Quad>(Point3{555, 0, 0}, Vec3{0, 555, 0}, Vec3{0, 0, 555}, green));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Vec3{0, 555, 0}, Vec3{0, 0, 555}, red));
+	world.add(std::make_shared<Quad>(Point3{343, 554, 332}, Vec3{-130, 0, 0}, Vec3{0, 0, -105}, light));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Vec3{555, 0, 0}, Vec3{0, 0, 555}, white));
+	world.add(std::make_shared<Quad>(Point3{555, 555, 555}, Vec3{-555, 0, 0}, Vec3{0, 0, -555}, white));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 555}, Vec3{555, 0, 0}, Vec3{0, 555, 0}, white));
 
 	Camera camera(1920, 16.0 / 9.0, 40, {278, 278, -800}, {278, 278, 0}, 0);
-	camera.setSampleCount(10000);
+	camera.setSampleCount(1000);
 	camera.setShutterSpeed(1.0 / 24.0);
 	camera.setRenderDepth(4);
 	camera.setRenderThreadCount(12);
 	camera.setChunkDimension(64);
 	camera.setBackground(Color{0, 0, 0});
 
-	world = HittableList(std::make_shared<BVHNode>(world));
+	world = HittableList(std::make_shared<LinearBVH>(world));
 
-	render(world, camera, "emptyCornell.ppm");
+	return {"emptyCornell.ppm", std::move(materials), world, camera};
 }
 
-void cornellBoxWithObjects() {
-	auto red = std::make_shared<Lambertian>(Color{.65, .05, .05});
-	auto white = std::make_shared<Lambertian>(Color{.73, .73, .73});
-	auto green = std::make_shared<Lambertian>(Color{.12, .45, .15});
-	auto blue = std::make_shared<Lambertian>(Color{0, 0, 1});
-	auto light = std::make_shared<DiffuseLight>(Color{15, 15, 15});
+void cornellBox() { render(makeCornellBox()); }
+
+Scene makeCornellBoxWithObjects() {
+	MaterialTable materials;
+	auto red = materials.add<Lambertian>(Color{.65, .05, .05});
+	auto white = materials.add<Lambertian>(Color{.73, .73, .73});
+	auto green = materials.add<Lambertian>(Color{.12, .45, .15});
+	auto light = materials.add<DiffuseLight>(Color{15, 15, 15});
 	HittableList world;
 
-	world.add(std::make_shared<Quad>(Point3{555, 0, 0}, Eigen::Vector3d{0, 555, 0}, Eigen::Vector3d{0, 0, 555}, green));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Eigen::Vector3d{0, 555, 0}, Eigen::Vector3d{0, 0, 555}, red));
-	world.add(std::make_shared<Quad>(Point3{343, 554, 332}, Eigen::Vector3d{-130, 0, 0}, Eigen::Vector3d{0, 0, -105},
-									 light));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Eigen::Vector3d{555, 0, 0}, Eigen::Vector3d{0, 0, 555}, white));
-	world.add(std::make_shared<Quad>(Point3{555, 555, 555}, Eigen::Vector3d{-555, 0, 0}, Eigen::Vector3d{0, 0, -555},
-									 white));
-	world.add(std::make_shared<Quad>(Point3{0, 0, 555}, Eigen::Vector3d{555, 0, 0}, Eigen::Vector3d{0, 555, 0}, white));
+	world.add(std::make_shared<Quad>(Point3{555, 0, 0}, Vec3{0, 555, 0}, Vec3{0, 0, 555}, green));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Vec3{0, 555, 0}, Vec3{0, 0, 555}, red));
+	world.add(std::make_shared<Quad>(Point3{343, 554, 332}, Vec3{-130, 0, 0}, Vec3{0, 0, -105}, light));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 0}, Vec3{555, 0, 0}, Vec3{0, 0, 555}, white));
+	world.add(std::make_shared<Quad>(Point3{555, 555, 555}, Vec3{-555, 0, 0}, Vec3{0, 0, -555}, white));
+	world.add(std::make_shared<Quad>(Point3{0, 0, 555}, Vec3{555, 0, 0}, Vec3{0, 555, 0}, white));
 
 	Camera camera(800, 16.0 / 9.0, 40, {278, 278, -800}, {278, 278, 0}, 0);
 	camera.setSampleCount(20);
 	camera.setShutterSpeed(1.0 / 24.0);
 	camera.setRenderDepth(4);
 	camera.setRenderThreadCount(12);
-	camera.setChunkDimension(64);
+	camera.setChunkDimension(16);
 	camera.setBackground(Color{0, 0, 0});
 
 	std::shared_ptr<IHittable> box1 = box(Point3{0, 0, 0}, Point3{165, 330, 165}, white);
 
 	box1 = std::make_shared<Rotation>(box1, 0, deg2Rad(-15), 0, Point3{0, 0, 0});
-	box1 = std::make_shared<Translate>(box1, Eigen::Vector3d{265, 0, 295});
+	box1 = std::make_shared<Translate>(box1, Vec3{265, 0, 295});
 
 	std::shared_ptr<IHittable> box2 = box(Point3{0, 0, 0}, Point3{165, 165, 165}, red);
 
 	box2 = std::make_shared<Rotation>(box2, 0, deg2Rad(18), 0, Point3{0, 0, 0});
-	box2 = std::make_shared<Translate>(box2, Eigen::Vector3d{130, 0, 65});
+	box2 = std::make_shared<Translate>(box2, Vec3{130, 0, 65});
 
 	world.add(box1);
 	world.add(box2);
 
-	world = HittableList(std::make_shared<BVHNode>(world));
+	world = HittableList(std::make_shared<LinearBVH>(world));
+
+	return {"cornell.ppm", std::move(materials), world, camera};
+}
+
+void cornellBoxWithObjects() { render(makeCornellBoxWithObjects()); }
+
+Scene makeInstances() {
+	MaterialTable materials;
+	auto ground = materials.add<Lambertian>(Color{0.48, 0.83, 0.53});
+	const IMaterial *palette[] = {
+			materials.add<Lambertian>(Color{0.36, 0.81, 0.98}),
+			materials.add<Lambertian>(Color{0.96, 0.66, 0.72}),
+			materials.add<Lambertian>(Color{0.9, 0.9, 0.9}),
+			materials.add<Metal>(Color{0.8, 0.8, 0.9}, 0.1),
+	};
+	HittableList world;
+	world.add(std::make_shared<Quad>(Point3{-60, 0, -60}, Vec3{0, 0, 120}, Vec3{120, 0, 0}, ground));
+
+	// ten thousand boxes, all of them the same six quads
+	std::shared_ptr<IHittable> unit_box =
+			std::make_shared<LinearBVH>(*box(Point3{-0.5, 0, -0.5}, Point3{0.5, 1, 0.5}, palette[0]));
+	PCG32 rng(7, 1);
+	std::vector<std::shared_ptr<IHittable>> instances;
+	for (int i = -50; i < 50; i++) {
+		for (int j = -50; j < 50; j++) {
+			Vec3 position{i + randomFloat(rng, 0.2, 0.8), 0, j + randomFloat(rng, 0.2, 0.8)};
+			auto transform = Instance::makeTransform(position, 0, randomFloat(rng, 0, PI), 0,
+													 randomFloat(rng, 0.2, 0.5));
+			auto material = palette[std::min(static_cast<int>(4 * randomFloat(rng)), 3)];
+			instances.push_back(std::make_shared<Instance>(unit_box, transform, material));
+		}
+	}
+	world.add(std::make_shared<LinearBVH>(instances));
+
+	Camera camera(1920, 16.0 / 9.0, 40, {-20, 5, 4}, {0, 0, 0}, 0);
+	camera.setSampleCount(100);
+	camera.setShutterSpeed(1.0 / 24.0);
+	camera.setRenderDepth(50);
+	camera.setRenderThreadCount(12);
+	camera.setChunkDimension(64);
+	camera.setBackground(Color{0.7, 0.8, 1});
+	world = HittableList(std::make_shared<LinearBVH>(world));
+	return {"instances.ppm", std::move(materials), world, camera};
+}
 
-	render(world, camera, "cornell.ppm");
+void instances() { render(makeInstances()); }
+
+std::span<const BundledScene> bundledScenes() {
+	static constexpr BundledScene scenes[] = {
+			{"randomSpheres", makeRandomSpheres},
+			{"twoSpheres", makeTwoSpheres},
+			{"huajiSphere", makeHuajiSphere},
+			{"perlinSpheres", makePerlinSpheres},
+			{"bakedPerlinSpheres", makeBakedPerlinSpheres},
+			{"terrain", makeTerrain},
+			{"bakedTerrain", makeBakedTerrain},
+			{"quads", makeQuads},
+			{"triangles", makeTriangles},
+			{"cornellBox", makeCornellBox},
+			{"cornellBoxWithObjects", makeCornellBoxWithObjects},
+			{"instances", makeInstances},
+	};
+	return scenes;
 }